@@ -36,6 +36,85 @@ namespace Cycling74.RNBOTypes {
         public const byte SYSEX_END = 0xF7;
     }
 
+    //Builds the packed buffer for sending many timestamped MIDI messages in one call, see SendMIDIPacked
+    //Each record is a float64 time, a uint8 port, a uint16 length and the MIDI bytes, which may use running status
+    public class MIDIStreamBuffer {
+        List<byte> data = new List<byte>();
+
+        public void Add(MillisecondTime time, byte[] bytes, byte port = 0) {
+            data.AddRange(BitConverter.GetBytes(time));
+            data.Add(port);
+            data.Add((byte)(bytes.Length & 0xFF));
+            data.Add((byte)((bytes.Length >> 8) & 0xFF));
+            data.AddRange(bytes);
+        }
+
+        public void Clear() {
+            data.Clear();
+        }
+
+        public int Length => data.Count;
+        public byte[] ToArray() => data.ToArray();
+
+        //Walk a packed buffer, like the ones delivered by MIDIEvent or CopyMIDIOut
+        public static int Unpack(byte[] packed, int length, Action<MillisecondTime, byte, byte[]> each) {
+            const int header = sizeof(double) + 3;
+            int pos = 0;
+            int count = 0;
+            while (pos + header <= length) {
+                MillisecondTime time = BitConverter.ToDouble(packed, pos);
+                byte port = packed[pos + sizeof(double)];
+                int len = packed[pos + sizeof(double) + 1] | (packed[pos + sizeof(double) + 2] << 8);
+                pos += header;
+                if (pos + len > length) {
+                    break;
+                }
+                byte[] bytes = new byte[len];
+                Array.Copy(packed, pos, bytes, 0, len);
+                pos += len;
+                each(time, port, bytes);
+                count++;
+            }
+            return count;
+        }
+    }
+
+    public class MIDIEventArgs : EventArgs {
+        public MIDIEventArgs(byte[] data, byte port, MillisecondTime time)
+        {
+            Data = data;
+            Port = port;
+            Time = time;
+        }
+
+        public byte[] Data { get; private set; }
+        public byte Port { get; private set; }
+        public MillisecondTime Time { get; private set; }
+    }
+
+    //matches ParameterRamps::Curve in the native plugin
+    public enum RampCurve : int {
+        Linear = 0,
+        Exponential = 1,
+        SCurve = 2
+    }
+
+    //matches SampleCache::Status in the native plugin
+    public enum SampleStatus : int {
+        Pending = 0,
+        Ready = 1,
+        Failed = -1,
+        Unsupported = -2,
+        Unknown = -3
+    }
+
+    //matches ThreadManager::Role in the native plugin
+    public enum ThreadRole : int {
+        Graph = 0,
+        Offline = 1,
+        Background = 2
+    }
+
     public enum MessageEventType {
         Number,
         List,
@@ -178,6 +257,58 @@ namespace Cycling74.RNBOTypes {
         public List<PresetEntry> presets;
     }
 
+    public enum RenderEventType : int {
+        Parameter = 0,
+        ParameterNormalized = 1,
+        Bang = 2,
+        Number = 3,
+        List = 4,
+        MIDI = 5,
+        Transport = 6,
+        Tempo = 7,
+        BeatTime = 8,
+        TimeSignature = 9
+    }
+
+    //matches RNBORenderEvent in the native plugin
+    //Id is the parameter index, message tag, MIDI port or time signature numerator depending on the Type
+    //List and MIDI events reference [Offset, Offset + Length) of the values or bytes passed along with the events
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RenderEvent {
+        public MillisecondTime Time;
+        public RenderEventType Type;
+        public UInt32 Id;
+        public Float Value;
+        public UInt32 Offset;
+        public UInt32 Length;
+
+        public static RenderEvent Parameter(MillisecondTime time, int index, ParameterValue value) => new RenderEvent { Time = time, Type = RenderEventType.Parameter, Id = (UInt32)index, Value = value };
+        public static RenderEvent Bang(MillisecondTime time, MessageTag tag) => new RenderEvent { Time = time, Type = RenderEventType.Bang, Id = tag };
+        public static RenderEvent Number(MillisecondTime time, MessageTag tag, Float value) => new RenderEvent { Time = time, Type = RenderEventType.Number, Id = tag, Value = value };
+        public static RenderEvent List(MillisecondTime time, MessageTag tag, int offset, int length) => new RenderEvent { Time = time, Type = RenderEventType.List, Id = tag, Offset = (UInt32)offset, Length = (UInt32)length };
+        public static RenderEvent MIDI(MillisecondTime time, int offset, int length, int port = 0) => new RenderEvent { Time = time, Type = RenderEventType.MIDI, Id = (UInt32)port, Offset = (UInt32)offset, Length = (UInt32)length };
+    }
+
+    //matches RNBORenderJob in the native plugin
+    [StructLayout(LayoutKind.Sequential)]
+    public struct RenderJob {
+        public IntPtr Instance;
+        public IntPtr Input;
+        public int InChannels;
+        public Int64 InFrames;
+        public IntPtr Output;
+        public int OutChannels;
+        public Int64 NFrames;
+        public int SampleRate;
+        public int BlockSize;
+        public IntPtr Events;
+        public UIntPtr NumEvents;
+        public IntPtr Values;
+        public UIntPtr NumValues;
+        public IntPtr Bytes;
+        public UIntPtr NumBytes;
+    }
+
     public delegate void TransportRequestDelegate(IntPtr userData, MillisecondTime time, out byte running, out Float bpm, out Float beatTime, out int timeSigNum, out int timeSigDenom);
 
     public class Transport {
@@ -191,9 +322,18 @@ namespace Cycling74.RNBOTypes {
         //would use UInt32 but the version of .net or whatever it is doesn't support it 
         Int32 _timeSignature = 4 << 16 | 4;
 
+        //incremented whenever script changes the transport, used to only push the shared native state when needed
+        Int32 _version = 0;
+        public int Version {
+            get => Interlocked.CompareExchange(ref _version, 0, 0);
+        }
+
         public bool Running {
             get => _running;
-            set => _running = value;
+            set {
+                _running = value;
+                Interlocked.Increment(ref _version);
+            }
         }
 
         //there is no Interlocked.Load but CompareExchange returns the value so we simply compare against zero and then set to zero
@@ -204,6 +344,7 @@ namespace Cycling74.RNBOTypes {
                     throw new ArgumentOutOfRangeException("Tempo can only be positive");
                 }
                 Interlocked.Exchange(ref _tempo, value);
+                Interlocked.Increment(ref _version);
             }
         }
         public Float BeatTime { 
@@ -213,6 +354,9 @@ namespace Cycling74.RNBOTypes {
                     throw new ArgumentOutOfRangeException("BeatTime can only be positive");
                 }
                 Interlocked.Exchange(ref _beatTime, value);
+                //setting the beat time from script is a seek
+                Interlocked.Exchange(ref _seekTo, value);
+                Interlocked.Increment(ref _version);
             }
         }
         public (UInt16, UInt16) TimeSignature { 
@@ -226,6 +370,7 @@ namespace Cycling74.RNBOTypes {
                 }
                 UInt32 v = unchecked((UInt32)(value.Item1) << 16 | (UInt32)(value.Item2));
                 Interlocked.Exchange(ref _timeSignature, (Int32)v);
+                Interlocked.Increment(ref _version);
             }
         }
 
@@ -234,6 +379,17 @@ namespace Cycling74.RNBOTypes {
         Float _seekTo = -1.0;
         public void SeekTo(Float beatTime) {
             Interlocked.Exchange(ref _seekTo, beatTime < 0.0 ? 0.0 : beatTime);
+            Interlocked.Increment(ref _version);
+        }
+
+        //consume a pending seek, returns a negative value if there is none
+        public Float TakeSeek() {
+            return Interlocked.Exchange(ref _seekTo, -1.0);
+        }
+
+        //update the beat time without counting it as a change, used to reflect the native transport's position
+        public void ReflectBeatTime(Float beatTime) {
+            Interlocked.Exchange(ref _beatTime, beatTime);
         }
 
         //only to be accessed from audio thread
@@ -281,7 +437,7 @@ namespace Cycling74.RNBOTypes {
                         beatTimeCur += offset * tempoCur * 0.008 / 480.0;
                     }
                 }
-                BeatTime = beatTimeCur;
+                ReflectBeatTime(beatTimeCur);
             }
 
             run = (byte)(runningCur ? 1 : 0);
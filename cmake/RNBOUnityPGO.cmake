@@ -0,0 +1,56 @@
+#Two phase profile guided optimization of the plugin, GCC and Clang on Linux.
+#
+#  1. configure with -DRNBO_UNITY_PGO=Generate, build, then build the RNBOUnityPGOTrain target,
+#     which runs tools/RNBOUnityPGOTrain.cpp against the instrumented plugin
+#  2. reconfigure with -DRNBO_UNITY_PGO=Use and build again
+#
+#rnbo_unity_setup_pgo(<target> <mode> <profile dir>)
+function(rnbo_unity_setup_pgo TARGET MODE PROFILE_DIR)
+	if (NOT CMAKE_SYSTEM_NAME STREQUAL Linux)
+		message(FATAL_ERROR "RNBO_UNITY_PGO is only supported on Linux")
+	endif()
+
+	if (CMAKE_CXX_COMPILER_ID STREQUAL "GNU")
+		set(GENERATE_FLAGS -fprofile-generate=${PROFILE_DIR} -fprofile-update=atomic)
+		set(USE_FLAGS -fprofile-use=${PROFILE_DIR} -fprofile-partial-training -Wno-missing-profile)
+		set(PROFILE_DATA ${PROFILE_DIR})
+	elseif (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+		set(GENERATE_FLAGS -fprofile-generate=${PROFILE_DIR})
+		set(PROFILE_DATA ${PROFILE_DIR}/default.profdata)
+		set(USE_FLAGS -fprofile-use=${PROFILE_DATA} -Wno-profile-instr-unprofiled -Wno-profile-instr-out-of-date)
+	else()
+		message(FATAL_ERROR "RNBO_UNITY_PGO is not supported with ${CMAKE_CXX_COMPILER_ID}")
+	endif()
+
+	if (MODE STREQUAL "Generate")
+		file(MAKE_DIRECTORY ${PROFILE_DIR})
+		target_compile_options(${TARGET} PRIVATE ${GENERATE_FLAGS})
+		target_link_options(${TARGET} PRIVATE ${GENERATE_FLAGS})
+
+		add_executable(RNBOUnityPGOTrainer ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../tools/RNBOUnityPGOTrain.cpp)
+		target_include_directories(RNBOUnityPGOTrainer PRIVATE ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../src/)
+		target_link_libraries(RNBOUnityPGOTrainer PRIVATE ${CMAKE_DL_LIBS})
+
+		set(TRAIN_COMMANDS COMMAND RNBOUnityPGOTrainer $<TARGET_FILE:${TARGET}> ${RNBO_UNITY_PGO_SECONDS})
+		if (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+			string(REGEX MATCH "^[0-9]+" CLANG_MAJOR ${CMAKE_CXX_COMPILER_VERSION})
+			find_program(LLVM_PROFDATA NAMES llvm-profdata llvm-profdata-${CLANG_MAJOR} REQUIRED)
+			list(APPEND TRAIN_COMMANDS COMMAND sh -c "${LLVM_PROFDATA} merge -output=${PROFILE_DATA} ${PROFILE_DIR}/*.profraw")
+		endif()
+
+		add_custom_target(RNBOUnityPGOTrain
+			${TRAIN_COMMANDS}
+			DEPENDS ${TARGET} RNBOUnityPGOTrainer
+			COMMENT "Collecting the optimization profile in ${PROFILE_DIR}"
+			VERBATIM
+		)
+	elseif (MODE STREQUAL "Use")
+		if (NOT EXISTS ${PROFILE_DATA})
+			message(FATAL_ERROR "no profile at ${PROFILE_DATA}, build with RNBO_UNITY_PGO=Generate and run the RNBOUnityPGOTrain target first")
+		endif()
+		target_compile_options(${TARGET} PRIVATE ${USE_FLAGS})
+		target_link_options(${TARGET} PRIVATE ${USE_FLAGS})
+	elseif (NOT MODE STREQUAL "Off")
+		message(FATAL_ERROR "RNBO_UNITY_PGO must be one of Off, Generate or Use, not ${MODE}")
+	endif()
+endfunction()
@@ -0,0 +1,96 @@
+#Builds more exported patchers into the plugin, each registered as its own effect and with its own helper script.
+#They share the RNBO runtime and the instance registry with the plugin's own export.
+#
+#Every entry of PATCHES is "<effect name>=<export directory>", the export directory holds the class file,
+#description.json and optionally presets.json. Each export needs its own class name, set in RNBO's export sidebar.
+#
+#rnbo_unity_add_extra_patches(<target> <output dir> <class file name> <patches...>)
+function(rnbo_unity_add_extra_patches TARGET OUTPUT_DIR CLASS_FILE_NAME)
+	if (CMAKE_VERSION VERSION_LESS 3.19)
+		message(FATAL_ERROR "RNBO_UNITY_EXTRA_PATCHES needs CMake 3.19 or newer to read the exports' description.json")
+	endif()
+
+	set(DECLARATIONS "")
+	set(ENTRIES "")
+	set(PATCH_INDEX 0)
+	foreach(PATCH ${ARGN})
+		math(EXPR PATCH_INDEX "${PATCH_INDEX} + 1")
+		string(FIND "${PATCH}" "=" SPLIT)
+		if (SPLIT LESS 1)
+			message(FATAL_ERROR "RNBO_UNITY_EXTRA_PATCHES entries look like \"Effect Name=/path/to/export\", not ${PATCH}")
+		endif()
+		string(SUBSTRING "${PATCH}" 0 ${SPLIT} NAME)
+		math(EXPR SPLIT "${SPLIT} + 1")
+		string(SUBSTRING "${PATCH}" ${SPLIT} -1 EXPORT_DIR)
+
+		set(DESCRIPTION_FILE ${EXPORT_DIR}/description.json)
+		set(PRESETS_FILE ${EXPORT_DIR}/presets.json)
+		set(CLASS_FILE ${EXPORT_DIR}/${CLASS_FILE_NAME})
+		foreach(F ${DESCRIPTION_FILE} ${CLASS_FILE})
+			if (NOT EXISTS ${F})
+				message(FATAL_ERROR "${NAME}: missing ${F}")
+			endif()
+		endforeach()
+
+		file(READ ${DESCRIPTION_FILE} DESCRIPTION)
+		set(PRESETS "[]")
+		if (EXISTS ${PRESETS_FILE})
+			file(READ ${PRESETS_FILE} PRESETS)
+		endif()
+
+		string(JSON CLASS_NAME ERROR_VARIABLE ERR GET "${DESCRIPTION}" meta rnboobjname)
+		if (ERR)
+			message(FATAL_ERROR "${NAME}: could not find the class name (meta.rnboobjname) in ${DESCRIPTION_FILE}")
+		endif()
+
+		#only the plugin's own export provides GetPatcherFactoryFunction
+		target_sources(${TARGET} PRIVATE ${CLASS_FILE})
+		set_source_files_properties(${CLASS_FILE} PROPERTIES COMPILE_DEFINITIONS RNBO_NO_PATCHERFACTORY)
+
+		_rnbo_unity_string_literal("${DESCRIPTION}" DESCRIPTION_LITERAL)
+		_rnbo_unity_string_literal("${PRESETS}" PRESETS_LITERAL)
+		string(APPEND DECLARATIONS "extern \"C\" RNBO::PatcherFactoryFunctionPtr ${CLASS_NAME}FactoryFunction(RNBO::PlatformInterface* platformInterface);\n")
+		string(APPEND ENTRIES "\t\t{\n\t\t\t\"${NAME}\",\n\t\t\t${CLASS_NAME}FactoryFunction,\n\t\t\t${DESCRIPTION_LITERAL},\n\t\t\t${PRESETS_LITERAL}\n\t\t},\n")
+
+		#a helper script per patch, they all talk to the same library
+		string(REGEX REPLACE "[^A-Za-z0-9]" "" PLUGIN_NAME_ID ${NAME})
+		set(PLUGIN_PATCH_INDEX ${PATCH_INDEX})
+		set(HELPER_NAME ${PLUGIN_NAME_ID}Helper.cs)
+		configure_file(${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../src/Helper.cs.in ${HELPER_OUTPUT_DIR}/${HELPER_NAME})
+		configure_file(${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../src/Helper.cs.asmdef.in ${HELPER_OUTPUT_DIR}/${HELPER_NAME}.asmdef)
+
+		message(STATUS "adding patch ${NAME} (${CLASS_NAME}) from ${EXPORT_DIR}")
+	endforeach()
+
+	file(WRITE ${OUTPUT_DIR}/rnbo_unity_patches.h.tmp
+		"//generated by rnbo_unity_add_extra_patches, do not edit\n"
+		"#pragma once\n\n"
+		"${DECLARATIONS}\n"
+		"namespace RNBOUnity {\n"
+		"\tconst Patch extraPatches[] = {\n"
+		"${ENTRIES}"
+		"\t};\n"
+		"}\n"
+	)
+	#only touch the header when it changes, so the wrapper isn't rebuilt on every configure
+	configure_file(${OUTPUT_DIR}/rnbo_unity_patches.h.tmp ${OUTPUT_DIR}/rnbo_unity_patches.h COPYONLY)
+	file(REMOVE ${OUTPUT_DIR}/rnbo_unity_patches.h.tmp)
+endfunction()
+
+#raw string literals in pieces, some compilers limit the length of a single literal
+function(_rnbo_unity_string_literal CONTENT OUTPUT)
+	set(PIECE_LENGTH 4000)
+	string(LENGTH "${CONTENT}" LENGTH)
+	set(LITERAL "")
+	set(OFFSET 0)
+	while (OFFSET LESS LENGTH)
+		string(SUBSTRING "${CONTENT}" ${OFFSET} ${PIECE_LENGTH} PIECE)
+		string(APPEND LITERAL "R\"RNBO(${PIECE})RNBO\"\n\t\t\t")
+		math(EXPR OFFSET "${OFFSET} + ${PIECE_LENGTH}")
+	endwhile()
+	if (LITERAL STREQUAL "")
+		set(LITERAL "\"\"")
+	endif()
+	string(STRIP "${LITERAL}" LITERAL)
+	set(${OUTPUT} "${LITERAL}" PARENT_SCOPE)
+endfunction()
@@ -0,0 +1,77 @@
+#Sanitizer builds of the plugin with the stress and fuzz drivers, Linux with GCC or Clang.
+#
+#  Thread   builds the plugin, RNBOUnityStress and RNBOUnityChurn with -fsanitize=thread
+#  Address  builds the plugin, RNBOUnityStress and RNBOUnityChurn with -fsanitize=address, and RNBOUnityFuzz with
+#           -fsanitize=address,fuzzer (Clang). Without libFuzzer (GCC) RNBOUnityFuzz is a replay
+#           driver that runs the inputs it is given once each.
+#
+#The RNBOUnityStressRun target runs the stress driver for RNBO_UNITY_STRESS_SECONDS.
+#
+#rnbo_unity_setup_sanitize(<target> <mode>)
+function(rnbo_unity_setup_sanitize TARGET MODE)
+	if (MODE STREQUAL "Off")
+		return()
+	endif()
+	if (NOT CMAKE_SYSTEM_NAME STREQUAL Linux)
+		message(FATAL_ERROR "RNBO_UNITY_SANITIZE is only supported on Linux")
+	endif()
+	if (NOT CMAKE_CXX_COMPILER_ID STREQUAL "GNU" AND NOT CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+		message(FATAL_ERROR "RNBO_UNITY_SANITIZE is not supported with ${CMAKE_CXX_COMPILER_ID}")
+	endif()
+
+	set(TOOLS_DIR ${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../tools)
+	set(COMMON_FLAGS -g -fno-omit-frame-pointer)
+	set(FUZZ_LIBFUZZER OFF)
+	if (MODE STREQUAL "Thread")
+		set(SANITIZE_FLAGS -fsanitize=thread)
+		set(PLUGIN_FLAGS ${SANITIZE_FLAGS})
+	elseif (MODE STREQUAL "Address")
+		set(SANITIZE_FLAGS -fsanitize=address)
+		set(PLUGIN_FLAGS ${SANITIZE_FLAGS})
+		if (CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+			#coverage for the fuzzer, the runtime comes with the fuzz driver
+			list(APPEND PLUGIN_FLAGS -fsanitize=fuzzer-no-link)
+			set(FUZZ_LIBFUZZER ON)
+		endif()
+	else()
+		message(FATAL_ERROR "RNBO_UNITY_SANITIZE must be one of Off, Thread or Address, not ${MODE}")
+	endif()
+
+	target_compile_options(${TARGET} PRIVATE ${COMMON_FLAGS} ${PLUGIN_FLAGS})
+	target_link_options(${TARGET} PRIVATE ${SANITIZE_FLAGS})
+
+	add_executable(RNBOUnityStress ${TOOLS_DIR}/RNBOUnityStress.cpp)
+	target_compile_options(RNBOUnityStress PRIVATE ${COMMON_FLAGS} ${SANITIZE_FLAGS})
+	target_link_options(RNBOUnityStress PRIVATE ${SANITIZE_FLAGS})
+	target_link_libraries(RNBOUnityStress PRIVATE ${CMAKE_DL_LIBS} Threads::Threads)
+	add_dependencies(RNBOUnityStress ${TARGET})
+
+	#a benchmark rather than a test, built here so it can also be pointed at a regular build of the plugin
+	add_executable(RNBOUnityChurn ${TOOLS_DIR}/RNBOUnityChurn.cpp)
+	target_compile_options(RNBOUnityChurn PRIVATE ${COMMON_FLAGS} ${SANITIZE_FLAGS})
+	target_link_options(RNBOUnityChurn PRIVATE ${SANITIZE_FLAGS})
+	target_link_libraries(RNBOUnityChurn PRIVATE ${CMAKE_DL_LIBS} Threads::Threads)
+	add_dependencies(RNBOUnityChurn ${TARGET})
+
+	add_custom_target(RNBOUnityStressRun
+		COMMAND RNBOUnityStress $<TARGET_FILE:${TARGET}> ${RNBO_UNITY_STRESS_SECONDS}
+		DEPENDS ${TARGET} RNBOUnityStress
+		COMMENT "Stressing ${TARGET} for ${RNBO_UNITY_STRESS_SECONDS} seconds"
+		VERBATIM
+	)
+
+	if (MODE STREQUAL "Address")
+		add_executable(RNBOUnityFuzz ${TOOLS_DIR}/RNBOUnityFuzz.cpp)
+		target_compile_definitions(RNBOUnityFuzz PRIVATE RNBO_UNITY_FUZZ_PLUGIN="$<TARGET_FILE:${TARGET}>")
+		if (FUZZ_LIBFUZZER)
+			set(FUZZ_FLAGS -fsanitize=address,fuzzer)
+		else()
+			set(FUZZ_FLAGS ${SANITIZE_FLAGS})
+			target_compile_definitions(RNBOUnityFuzz PRIVATE RNBO_UNITY_FUZZ_REPLAY=1)
+		endif()
+		target_compile_options(RNBOUnityFuzz PRIVATE ${COMMON_FLAGS} ${FUZZ_FLAGS})
+		target_link_options(RNBOUnityFuzz PRIVATE ${FUZZ_FLAGS})
+		target_link_libraries(RNBOUnityFuzz PRIVATE ${CMAKE_DL_LIBS})
+		add_dependencies(RNBOUnityFuzz ${TARGET})
+	endif()
+endfunction()
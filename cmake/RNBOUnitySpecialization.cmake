@@ -0,0 +1,49 @@
+#Writes rnbo_unity_specialization.h, which bakes the parameter map of a single export into the wrapper
+#as a constant table instead of one built when the effect is registered.
+#
+#rnbo_unity_write_specialization_header(<description.json> <output dir> <instance hack 0|1>)
+function(rnbo_unity_write_specialization_header DESCRIPTION_FILE OUTPUT_DIR INSTANCE_HACK)
+	if (CMAKE_VERSION VERSION_LESS 3.19)
+		message(FATAL_ERROR "RNBO_UNITY_SPECIALIZE needs CMake 3.19 or newer to read ${DESCRIPTION_FILE}")
+	endif()
+	if (NOT EXISTS ${DESCRIPTION_FILE})
+		message(FATAL_ERROR "RNBO_UNITY_SPECIALIZE needs ${DESCRIPTION_FILE}")
+	endif()
+
+	file(READ ${DESCRIPTION_FILE} DESCRIPTION)
+
+	#mirror the filtering done by InternalRegisterEffectDefinition
+	set(PARAM_MAP)
+	if (INSTANCE_HACK)
+		list(APPEND PARAM_MAP 0)
+	endif()
+
+	string(JSON NUM_PARAMS ERROR_VARIABLE ERR LENGTH ${DESCRIPTION} parameters)
+	if (ERR)
+		set(NUM_PARAMS 0)
+	endif()
+	if (NUM_PARAMS GREATER 0)
+		math(EXPR LAST "${NUM_PARAMS} - 1")
+		foreach(I RANGE ${LAST})
+			string(JSON TYPE ERROR_VARIABLE ERR GET ${DESCRIPTION} parameters ${I} type)
+			string(JSON VISIBLE ERROR_VARIABLE ERR_VISIBLE GET ${DESCRIPTION} parameters ${I} visible)
+			string(JSON DEBUG ERROR_VARIABLE ERR_DEBUG GET ${DESCRIPTION} parameters ${I} debug)
+			string(JSON INDEX GET ${DESCRIPTION} parameters ${I} index)
+			if (ERR_VISIBLE)
+				set(VISIBLE ON)
+			endif()
+			if (ERR_DEBUG)
+				set(DEBUG OFF)
+			endif()
+			if (TYPE STREQUAL "ParameterTypeNumber" AND VISIBLE AND NOT DEBUG)
+				list(APPEND PARAM_MAP ${INDEX})
+			endif()
+		endforeach()
+	endif()
+
+	list(LENGTH PARAM_MAP RNBO_UNITY_NUM_MAPPED_PARAMS)
+	list(JOIN PARAM_MAP ", " RNBO_UNITY_PARAM_MAP)
+
+	configure_file(${CMAKE_CURRENT_FUNCTION_LIST_DIR}/../src/rnbo_unity_specialization.h.in ${OUTPUT_DIR}/rnbo_unity_specialization.h @ONLY)
+	message(STATUS "specialized with ${RNBO_UNITY_NUM_MAPPED_PARAMS} mapped parameters")
+endfunction()
@@ -0,0 +1,200 @@
+#include "RNBOCapture.h"
+#include "RNBOThreads.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstring>
+
+namespace {
+	size_t nextPowerOfTwo(size_t v) {
+		size_t p = 1;
+		while (p < v) {
+			p <<= 1;
+		}
+		return p;
+	}
+
+	bool endsWith(const std::string& s, const std::string& suffix) {
+		return s.size() >= suffix.size() && std::equal(suffix.rbegin(), suffix.rend(), s.rbegin(),
+				[](char a, char b) { return std::tolower(a) == std::tolower(b); });
+	}
+
+	void writeU32(FILE * f, uint32_t v) {
+		uint8_t b[4] = { static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8), static_cast<uint8_t>(v >> 16), static_cast<uint8_t>(v >> 24) };
+		fwrite(b, 1, 4, f);
+	}
+
+	void writeU16(FILE * f, uint16_t v) {
+		uint8_t b[2] = { static_cast<uint8_t>(v), static_cast<uint8_t>(v >> 8) };
+		fwrite(b, 1, 2, f);
+	}
+
+	//RIFF, a WAVE_FORMAT_EXTENSIBLE fmt chunk, fact and the data chunk header. Extensible because the samples are
+	//32 bit float, which readers may not take from a plain fmt chunk, and because there can be more than two channels.
+	const size_t wavHeaderBytes = 12 + 8 + 40 + 12 + 8;
+
+	//KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+	const uint8_t floatSubFormat[16] = { 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+
+	//the speakers for Unity's speaker modes, 0 leaves other counts unassigned
+	uint32_t channelMask(uint16_t channels) {
+		switch (channels) {
+			case 1: return 0x4; //center
+			case 2: return 0x3; //left, right
+			case 4: return 0x33; //left, right, back left, back right
+			case 5: return 0x37; //and center
+			case 6: return 0x3F; //5.1
+			case 8: return 0x63F; //7.1
+			default: return 0;
+		}
+	}
+}
+
+namespace RNBOUnity {
+
+	Capture * Capture::open(const std::string& path, size_t ringSamples) {
+		FILE * file = fopen(path.c_str(), "wb");
+		if (file == nullptr) {
+			return nullptr;
+		}
+		//anything but .raw gets a 32 bit float wav file
+		return new Capture(file, !endsWith(path, ".raw"), nextPowerOfTwo(std::max<size_t>(ringSamples, 1024)));
+	}
+
+	Capture::Capture(FILE * file, bool wav, size_t ringSamples) :
+		mFile(file),
+		mWav(wav),
+		mRing(ringSamples, 0.0f),
+		mMask(ringSamples - 1)
+	{
+		if (mWav) {
+			//placeholder, rewritten once we know the channel count and length
+			writeHeader(0);
+		}
+		mWriter = std::thread(&Capture::writerLoop, this);
+	}
+
+	Capture::~Capture() {
+		finish();
+	}
+
+	void Capture::push(const float * interleaved, size_t frames, int32_t channels, int32_t samplerate) {
+		if (interleaved == nullptr || channels <= 0 || frames == 0) {
+			return;
+		}
+
+		//the header has room for one channel count and one rate
+		int32_t expected = 0;
+		if (samplerate <= 0 || (!mChannels.compare_exchange_strong(expected, channels, std::memory_order_relaxed) && expected != channels)) {
+			mFramesDropped.fetch_add(frames, std::memory_order_relaxed);
+			return;
+		}
+		expected = 0;
+		if (!mSampleRate.compare_exchange_strong(expected, samplerate, std::memory_order_relaxed) && expected != samplerate) {
+			mFramesDropped.fetch_add(frames, std::memory_order_relaxed);
+			return;
+		}
+
+		const size_t samples = frames * static_cast<size_t>(channels);
+		const size_t write = mWritePos.load(std::memory_order_relaxed);
+		const size_t read = mReadPos.load(std::memory_order_acquire);
+		if (mRing.size() - (write - read) < samples) {
+			//the writer isn't keeping up, drop the whole block rather than a partial frame
+			mFramesDropped.fetch_add(frames, std::memory_order_relaxed);
+			return;
+		}
+
+		const size_t start = write & mMask;
+		const size_t first = std::min(samples, mRing.size() - start);
+		std::memcpy(mRing.data() + start, interleaved, first * sizeof(float));
+		if (first < samples) {
+			std::memcpy(mRing.data(), interleaved + first, (samples - first) * sizeof(float));
+		}
+		mWritePos.store(write + samples, std::memory_order_release);
+	}
+
+	size_t Capture::drain() {
+		const size_t read = mReadPos.load(std::memory_order_relaxed);
+		const size_t write = mWritePos.load(std::memory_order_acquire);
+		const size_t samples = write - read;
+		if (samples == 0) {
+			return 0;
+		}
+
+		const size_t start = read & mMask;
+		const size_t first = std::min(samples, mRing.size() - start);
+		fwrite(mRing.data() + start, sizeof(float), first, mFile);
+		if (first < samples) {
+			fwrite(mRing.data(), sizeof(float), samples - first, mFile);
+		}
+		mReadPos.store(write, std::memory_order_release);
+
+		const int32_t channels = mChannels.load(std::memory_order_relaxed);
+		if (channels > 0) {
+			mFramesWritten.fetch_add(samples / static_cast<size_t>(channels), std::memory_order_relaxed);
+		}
+		return samples;
+	}
+
+	void Capture::writerLoop() {
+		uint64_t applied = 0;
+		while (mRunning.load(std::memory_order_acquire)) {
+			threadManager().checkIn(ThreadManager::Background, applied);
+			const double start = ThreadManager::cpuTimeMs();
+			if (drain() == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			} else {
+				//only passes that wrote something are a cycle, the empty ones would drown them out
+				threadManager().record(ThreadManager::Background, ThreadManager::cpuTimeMs() - start);
+			}
+		}
+		drain();
+	}
+
+	void Capture::finish() {
+		if (!mWriter.joinable()) {
+			return;
+		}
+		mRunning.store(false, std::memory_order_release);
+		mWriter.join();
+
+		if (mWav) {
+			const int32_t channels = std::max<int32_t>(1, mChannels.load());
+			writeHeader(framesWritten() * static_cast<uint64_t>(channels) * sizeof(float));
+		}
+		fclose(mFile);
+		mFile = nullptr;
+	}
+
+	void Capture::writeHeader(uint64_t dataBytes) {
+		const uint16_t channels = static_cast<uint16_t>(std::max<int32_t>(1, mChannels.load()));
+		const uint32_t samplerate = static_cast<uint32_t>(std::max<int32_t>(1, mSampleRate.load()));
+		//wav sizes are 32 bit, clamp rather than wrap for very long captures
+		const uint32_t data = static_cast<uint32_t>(std::min<uint64_t>(dataBytes, 0xFFFFFFFFu - wavHeaderBytes));
+
+		fseek(mFile, 0, SEEK_SET);
+		fwrite("RIFF", 1, 4, mFile);
+		writeU32(mFile, static_cast<uint32_t>(wavHeaderBytes - 8 + data));
+		fwrite("WAVE", 1, 4, mFile);
+		fwrite("fmt ", 1, 4, mFile);
+		writeU32(mFile, 40);
+		writeU16(mFile, 0xFFFE); //WAVE_FORMAT_EXTENSIBLE
+		writeU16(mFile, channels);
+		writeU32(mFile, samplerate);
+		writeU32(mFile, samplerate * channels * sizeof(float));
+		writeU16(mFile, static_cast<uint16_t>(channels * sizeof(float)));
+		writeU16(mFile, 32);
+		writeU16(mFile, 22);
+		writeU16(mFile, 32); //valid bits
+		writeU32(mFile, channelMask(channels));
+		fwrite(floatSubFormat, 1, sizeof(floatSubFormat), mFile);
+		//frames, required for anything but PCM
+		fwrite("fact", 1, 4, mFile);
+		writeU32(mFile, 4);
+		writeU32(mFile, data / static_cast<uint32_t>(channels * sizeof(float)));
+		fwrite("data", 1, 4, mFile);
+		writeU32(mFile, data);
+		fseek(mFile, 0, SEEK_END);
+	}
+}
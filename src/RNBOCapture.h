@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Streams the audio an instance produces to a file.
+	//The audio thread only copies into a preallocated single producer, single consumer ring,
+	//a background thread drains the ring and does all of the file io.
+	class Capture {
+		public:
+			//ringSamples is rounded up to a power of two
+			static Capture * open(const std::string& path, size_t ringSamples = 1 << 20);
+			~Capture();
+
+			//audio thread only, never blocks or allocates
+			//the first block sets the channel count and sample rate, blocks that don't match are dropped
+			void push(const float * interleaved, size_t frames, int32_t channels, int32_t samplerate);
+
+			//stops the writer thread after it has drained the ring and finalizes the file
+			void finish();
+
+			uint64_t framesWritten() const { return mFramesWritten.load(std::memory_order_relaxed); }
+			uint64_t framesDropped() const { return mFramesDropped.load(std::memory_order_relaxed); }
+
+		private:
+			Capture(FILE * file, bool wav, size_t ringSamples);
+			void writerLoop();
+			size_t drain();
+			void writeHeader(uint64_t dataBytes);
+
+			FILE * mFile;
+			const bool mWav;
+
+			std::vector<float> mRing;
+			const size_t mMask;
+			std::atomic<size_t> mWritePos = 0;
+			std::atomic<size_t> mReadPos = 0;
+
+			std::atomic<int32_t> mChannels = 0;
+			std::atomic<int32_t> mSampleRate = 0;
+
+			std::atomic<uint64_t> mFramesWritten = 0;
+			std::atomic<uint64_t> mFramesDropped = 0;
+
+			std::atomic<bool> mRunning = true;
+			std::thread mWriter;
+	};
+}
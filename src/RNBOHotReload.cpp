@@ -0,0 +1,179 @@
+#include "RNBOHotReload.h"
+#include "RNBOThreads.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+	typedef RNBO::PatcherFactoryFunctionPtr (*GetFactoryFunction)(RNBO::PlatformInterface *);
+
+	const auto pollInterval = std::chrono::milliseconds(250);
+
+	void * openLibrary(const fs::path& path) {
+#ifdef _WIN32
+		return reinterpret_cast<void *>(LoadLibraryW(path.c_str()));
+#else
+		return dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+#endif
+	}
+
+	void closeLibrary(void * library) {
+#ifdef _WIN32
+		FreeLibrary(reinterpret_cast<HMODULE>(library));
+#else
+		dlclose(library);
+#endif
+	}
+
+	GetFactoryFunction lookupFactory(void * library) {
+#ifdef _WIN32
+		return reinterpret_cast<GetFactoryFunction>(GetProcAddress(reinterpret_cast<HMODULE>(library), "GetPatcherFactoryFunction"));
+#else
+		return reinterpret_cast<GetFactoryFunction>(dlsym(library, "GetPatcherFactoryFunction"));
+#endif
+	}
+
+	struct Stamp {
+		fs::file_time_type time;
+		uintmax_t size = 0;
+		bool valid = false;
+
+		bool operator==(const Stamp& other) const { return valid == other.valid && time == other.time && size == other.size; }
+		bool operator!=(const Stamp& other) const { return !(*this == other); }
+	};
+
+	//where the copies go, separate so leftovers of earlier sessions can be found
+	fs::path copyDirectory() {
+		return fs::temp_directory_path() / "rnbo-unity-hotreload";
+	}
+
+	Stamp stamp(const fs::path& path) {
+		std::error_code ec;
+		Stamp s;
+		s.time = fs::last_write_time(path, ec);
+		if (ec)
+			return Stamp();
+		s.size = fs::file_size(path, ec);
+		s.valid = !ec;
+		return s;
+	}
+}
+
+namespace RNBOUnity {
+
+	PatchReloader::PatchReloader(const std::string& path, ReloadHandler handler) :
+		mPath(path),
+		mHandler(handler)
+	{
+		//copies an earlier session couldn't remove, the ones another editor still has loaded stay
+		std::error_code ec;
+		const fs::path stem = fs::path(mPath).stem();
+		for (const auto& entry: fs::directory_iterator(copyDirectory(), ec)) {
+			if (entry.path().stem().string().rfind(stem.string() + "-", 0) == 0) {
+				fs::remove(entry.path(), ec);
+			}
+		}
+
+		//use what is there right away, so new instances start with the newest code
+		load();
+		mWatcher = std::thread(&PatchReloader::watch, this);
+	}
+
+	PatchReloader::~PatchReloader() {
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			mRunning = false;
+		}
+		mWake.notify_all();
+		if (mWatcher.joinable()) {
+			mWatcher.join();
+		}
+		//the libraries stay loaded, instances freed after this may still run their destructors,
+		//Windows can't remove the copies of those, the next session does
+		std::error_code ec;
+		for (const auto& copy: mCopies) {
+			fs::remove(copy, ec);
+		}
+	}
+
+	void PatchReloader::watch() {
+		Stamp loaded = stamp(mPath);
+		Stamp previous = loaded;
+		uint64_t applied = 0;
+
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (mRunning) {
+			mWake.wait_for(lock, pollInterval);
+			if (!mRunning)
+				break;
+			threadManager().checkIn(ThreadManager::Background, applied);
+			const double start = ThreadManager::cpuTimeMs();
+
+			//only load once the file has stopped changing, the build might still be writing it
+			Stamp current = stamp(mPath);
+			if (current.valid && current != loaded && current == previous) {
+				lock.unlock();
+				if (load()) {
+					RNBO::PatcherFactoryFunctionPtr f = factory();
+					mHandler(f, generation());
+				}
+				lock.lock();
+				loaded = current;
+			}
+			previous = current;
+			threadManager().record(ThreadManager::Background, ThreadManager::cpuTimeMs() - start);
+		}
+	}
+
+	bool PatchReloader::load() {
+		fs::path source(mPath);
+		if (!fs::exists(source))
+			return false;
+
+		//load a copy, so the build can overwrite the library while we use it, and so every
+		//generation gets its own path, some platforms return the already loaded library for a known path
+		const auto stampCount = std::chrono::steady_clock::now().time_since_epoch().count();
+		std::error_code ec;
+		fs::create_directories(copyDirectory(), ec);
+		fs::path copy = copyDirectory() / (source.stem().string() + "-" + std::to_string(stampCount) + source.extension().string());
+		fs::copy_file(source, copy, fs::copy_options::overwrite_existing, ec);
+		if (ec) {
+			std::cerr << "hot reload: failed to copy " << source << ": " << ec.message() << std::endl;
+			return false;
+		}
+
+		void * library = openLibrary(copy);
+		if (library == nullptr) {
+			std::cerr << "hot reload: failed to load " << copy << std::endl;
+			fs::remove(copy, ec);
+			return false;
+		}
+		GetFactoryFunction get = lookupFactory(library);
+		RNBO::PatcherFactoryFunctionPtr f = get ? get(RNBO::Platform::get()) : nullptr;
+		if (f == nullptr) {
+			std::cerr << "hot reload: " << source << " doesn't provide GetPatcherFactoryFunction" << std::endl;
+			closeLibrary(library);
+			fs::remove(copy, ec);
+			return false;
+		}
+
+		mLibraries.push_back(library);
+		//a loaded library stays mapped when its file is removed, except on Windows, where that has to wait
+		if (!fs::remove(copy, ec)) {
+			mCopies.push_back(copy.string());
+		}
+		mFactory.store(f);
+		mGeneration.fetch_add(1);
+		return true;
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <RNBO.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Development mode only: loads the patch's generated code from a separately built shared library
+	//and watches that library, every rebuild is loaded and handed to the handler.
+	//Loaded libraries are never unloaded, instances may still be running their code. Each one is loaded
+	//from a copy in the temp directory, which is removed as soon as the platform allows.
+	class PatchReloader {
+		public:
+			typedef std::function<void(RNBO::PatcherFactoryFunctionPtr factory, uint64_t generation)> ReloadHandler;
+
+			PatchReloader(const std::string& path, ReloadHandler handler);
+			~PatchReloader();
+
+			//the factory of the newest library, nullptr until one has been loaded
+			RNBO::PatcherFactoryFunctionPtr factory() const { return mFactory.load(); }
+			//how many times a library has been loaded
+			uint64_t generation() const { return mGeneration.load(); }
+
+		private:
+			void watch();
+			bool load();
+
+			const std::string mPath;
+			ReloadHandler mHandler;
+
+			std::atomic<RNBO::PatcherFactoryFunctionPtr> mFactory = nullptr;
+			std::atomic<uint64_t> mGeneration = 0;
+			std::vector<void *> mLibraries;
+			//copies that couldn't be removed while they were loaded
+			std::vector<std::string> mCopies;
+
+			std::mutex mMutex;
+			std::condition_variable mWake;
+			bool mRunning = true;
+			std::thread mWatcher;
+	};
+}
@@ -0,0 +1,57 @@
+#include "RNBOLatency.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace RNBOUnity {
+
+	PatchLatency PatchLatency::parse(const char * description) {
+		PatchLatency latency;
+		if (description == nullptr)
+			return latency;
+		try {
+			nlohmann::json desc = nlohmann::json::parse(description);
+			if (desc.contains("meta") && desc["meta"].is_object() && desc["meta"].contains("latency") && desc["meta"]["latency"].is_number()) {
+				latency.samples = std::max(0.0, desc["meta"]["latency"].get<RNBO::number>());
+			}
+			if (desc.contains("parameters") && desc["parameters"].is_array()) {
+				for (auto& p: desc["parameters"]) {
+					if (!p.is_object() || !p.contains("meta") || !p["meta"].is_object() || !p.contains("index") || !p["index"].is_number_integer())
+						continue;
+					auto& meta = p["meta"];
+					if (meta.contains("latency") && meta["latency"].is_boolean() && meta["latency"].get<bool>()) {
+						latency.parameter = p["index"].get<int64_t>();
+						break;
+					}
+				}
+			}
+		} catch (std::exception& e) {
+			std::cerr << "exception reading patch latency " << e.what() << std::endl;
+		}
+		return latency;
+	}
+
+	DelayLine::DelayLine(size_t delay, int32_t channels) :
+		mDelay(delay),
+		mChannels(std::max(1, channels)),
+		mRing(delay * static_cast<size_t>(std::max(1, channels)), 0.0f)
+	{
+	}
+
+	bool DelayLine::process(float * buffer, int32_t channels, size_t frames) {
+		if (channels != mChannels)
+			return false;
+		if (mDelay == 0)
+			return true;
+		//swapping the block with the ring hands out what went in delay frames ago and keeps the block for later
+		const size_t width = static_cast<size_t>(mChannels);
+		size_t done = 0;
+		while (done < frames) {
+			const size_t n = std::min(frames - done, mDelay - mPosition);
+			std::swap_ranges(buffer + done * width, buffer + (done + n) * width, mRing.begin() + static_cast<std::ptrdiff_t>(mPosition * width));
+			mPosition = (mPosition + n) % mDelay;
+			done += n;
+		}
+		return true;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <RNBO.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//What a patch says about its own latency, from its description.json: a fixed number of samples in the
+	//patcher's meta, { "latency": 256 }, or a parameter whose meta has "latency": true, which holds the current
+	//latency in samples, for patches where it depends on their settings (FFT size, lookahead).
+	struct PatchLatency {
+		RNBO::number samples = 0.0;
+		//-1 without one
+		int64_t parameter = -1;
+
+		static PatchLatency parse(const char * description);
+	};
+
+	//Fixed delay of interleaved audio, in place, to line an instance up with ones that have more latency.
+	//The ring is allocated when it is created, processing doesn't allocate.
+	class DelayLine {
+		public:
+			DelayLine(size_t delay, int32_t channels);
+
+			size_t delay() const { return mDelay; }
+			int32_t channels() const { return mChannels; }
+
+			//returns false and leaves buffer alone if it has a different channel count than the line was made for
+			bool process(float * buffer, int32_t channels, size_t frames);
+
+		private:
+			const size_t mDelay;
+			const int32_t mChannels;
+			std::vector<float> mRing;
+			size_t mPosition = 0;
+	};
+}
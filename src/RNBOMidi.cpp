@@ -0,0 +1,146 @@
+#include "RNBOMidi.h"
+
+#include <algorithm>
+
+namespace {
+	class Reader {
+		public:
+			Reader(const uint8_t * data, size_t length) : mData(data), mLength(length) {}
+
+			bool ok() const { return mOk; }
+			size_t remaining() const { return mOk ? mLength - mPos : 0; }
+			size_t pos() const { return mPos; }
+
+			uint8_t u8() {
+				if (mPos >= mLength) {
+					mOk = false;
+					return 0;
+				}
+				return mData[mPos++];
+			}
+
+			uint32_t u16() { uint32_t v = u8(); return (v << 8) | u8(); }
+			uint32_t u32() { uint32_t v = u16(); return (v << 16) | u16(); }
+
+			uint32_t varlen() {
+				uint32_t v = 0;
+				for (int i = 0; i < 4; i++) {
+					uint8_t b = u8();
+					v = (v << 7) | (b & 0x7F);
+					if (!(b & 0x80)) {
+						return v;
+					}
+				}
+				mOk = false;
+				return v;
+			}
+
+			void skip(size_t n) {
+				if (n > remaining()) {
+					mOk = false;
+					return;
+				}
+				mPos += n;
+			}
+
+			bool tag(const char * t) {
+				for (int i = 0; i < 4; i++) {
+					if (u8() != static_cast<uint8_t>(t[i])) {
+						return false;
+					}
+				}
+				return mOk;
+			}
+
+		private:
+			const uint8_t * mData;
+			size_t mLength;
+			size_t mPos = 0;
+			bool mOk = true;
+	};
+}
+
+namespace RNBOUnity {
+
+	MidiFile * MidiFile::parse(const uint8_t * data, size_t length) {
+		if (data == nullptr) {
+			return nullptr;
+		}
+
+		Reader r(data, length);
+		if (!r.tag("MThd")) {
+			return nullptr;
+		}
+		const uint32_t headerLength = r.u32();
+		r.u16(); //format, 0 and 1 are both simply merged
+		const uint32_t tracks = r.u16();
+		const uint32_t division = r.u16();
+		if (!r.ok() || headerLength < 6 || (division & 0x8000) || division == 0) {
+			return nullptr;
+		}
+		r.skip(headerLength - 6);
+
+		auto file = new MidiFile();
+		for (uint32_t t = 0; t < tracks && r.ok() && r.remaining() >= 8; t++) {
+			const bool isTrack = r.tag("MTrk");
+			const uint32_t chunkLength = r.u32();
+			if (!r.ok() || chunkLength > r.remaining()) {
+				break;
+			}
+			if (!isTrack) {
+				r.skip(chunkLength);
+				continue;
+			}
+
+			const size_t end = r.pos() + chunkLength;
+			uint64_t ticks = 0;
+			uint8_t runningStatus = 0;
+			while (r.ok() && r.pos() < end) {
+				ticks += r.varlen();
+				uint8_t status = r.u8();
+				if (status == 0xFF) {
+					//meta event, end of track or otherwise ignored
+					const uint8_t type = r.u8();
+					r.skip(r.varlen());
+					if (type == 0x2F) {
+						break;
+					}
+					continue;
+				}
+				if (status == 0xF0 || status == 0xF7) {
+					r.skip(r.varlen());
+					continue;
+				}
+
+				Event e;
+				e.beat = static_cast<double>(ticks) / static_cast<double>(division);
+				e.length = 0;
+				if (status & 0x80) {
+					runningStatus = status;
+					e.bytes[e.length++] = status;
+				} else {
+					if (runningStatus == 0) {
+						break;
+					}
+					e.bytes[e.length++] = runningStatus;
+					e.bytes[e.length++] = status;
+				}
+				const size_t expected = MidiStreamParser::messageLength(e.bytes[0]);
+				while (e.length < expected && r.ok()) {
+					e.bytes[e.length++] = r.u8();
+				}
+				if (r.ok()) {
+					file->mEvents.push_back(e);
+				}
+			}
+			//always continue from the end of the chunk, even if the track was cut short
+			if (r.ok() && r.pos() < end) {
+				r.skip(end - r.pos());
+			}
+		}
+
+		//stable so events at the same beat keep their track and file order
+		std::stable_sort(file->mEvents.begin(), file->mEvents.end(), [](const Event& a, const Event& b) { return a.beat < b.beat; });
+		return file;
+	}
+}
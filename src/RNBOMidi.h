@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Splits a raw MIDI byte stream into messages, keeping running status between calls.
+	//System exclusive messages are skipped, RNBO's MIDI events only carry up to 3 bytes.
+	class MidiStreamParser {
+		public:
+			//emit(const uint8_t * bytes, size_t length) is called for every complete message
+			template<typename F>
+			void parse(const uint8_t * data, size_t length, F emit) {
+				for (size_t i = 0; i < length; i++) {
+					const uint8_t b = data[i];
+					if (b >= 0xF8) {
+						//realtime, can appear anywhere and doesn't affect running status
+						emit(&b, 1);
+						continue;
+					}
+
+					if (b & 0x80) {
+						//any status byte ends a sysex message
+						mInSysex = false;
+						mCount = 0;
+						if (b == 0xF7) {
+							continue;
+						}
+						if (b == 0xF0) {
+							mInSysex = true;
+							mRunningStatus = 0;
+							continue;
+						}
+						mMessage[mCount++] = b;
+						mExpected = messageLength(b);
+						//system common messages cancel running status
+						mRunningStatus = b < 0xF0 ? b : 0;
+					} else {
+						if (mInSysex) {
+							continue;
+						}
+						if (mCount == 0) {
+							if (mRunningStatus == 0) {
+								//data without a status, drop
+								continue;
+							}
+							mMessage[mCount++] = mRunningStatus;
+							mExpected = messageLength(mRunningStatus);
+						}
+						mMessage[mCount++] = b;
+					}
+
+					if (mCount >= mExpected) {
+						emit(mMessage, mCount);
+						mCount = 0;
+					}
+				}
+			}
+
+			static size_t messageLength(uint8_t status) {
+				switch (status & 0xF0) {
+					case 0xC0:
+					case 0xD0:
+						return 2;
+					case 0xF0:
+						switch (status) {
+							case 0xF1:
+							case 0xF3:
+								return 2;
+							case 0xF2:
+								return 3;
+							default:
+								return 1;
+						}
+					default:
+						return 3;
+				}
+			}
+
+		private:
+			uint8_t mMessage[3] = { 0, 0, 0 };
+			size_t mCount = 0;
+			size_t mExpected = 0;
+			uint8_t mRunningStatus = 0;
+			bool mInSysex = false;
+	};
+
+	//A Standard MIDI File flattened into a single, beat ordered, list of short messages.
+	//Tempo changes in the file are ignored, playback follows the transport's tempo.
+	class MidiFile {
+		public:
+			struct Event {
+				double beat;
+				uint8_t bytes[3];
+				uint8_t length;
+			};
+
+			//returns nullptr for malformed files or SMPTE time division
+			static MidiFile * parse(const uint8_t * data, size_t length);
+
+			const std::vector<Event>& events() const { return mEvents; }
+			double lengthBeats() const { return mEvents.empty() ? 0.0 : mEvents.back().beat; }
+
+		private:
+			std::vector<Event> mEvents;
+	};
+
+	//Streams a MidiFile against beat time, only touched by the audio thread once handed over
+	class MidiFilePlayer {
+		public:
+			//startBeat is the transport beat that lines up with the start of the file, negative starts at the next block
+			MidiFilePlayer(MidiFile * file, double startBeat, int port) : mFile(file), mStartBeat(startBeat), mPort(port) {}
+			~MidiFilePlayer() { delete mFile; }
+
+			bool finished() const { return mStarted && mNext >= mFile->events().size(); }
+			int port() const { return mPort; }
+
+			//emit(const Event& event, double transportBeat) for every event in [beatStart, beatEnd)
+			template<typename F>
+			void advance(double beatStart, double beatEnd, F emit) {
+				if (!mStarted) {
+					mStarted = true;
+					if (mStartBeat < 0.0) {
+						mStartBeat = beatStart;
+					}
+					mExpectedBeat = beatStart;
+					seek(beatStart);
+				} else if (beatStart < mExpectedBeat - 1e-6 || beatStart > mExpectedBeat + 1e-6) {
+					//the transport jumped, pick up from the new position
+					seek(beatStart);
+				}
+				mExpectedBeat = beatEnd;
+
+				const auto& events = mFile->events();
+				while (mNext < events.size()) {
+					const double beat = mStartBeat + events[mNext].beat;
+					if (beat >= beatEnd) {
+						break;
+					}
+					if (beat >= beatStart) {
+						emit(events[mNext], beat);
+					}
+					mNext++;
+				}
+			}
+
+		private:
+			void seek(double beat) {
+				const auto& events = mFile->events();
+				size_t lo = 0, hi = events.size();
+				while (lo < hi) {
+					size_t mid = (lo + hi) / 2;
+					if (mStartBeat + events[mid].beat < beat) {
+						lo = mid + 1;
+					} else {
+						hi = mid;
+					}
+				}
+				mNext = lo;
+			}
+
+			MidiFile * mFile;
+			double mStartBeat;
+			int mPort;
+			bool mStarted = false;
+			double mExpectedBeat = 0.0;
+			size_t mNext = 0;
+	};
+}
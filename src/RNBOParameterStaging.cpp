@@ -0,0 +1,108 @@
+#include "RNBOParameterStaging.h"
+
+#include <cmath>
+#include <limits>
+
+namespace {
+	const size_t bitsPerWord = 64;
+	const RNBO::ParameterValue noEcho = std::numeric_limits<RNBO::ParameterValue>::quiet_NaN();
+}
+
+namespace RNBOUnity {
+
+	ParameterStaging::ParameterStaging(size_t count) {
+		resize(count);
+	}
+
+	void ParameterStaging::resize(size_t count) {
+		mCount = count;
+		mValues.reset(new std::atomic<RNBO::ParameterValue>[count]);
+		mDirty.reset(new std::atomic<uint64_t>[(count + bitsPerWord - 1) / bitsPerWord]);
+		mEchoes.reset(new std::atomic<RNBO::ParameterValue>[count]);
+		mSettling.reset(new RNBO::ParameterValue[count]);
+		for (size_t i = 0; i < mCount; i++) {
+			mValues[i].store(0.0, std::memory_order_relaxed);
+			mEchoes[i].store(noEcho, std::memory_order_relaxed);
+			mSettling[i] = noEcho;
+		}
+		for (size_t w = 0; w < (mCount + bitsPerWord - 1) / bitsPerWord; w++) {
+			mDirty[w].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	bool ParameterStaging::stage(RNBO::ParameterIndex index, RNBO::ParameterValue value) {
+		if (index >= mCount)
+			return false;
+		const uint64_t bit = uint64_t(1) << (index % bitsPerWord);
+		//value first, so a flush that sees the bit sees this value or a newer one
+		mValues[index].store(value, std::memory_order_release);
+		if (mDirty[index / bitsPerWord].fetch_or(bit, std::memory_order_acq_rel) & bit) {
+			mCoalesced.fetch_add(1, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	bool ParameterStaging::pending(RNBO::ParameterIndex index, RNBO::ParameterValue& value) const {
+		if (index >= mCount)
+			return false;
+		const uint64_t bit = uint64_t(1) << (index % bitsPerWord);
+		if ((mDirty[index / bitsPerWord].load(std::memory_order_acquire) & bit) == 0)
+			return false;
+		value = mValues[index].load(std::memory_order_acquire);
+		return true;
+	}
+
+	void ParameterStaging::discard(RNBO::ParameterIndex index) {
+		if (index >= mCount)
+			return;
+		const uint64_t bit = uint64_t(1) << (index % bitsPerWord);
+		mDirty[index / bitsPerWord].fetch_and(~bit, std::memory_order_acq_rel);
+	}
+
+	void ParameterStaging::flush(RNBO::CoreObject& core, RNBO::MillisecondTime now) {
+		for (size_t w = 0; w < (mCount + bitsPerWord - 1) / bitsPerWord; w++) {
+			if (mDirty[w].load(std::memory_order_relaxed) == 0)
+				continue;
+			uint64_t bits = mDirty[w].exchange(0, std::memory_order_acq_rel);
+			while (bits != 0) {
+				size_t bit = 0;
+				while ((bits & (uint64_t(1) << bit)) == 0) {
+					bit++;
+				}
+				bits &= ~(uint64_t(1) << bit);
+
+				const size_t index = w * bitsPerWord + bit;
+				const RNBO::ParameterValue value = mValues[index].load(std::memory_order_acquire);
+				mEchoes[index].store(value, std::memory_order_relaxed);
+				core.setParameterValue(index, value, now);
+			}
+		}
+	}
+
+	bool ParameterStaging::echo(RNBO::ParameterIndex index, RNBO::ParameterValue value) {
+		if (index >= mCount)
+			return false;
+		RNBO::ParameterValue expected = mEchoes[index].load(std::memory_order_relaxed);
+		//the patcher may have constrained the value, that notification is news to script and goes through
+		if (std::isnan(expected) || expected != value)
+			return false;
+		return mEchoes[index].compare_exchange_strong(expected, noEcho, std::memory_order_relaxed);
+	}
+
+	void ParameterStaging::settling() {
+		for (size_t i = 0; i < mCount; i++) {
+			mSettling[i] = mEchoes[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	void ParameterStaging::settled() {
+		for (size_t i = 0; i < mCount; i++) {
+			RNBO::ParameterValue expected = mSettling[i];
+			if (std::isnan(expected))
+				continue;
+			//a value flushed since settling started keeps its echo for the next poll
+			mEchoes[i].compare_exchange_strong(expected, noEcho, std::memory_order_relaxed);
+			mSettling[i] = noEcho;
+		}
+	}
+}
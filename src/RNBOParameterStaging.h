@@ -0,0 +1,54 @@
+#pragma once
+
+#include <RNBO.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace RNBOUnity {
+
+	//Immediate parameter changes from script, coalesced per block.
+	//Any thread writes the latest value into the parameter's slot and marks it dirty, the audio thread
+	//hands each dirty parameter to the core once at the start of the block. So setting the same
+	//parameter many times in a frame costs the core one change, and one notification back to script.
+	class ParameterStaging {
+		public:
+			//sized once, parameters beyond count aren't staged
+			ParameterStaging(size_t count);
+
+			size_t size() const { return mCount; }
+			//only while nothing else uses it, drops what is staged
+			void resize(size_t count);
+
+			//any thread, last writer wins, returns false if index isn't staged
+			bool stage(RNBO::ParameterIndex index, RNBO::ParameterValue value);
+			//any thread, the value waiting to be flushed, if there is one
+			bool pending(RNBO::ParameterIndex index, RNBO::ParameterValue& value) const;
+			//any thread, drops the value waiting to be flushed, for a value set some other way that should win
+			void discard(RNBO::ParameterIndex index);
+
+			//audio thread, sets every dirty parameter at time now
+			void flush(RNBO::CoreObject& core, RNBO::MillisecondTime now);
+
+			//poll thread, true once for the notification caused by a staged value, which script already knows about
+			bool echo(RNBO::ParameterIndex index, RNBO::ParameterValue value);
+			//poll thread, around draining the notifications, the echoes flushed before settling starts that
+			//didn't come back while draining, because the patcher changed the value, are dropped after it
+			void settling();
+			void settled();
+
+			//number of writes that replaced a value before it was flushed
+			uint64_t coalesced() const { return mCoalesced.load(std::memory_order_relaxed); }
+
+		private:
+			size_t mCount;
+			std::unique_ptr<std::atomic<RNBO::ParameterValue>[]> mValues;
+			std::unique_ptr<std::atomic<uint64_t>[]> mDirty;
+			//the last flushed value per parameter until its notification comes back, NaN otherwise
+			std::unique_ptr<std::atomic<RNBO::ParameterValue>[]> mEchoes;
+			//poll thread only, the echoes as settling found them
+			std::unique_ptr<RNBO::ParameterValue[]> mSettling;
+			std::atomic<uint64_t> mCoalesced = 0;
+	};
+}
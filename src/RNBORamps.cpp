@@ -0,0 +1,161 @@
+#include "RNBORamps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	const RNBO::number defaultControlRate = 500.0;
+	const RNBO::ParameterValue notStarted = std::numeric_limits<RNBO::ParameterValue>::quiet_NaN();
+	const RNBO::MillisecondTime done = std::numeric_limits<RNBO::MillisecondTime>::infinity();
+}
+
+namespace RNBOUnity {
+
+	ParameterRamps::ParameterRamps() :
+		mCommands(maxCommands),
+		mInterval(1000.0 / defaultControlRate)
+	{
+		mSegments.reserve(maxSegments);
+	}
+
+	bool ParameterRamps::push(const Command& cmd) {
+		if (!mCommands.try_enqueue(cmd)) {
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		return true;
+	}
+
+	bool ParameterRamps::ramp(RNBO::ParameterIndex index, RNBO::ParameterValue target, RNBO::MillisecondTime duration, int32_t curve, RNBO::MillisecondTime attime) {
+		std::lock_guard<std::mutex> guard(mProducerMutex);
+		return push({ Replace, index, target, duration, curve, attime });
+	}
+
+	bool ParameterRamps::envelope(RNBO::ParameterIndex index, const RNBO::number * points, size_t numpoints, int32_t curve, RNBO::MillisecondTime attime) {
+		if (points == nullptr || numpoints == 0)
+			return false;
+		std::lock_guard<std::mutex> guard(mProducerMutex);
+		bool ok = true;
+		for (size_t i = 0; i < numpoints; i++) {
+			ok = push({ i == 0 ? Replace : Append, index, points[2 * i], points[2 * i + 1], curve, attime }) && ok;
+		}
+		return ok;
+	}
+
+	bool ParameterRamps::cancel(RNBO::ParameterIndex index) {
+		std::lock_guard<std::mutex> guard(mProducerMutex);
+		return push({ Cancel, index, 0.0, 0.0, Linear, 0.0 });
+	}
+
+	bool ParameterRamps::cancelAll() {
+		std::lock_guard<std::mutex> guard(mProducerMutex);
+		return push({ CancelAll, 0, 0.0, 0.0, Linear, 0.0 });
+	}
+
+	void ParameterRamps::setControlRate(RNBO::number hz) {
+		mInterval.store(1000.0 / std::clamp(hz, 1.0, 10000.0));
+	}
+
+	RNBO::ParameterValue ParameterRamps::interpolate(const Segment& s, RNBO::MillisecondTime t) {
+		RNBO::number x = s.duration > 0.0 ? std::clamp((t - s.start) / s.duration, 0.0, 1.0) : 1.0;
+		switch (s.curve) {
+			case Exponential:
+				if (s.from * s.to > 0.0) {
+					return s.from * std::pow(s.to / s.from, x);
+				}
+				break;
+			case SCurve:
+				x = x * x * (3.0 - 2.0 * x);
+				break;
+			default:
+				break;
+		}
+		return s.from + (s.to - s.from) * x;
+	}
+
+	RNBO::ParameterValue ParameterRamps::currentValue(RNBO::ParameterIndex index, RNBO::MillisecondTime now) const {
+		const Segment * current = nullptr;
+		for (const auto& s: mSegments) {
+			if (s.index == index && s.start <= now && !std::isnan(s.from) && (current == nullptr || s.start > current->start)) {
+				current = &s;
+			}
+		}
+		return current ? interpolate(*current, now) : notStarted;
+	}
+
+	void ParameterRamps::apply(const Command& cmd, RNBO::MillisecondTime now) {
+		auto removeRamps = [this, &cmd]() {
+			mSegments.erase(std::remove_if(mSegments.begin(), mSegments.end(), [&cmd](const Segment& s) { return s.index == cmd.index; }), mSegments.end());
+		};
+
+		Segment segment = { cmd.index, notStarted, cmd.target, std::max(cmd.attime, now), std::max(0.0, cmd.duration), 0.0, cmd.curve };
+		switch (cmd.type) {
+			case Cancel:
+				removeRamps();
+				return;
+			case CancelAll:
+				mSegments.clear();
+				return;
+			case Replace:
+				//pick up from where a running ramp is, rather than from the value it hasn't reached yet
+				segment.from = currentValue(cmd.index, now);
+				removeRamps();
+				break;
+			case Append:
+				{
+					const Segment * last = nullptr;
+					for (const auto& s: mSegments) {
+						if (s.index == cmd.index && (last == nullptr || s.start + s.duration >= last->start + last->duration)) {
+							last = &s;
+						}
+					}
+					if (last) {
+						segment.start = last->start + last->duration;
+						segment.from = last->to;
+					}
+				}
+				break;
+		}
+
+		if (mSegments.size() >= maxSegments) {
+			mDropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		segment.next = segment.start;
+		mSegments.push_back(segment);
+	}
+
+	void ParameterRamps::process(RNBO::CoreObject& core, RNBO::MillisecondTime now, RNBO::MillisecondTime blockEnd) {
+		Command cmd;
+		while (mCommands.try_dequeue(cmd)) {
+			apply(cmd, now);
+		}
+		if (mSegments.empty())
+			return;
+
+		const RNBO::MillisecondTime interval = mInterval.load(std::memory_order_relaxed);
+		for (auto& s: mSegments) {
+			if (s.start >= blockEnd)
+				continue;
+			if (std::isnan(s.from)) {
+				s.from = core.getParameterValue(s.index);
+			}
+
+			const RNBO::MillisecondTime end = s.start + s.duration;
+			RNBO::MillisecondTime t = std::max(s.next, now);
+			while (t < blockEnd) {
+				if (t >= end) {
+					core.setParameterValue(s.index, s.to, std::max(end, now));
+					t = done;
+					break;
+				}
+				core.setParameterValue(s.index, interpolate(s, t), t);
+				t += interval;
+			}
+			s.next = t;
+		}
+
+		mSegments.erase(std::remove_if(mSegments.begin(), mSegments.end(), [](const Segment& s) { return s.next == done; }), mSegments.end());
+	}
+}
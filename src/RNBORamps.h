@@ -0,0 +1,91 @@
+#pragma once
+
+#include <RNBO.h>
+#include <readerwriterqueue/readerwriterqueue.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Parameter ramps and breakpoint envelopes, interpolated natively.
+	//Script queues ramps, the audio thread turns them into timestamped parameter changes at the control rate,
+	//so a gesture is one call from script instead of one call per frame.
+	class ParameterRamps {
+		public:
+			enum Curve : int32_t {
+				Linear = 0,
+				//equal ratios in equal times, falls back to linear unless both ends have the same sign and aren't 0
+				Exponential = 1,
+				//eases in and out
+				SCurve = 2,
+			};
+
+			static const size_t maxSegments = 256;
+			static const size_t maxCommands = 1024;
+
+			ParameterRamps();
+
+			//script thread, all return false when the queue is full
+			//ramp from wherever the parameter is at attime (or now, if that has passed) to target, replaces any ramps of that parameter
+			bool ramp(RNBO::ParameterIndex index, RNBO::ParameterValue target, RNBO::MillisecondTime duration, int32_t curve, RNBO::MillisecondTime attime);
+			//numpoints (value, duration) pairs, the first segment replaces any ramps of that parameter, the others follow it
+			bool envelope(RNBO::ParameterIndex index, const RNBO::number * points, size_t numpoints, int32_t curve, RNBO::MillisecondTime attime);
+			//stops where it is
+			bool cancel(RNBO::ParameterIndex index);
+			//stops every ramp where it is
+			bool cancelAll();
+			void setControlRate(RNBO::number hz);
+
+			//number of segments dropped because the queue or the segment table was full
+			uint64_t dropped() const { return mDropped.load(std::memory_order_relaxed); }
+
+			//audio thread, schedules the changes that fall into [now, blockEnd)
+			void process(RNBO::CoreObject& core, RNBO::MillisecondTime now, RNBO::MillisecondTime blockEnd);
+			bool active() const { return !mSegments.empty(); }
+
+		private:
+			enum CommandType : int32_t {
+				Replace,
+				Append,
+				Cancel,
+				CancelAll,
+			};
+
+			struct Command {
+				CommandType type;
+				RNBO::ParameterIndex index;
+				RNBO::ParameterValue target;
+				RNBO::MillisecondTime duration;
+				int32_t curve;
+				RNBO::MillisecondTime attime;
+			};
+
+			struct Segment {
+				RNBO::ParameterIndex index;
+				RNBO::ParameterValue from; //NaN until the segment starts, then read from the core
+				RNBO::ParameterValue to;
+				RNBO::MillisecondTime start;
+				RNBO::MillisecondTime duration;
+				RNBO::MillisecondTime next; //the next time we schedule a change for
+				int32_t curve;
+			};
+
+			bool push(const Command& cmd);
+			void apply(const Command& cmd, RNBO::MillisecondTime now);
+			//where the parameter's ramps are at, or NaN if none of them has started
+			RNBO::ParameterValue currentValue(RNBO::ParameterIndex index, RNBO::MillisecondTime now) const;
+			static RNBO::ParameterValue interpolate(const Segment& s, RNBO::MillisecondTime t);
+
+			std::mutex mProducerMutex;
+			moodycamel::ReaderWriterQueue<Command, 256> mCommands;
+
+			//audio thread only, preallocated
+			std::vector<Segment> mSegments;
+
+			std::atomic<RNBO::MillisecondTime> mInterval;
+			std::atomic<uint64_t> mDropped = 0;
+	};
+}
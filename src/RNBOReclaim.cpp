@@ -0,0 +1,81 @@
+#include "RNBOReclaim.h"
+#include "RNBOThreads.h"
+
+#include <new>
+
+namespace RNBOUnity {
+
+	char * DataRef::allocate(size_t bytes) {
+		char * block = new char[headerSize + bytes];
+		new (block) DataRef();
+		return block + headerSize;
+	}
+
+	void DataRef::freeAll(DataRef * list) {
+		while (list != nullptr) {
+			DataRef * next = list->mReleaseNext;
+			list->~DataRef();
+			delete [] reinterpret_cast<char *>(list);
+			list = next;
+		}
+	}
+
+	uint32_t GracePeriod::enter() {
+		while (true) {
+			const uint64_t epoch = mEpoch.load(std::memory_order_seq_cst);
+			const uint32_t slot = static_cast<uint32_t>(epoch & 1);
+			mCallers[slot].fetch_add(1, std::memory_order_seq_cst);
+			//counted in the epoch it still is, otherwise advance may not have seen us, try again in the new one
+			if (mEpoch.load(std::memory_order_seq_cst) == epoch)
+				return slot;
+			mCallers[slot].fetch_sub(1, std::memory_order_seq_cst);
+		}
+	}
+
+	void GracePeriod::leave(uint32_t slot) {
+		mCallers[slot & 1].fetch_sub(1, std::memory_order_seq_cst);
+	}
+
+	void GracePeriod::advance() {
+		//the next epoch counts with the counter of the previous one, which has to be empty first
+		const uint64_t epoch = mEpoch.load(std::memory_order_seq_cst);
+		if (mCallers[(epoch + 1) & 1].load(std::memory_order_seq_cst) == 0) {
+			mEpoch.store(epoch + 1, std::memory_order_seq_cst);
+		}
+	}
+
+	Reclaimer::Reclaimer(std::function<void()> reclaim, std::chrono::milliseconds interval) :
+		mReclaim(reclaim),
+		mInterval(interval)
+	{
+		mThread = std::thread(&Reclaimer::run, this);
+	}
+
+	Reclaimer::~Reclaimer() {
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			mRunning = false;
+		}
+		mWake.notify_all();
+		if (mThread.joinable()) {
+			mThread.join();
+		}
+		mReclaim();
+	}
+
+	void Reclaimer::run() {
+		uint64_t applied = 0;
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (mRunning) {
+			mWake.wait_for(lock, mInterval);
+			if (!mRunning)
+				break;
+			lock.unlock();
+			threadManager().checkIn(ThreadManager::Background, applied);
+			const double start = ThreadManager::cpuTimeMs();
+			mReclaim();
+			threadManager().record(ThreadManager::Background, ThreadManager::cpuTimeMs() - start);
+			lock.lock();
+		}
+	}
+}
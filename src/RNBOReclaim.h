@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace RNBOUnity {
+
+	//Lock-free stack for handing things the audio thread is done with to whoever frees them.
+	//Any number of threads push, consumers take the whole stack at once. The link lives in the
+	//released object itself (T needs a T * mReleaseNext), so a push never allocates and can't fail.
+	template <typename T>
+	class ReleaseStack {
+		public:
+			void push(T * node) {
+				T * head = mHead.load(std::memory_order_relaxed);
+				do {
+					node->mReleaseNext = head;
+				} while (!mHead.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+			}
+
+			//everything pushed so far, linked through mReleaseNext, newest first
+			T * takeAll() {
+				return mHead.exchange(nullptr, std::memory_order_acquire);
+			}
+
+		private:
+			std::atomic<T *> mHead = nullptr;
+	};
+
+	//Buffers we copy for RNBO, with room in front for the release link, so RNBO can release them on the audio thread.
+	struct DataRef {
+		DataRef * mReleaseNext = nullptr;
+
+		//keeps the data that follows the header aligned for any type
+		static const size_t headerSize = alignof(std::max_align_t) > sizeof(DataRef *) ? alignof(std::max_align_t) : sizeof(DataRef *);
+
+		//returns the data, bytes long
+		static char * allocate(size_t bytes);
+		//takes what allocate returned
+		static DataRef * fromData(char * data) { return reinterpret_cast<DataRef *>(data - headerSize); }
+		//frees a list taken from a ReleaseStack
+		static void freeAll(DataRef * list);
+	};
+
+	//Grace periods for objects that callers on other threads may be using when they are retired, without the callers
+	//ever waiting. Callers enter before they touch such an object and leave when they are done. An object retired in
+	//epoch e can be freed once the epoch has moved past e + 2: everyone who entered in e or the epoch after it has left.
+	//Two counters take turns, so a steady stream of callers can't hold the epoch back.
+	class GracePeriod {
+		public:
+			//any thread, returns what leave takes
+			uint32_t enter();
+			void leave(uint32_t slot);
+
+			//the epoch an object retired now is retired in
+			uint64_t epoch() const { return mEpoch.load(std::memory_order_seq_cst); }
+			bool elapsed(uint64_t retired) const { return epoch() > retired + 2; }
+
+			//moves to the next epoch if everyone who entered in the previous one has left, one thread at a time
+			void advance();
+
+		private:
+			std::atomic<uint64_t> mEpoch = 0;
+			std::atomic<int32_t> mCallers[2] = {};
+	};
+
+	//Background thread that calls reclaim every interval, so memory the audio thread let go of is freed
+	//even if script never polls. Calls it once more when it is destroyed.
+	class Reclaimer {
+		public:
+			Reclaimer(std::function<void()> reclaim, std::chrono::milliseconds interval);
+			~Reclaimer();
+
+		private:
+			void run();
+
+			std::function<void()> mReclaim;
+			const std::chrono::milliseconds mInterval;
+
+			std::mutex mMutex;
+			std::condition_variable mWake;
+			bool mRunning = true;
+			std::thread mThread;
+	};
+}
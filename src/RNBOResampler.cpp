@@ -0,0 +1,361 @@
+#include "RNBOResampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RNBO_UNITY_RESAMPLER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RNBO_UNITY_RESAMPLER_NEON 1
+#endif
+
+namespace {
+	//a phase per position for ratios like 160/147, rarer ratios round their position to the nearest of these
+	const size_t maxPhases = 1024;
+	//stopband attenuation of roughly 80dB
+	const double kaiserBeta = 8.0;
+	//passband edge, as a fraction of the lower of the two nyquist frequencies
+	const double passband = 0.95;
+
+	//half band interpolator lengths, in taps either side, multiples of 2 so the rows stay multiples of 4
+	const size_t halfBandFirst = 16;
+	const size_t halfBandLater = 6;
+	const double halfBandBeta = 7.0;
+
+	double besselI0(double x) {
+		double sum = 1.0;
+		double term = 1.0;
+		for (int k = 1; k < 32; k++) {
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	//n is a multiple of 4, the table rows are padded to one
+	float dot(const float * a, const float * b, size_t n) {
+		size_t i = 0;
+#if defined(RNBO_UNITY_RESAMPLER_SSE)
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for (; i + 8 <= n; i += 8) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+			acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+		}
+		for (; i + 4 <= n; i += 4) {
+			acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(RNBO_UNITY_RESAMPLER_NEON)
+		float32x4_t acc0 = vdupq_n_f32(0.0f);
+		float32x4_t acc1 = vdupq_n_f32(0.0f);
+		for (; i + 8 <= n; i += 8) {
+			acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+			acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+		}
+		for (; i + 4 <= n; i += 4) {
+			acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+		}
+		float lanes[4];
+		vst1q_f32(lanes, vaddq_f32(acc0, acc1));
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+		float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (; i + 4 <= n; i += 4) {
+			acc[0] += a[i] * b[i];
+			acc[1] += a[i + 1] * b[i + 1];
+			acc[2] += a[i + 2] * b[i + 2];
+			acc[3] += a[i + 3] * b[i + 3];
+		}
+		return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+	}
+}
+
+namespace RNBOUnity {
+
+	Resampler::Resampler(int32_t from, int32_t to, size_t channels, size_t maxInput, size_t zeroCrossings) :
+		mUp(static_cast<uint64_t>(std::max(1, to) / std::gcd(std::max(1, from), std::max(1, to)))),
+		mDown(static_cast<uint64_t>(std::max(1, from) / std::gcd(std::max(1, from), std::max(1, to)))),
+		mChannels(channels)
+	{
+		//when converting down the filter narrows, and gets longer to keep the same steepness
+		const double cutoff = passband * std::min(1.0, static_cast<double>(mUp) / static_cast<double>(mDown));
+		mHalf = static_cast<size_t>(std::ceil(static_cast<double>(zeroCrossings) / cutoff));
+		mHalf = (mHalf + 1) & ~static_cast<size_t>(1);
+		mTaps = 2 * mHalf;
+		mPhases = static_cast<size_t>(std::min<uint64_t>(mUp, maxPhases));
+
+		//row p, tap m weighs the input (mHalf - 1 - m) + p / mPhases frames before the output position
+		mTable.resize((mPhases + 1) * mTaps);
+		const double norm = besselI0(kaiserBeta);
+		const double pi = 3.14159265358979323846;
+		for (size_t p = 0; p <= mPhases; p++) {
+			float * row = mTable.data() + p * mTaps;
+			double sum = 0.0;
+			for (size_t m = 0; m < mTaps; m++) {
+				const double d = static_cast<double>(mHalf) - 1.0 - static_cast<double>(m) + static_cast<double>(p) / static_cast<double>(mPhases);
+				const double x = d / static_cast<double>(mHalf);
+				const double window = std::fabs(x) < 1.0 ? besselI0(kaiserBeta * std::sqrt(1.0 - x * x)) / norm : 0.0;
+				const double sinc = d == 0.0 ? 1.0 : std::sin(pi * cutoff * d) / (pi * cutoff * d);
+				const double v = cutoff * sinc * window;
+				row[m] = static_cast<float>(v);
+				sum += v;
+			}
+			//unity gain at DC for every phase
+			for (size_t m = 0; m < mTaps; m++) {
+				row[m] = static_cast<float>(row[m] / sum);
+			}
+		}
+
+		//starts with silence before the first input frame, so the first output is at input time 0
+		mCapacity = mTaps + maxInput;
+		mHistory.assign(mCapacity * std::max<size_t>(1, mChannels), 0.0f);
+		mCount = mHalf - 1;
+		mTime = (mHalf - 1) * mUp;
+	}
+
+	size_t Resampler::maxOutput(size_t frames) const {
+		return static_cast<size_t>((static_cast<uint64_t>(frames) * mUp + mDown - 1) / mDown) + 2;
+	}
+
+	size_t Resampler::process(const float * in, size_t frames, float * out, size_t capacity) {
+		if (mCount + frames > mCapacity) {
+			//only grows, when a block is larger than the converter was set up for
+			const size_t grown = mCount + frames;
+			std::vector<float> history(grown * std::max<size_t>(1, mChannels), 0.0f);
+			for (size_t c = 0; c < mChannels; c++) {
+				std::memcpy(history.data() + c * grown, mHistory.data() + c * mCapacity, mCount * sizeof(float));
+			}
+			mHistory.swap(history);
+			mCapacity = grown;
+		}
+		for (size_t c = 0; c < mChannels; c++) {
+			float * h = mHistory.data() + c * mCapacity + mCount;
+			for (size_t f = 0; f < frames; f++) {
+				h[f] = in ? in[f * mChannels + c] : 0.0f;
+			}
+		}
+		mCount += frames;
+
+		size_t produced = 0;
+		while (produced < capacity) {
+			const size_t i = static_cast<size_t>(mTime / mUp);
+			if (i + mHalf >= mCount)
+				break;
+			const uint64_t frac = mTime % mUp;
+			const size_t row = mPhases == mUp ? static_cast<size_t>(frac) : static_cast<size_t>((frac * mPhases + mUp / 2) / mUp);
+			const float * taps = mTable.data() + row * mTaps;
+			const size_t start = i + 1 - mHalf;
+			for (size_t c = 0; c < mChannels; c++) {
+				out[produced * mChannels + c] = dot(taps, mHistory.data() + c * mCapacity + start, mTaps);
+			}
+			mTime += mDown;
+			produced++;
+		}
+
+		//drop the history the next output doesn't reach back to
+		const size_t next = static_cast<size_t>(mTime / mUp);
+		const size_t drop = std::min(mCount, next + 1 > mHalf ? next + 1 - mHalf : 0);
+		if (drop > 0) {
+			for (size_t c = 0; c < mChannels; c++) {
+				float * h = mHistory.data() + c * mCapacity;
+				std::memmove(h, h + drop, (mCount - drop) * sizeof(float));
+			}
+			mCount -= drop;
+			mTime -= static_cast<uint64_t>(drop) * mUp;
+		}
+		return produced;
+	}
+
+	std::vector<float> Resampler::convert(const float * in, size_t frames, size_t channels, int32_t from, int32_t to) {
+		const size_t target = static_cast<size_t>((static_cast<uint64_t>(frames) * static_cast<uint64_t>(to) + static_cast<uint64_t>(from) - 1) / static_cast<uint64_t>(from));
+		Resampler r(from, to, channels, frames);
+		std::vector<float> out((r.maxOutput(frames + r.lookahead() + 1)) * channels);
+		size_t produced = r.process(in, frames, out.data(), target);
+		//silence after the end, to produce the last frames
+		std::vector<float> tail((r.lookahead() + 1) * channels, 0.0f);
+		produced += r.process(tail.data(), r.lookahead() + 1, out.data() + produced * channels, target - produced);
+		out.resize(produced * channels);
+		return out;
+	}
+
+	Oversampler::Oversampler(int32_t factor, int32_t inChannels, int32_t outChannels, size_t maxFrames) :
+		mFactor(factor),
+		mInChannels(inChannels),
+		mOutChannels(outChannels),
+		mMaxFrames(maxFrames)
+	{
+		const size_t channels = static_cast<size_t>(std::max(0, std::max(inChannels, outChannels)));
+		size_t stages = 0;
+		while ((1 << stages) < factor && stages < 3) {
+			stages++;
+		}
+
+		//the first stage guards the outer band and is long, later ones only remove images far above it
+		double latency = 0.0;
+		const double pi = 3.14159265358979323846;
+		for (size_t i = 0; i < stages; i++) {
+			Stage stage;
+			stage.half = i == 0 ? halfBandFirst : halfBandLater;
+			const size_t taps = 2 * stage.half;
+			stage.taps.resize(taps);
+			double sum = 0.0;
+			for (size_t j = 0; j < taps; j++) {
+				const double d = static_cast<double>(j) - static_cast<double>(stage.half) + 0.5;
+				const double x = d / static_cast<double>(stage.half);
+				const double window = besselI0(halfBandBeta * std::sqrt(std::max(0.0, 1.0 - x * x))) / besselI0(halfBandBeta);
+				const double v = std::sin(pi * d) / (pi * d) * window;
+				stage.taps[j] = static_cast<float>(v);
+				sum += v;
+			}
+			for (auto& t: stage.taps) {
+				t = static_cast<float>(t / sum);
+			}
+
+			//the low rate side of stage i runs at maxFrames << i
+			stage.stride = taps - 1 + (maxFrames << i);
+			stage.upHistory.assign(stage.stride * channels, 0.0f);
+			stage.downEven.assign(stage.stride * channels, 0.0f);
+			stage.downOdd.assign(stage.stride * channels, 0.0f);
+			//2 * half - 1 frames at the stage's low rate for the round trip
+			latency += static_cast<double>(taps - 1) / static_cast<double>(1 << i);
+			mStages.push_back(std::move(stage));
+		}
+		mLatency = static_cast<size_t>(std::ceil(latency));
+
+		for (size_t level = 0; level <= stages; level++) {
+			mLevels.emplace_back((maxFrames << level) * channels, 0.0f);
+		}
+		mCoreInput.assign((maxFrames << stages) * static_cast<size_t>(std::max(0, inChannels)), 0.0f);
+		mCoreOutput.assign((maxFrames << stages) * static_cast<size_t>(std::max(0, outChannels)), 0.0f);
+	}
+
+	bool Oversampler::matches(int32_t factor, int32_t inChannels, int32_t outChannels, size_t frames) const {
+		return factor == mFactor && inChannels == mInChannels && outChannels == mOutChannels && frames <= mMaxFrames;
+	}
+
+	float * Oversampler::up(const float * in, size_t frames) {
+		const size_t channels = static_cast<size_t>(std::max(0, mInChannels));
+		frames = std::min(frames, mMaxFrames);
+		for (size_t c = 0; c < channels; c++) {
+			float * level = mLevels[0].data() + c * frames;
+			for (size_t f = 0; f < frames; f++) {
+				level[f] = in ? in[f * channels + c] : 0.0f;
+			}
+		}
+
+		size_t n = frames;
+		for (size_t i = 0; i < mStages.size(); i++) {
+			Stage& stage = mStages[i];
+			const size_t taps = 2 * stage.half;
+			for (size_t c = 0; c < channels; c++) {
+				float * h = stage.upHistory.data() + c * stage.stride;
+				std::memcpy(h + taps - 1, mLevels[i].data() + c * n, n * sizeof(float));
+				float * out = mLevels[i + 1].data() + c * 2 * n;
+				for (size_t m = 0; m < n; m++) {
+					//the even phase is the input delayed to line up with the interpolated odd one
+					out[2 * m] = h[m + stage.half - 1];
+					out[2 * m + 1] = dot(stage.taps.data(), h + m, taps);
+				}
+				std::memmove(h, h + n, (taps - 1) * sizeof(float));
+			}
+			n *= 2;
+		}
+
+		const std::vector<float>& top = mLevels[mStages.size()];
+		for (size_t c = 0; c < channels; c++) {
+			const float * level = top.data() + c * n;
+			for (size_t f = 0; f < n; f++) {
+				mCoreInput[f * channels + c] = level[f];
+			}
+		}
+		return mCoreInput.data();
+	}
+
+	void Oversampler::down(size_t frames, float * out) {
+		const size_t channels = static_cast<size_t>(std::max(0, mOutChannels));
+		frames = std::min(frames, mMaxFrames);
+		size_t n = frames << mStages.size();
+		std::vector<float>& top = mLevels[mStages.size()];
+		for (size_t c = 0; c < channels; c++) {
+			float * level = top.data() + c * n;
+			for (size_t f = 0; f < n; f++) {
+				level[f] = mCoreOutput[f * channels + c];
+			}
+		}
+
+		for (size_t i = mStages.size(); i-- > 0; ) {
+			Stage& stage = mStages[i];
+			const size_t taps = 2 * stage.half;
+			n /= 2;
+			for (size_t c = 0; c < channels; c++) {
+				const float * in = mLevels[i + 1].data() + c * 2 * n;
+				float * even = stage.downEven.data() + c * stage.stride;
+				float * odd = stage.downOdd.data() + c * stage.stride;
+				for (size_t m = 0; m < n; m++) {
+					even[taps - 1 + m] = in[2 * m];
+					odd[taps - 1 + m] = in[2 * m + 1];
+				}
+				float * result = mLevels[i].data() + c * n;
+				for (size_t m = 0; m < n; m++) {
+					result[m] = 0.5f * (even[m + stage.half] + dot(stage.taps.data(), odd + m, taps));
+				}
+				std::memmove(even, even + n, (taps - 1) * sizeof(float));
+				std::memmove(odd, odd + n, (taps - 1) * sizeof(float));
+			}
+		}
+
+		for (size_t c = 0; c < channels; c++) {
+			const float * level = mLevels[0].data() + c * frames;
+			for (size_t f = 0; f < frames; f++) {
+				out[f * channels + c] = level[f];
+			}
+		}
+	}
+
+	RateConverter::RateConverter(int32_t hostRate, int32_t coreRate, int32_t inChannels, int32_t outChannels, size_t maxFrames) :
+		mHostRate(hostRate),
+		mCoreRate(coreRate),
+		mInChannels(inChannels),
+		mOutChannels(outChannels),
+		mMaxFrames(maxFrames),
+		mDown(hostRate, coreRate, static_cast<size_t>(std::max(0, inChannels)), maxFrames),
+		mUp(coreRate, hostRate, static_cast<size_t>(std::max(0, outChannels)), mDown.maxOutput(maxFrames))
+	{
+		mMaxCoreFrames = mDown.maxOutput(maxFrames);
+		//the core frames lag the host by the down converter's lookahead, the host frames lag those by the up converter's
+		mLatency = mDown.lookahead() + static_cast<size_t>(std::ceil(static_cast<double>(mUp.lookahead()) * hostRate / coreRate)) + 3;
+
+		mCoreInput.resize(mMaxCoreFrames * static_cast<size_t>(std::max(0, inChannels)));
+		mCoreOutput.resize(mMaxCoreFrames * static_cast<size_t>(std::max(0, outChannels)));
+		mQueue.assign((mLatency + maxFrames + mUp.maxOutput(mMaxCoreFrames)) * static_cast<size_t>(std::max(0, outChannels)), 0.0f);
+		mQueued = mLatency;
+	}
+
+	bool RateConverter::matches(int32_t hostRate, int32_t coreRate, int32_t inChannels, int32_t outChannels, size_t frames) const {
+		return hostRate == mHostRate && coreRate == mCoreRate && inChannels == mInChannels && outChannels == mOutChannels && frames <= mMaxFrames;
+	}
+
+	size_t RateConverter::input(const float * in, size_t frames) {
+		return mDown.process(in, std::min(frames, mMaxFrames), mCoreInput.data(), mMaxCoreFrames);
+	}
+
+	void RateConverter::output(size_t coreFrames, float * out, size_t frames) {
+		const size_t channels = static_cast<size_t>(std::max(0, mOutChannels));
+		mQueued += mUp.process(mCoreOutput.data(), coreFrames, mQueue.data() + mQueued * channels, mQueue.size() / std::max<size_t>(1, channels) - mQueued);
+
+		//the priming covers the lag, a shortfall would be a bug, it comes out as silence rather than stale data
+		const size_t ready = std::min(frames, mQueued);
+		std::memcpy(out, mQueue.data(), ready * channels * sizeof(float));
+		std::memset(out + ready * channels, 0, (frames - ready) * channels * sizeof(float));
+		std::memmove(mQueue.data(), mQueue.data() + ready * channels, (mQueued - ready) * channels * sizeof(float));
+		mQueued -= ready;
+	}
+}
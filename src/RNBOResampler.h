@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Streaming polyphase sample rate converter with a Kaiser windowed sinc, for any pair of integer rates.
+	//Output frame n is input time n * from / to, so the output lines up with the input, but a frame can only be
+	//produced once the input half a filter length past it has arrived. Nothing allocates while the input per call
+	//stays within maxInput.
+	class Resampler {
+		public:
+			Resampler(int32_t from, int32_t to, size_t channels, size_t maxInput, size_t zeroCrossings = 16);
+
+			//interleaved, returns how many frames were written to out, at most capacity
+			size_t process(const float * in, size_t frames, float * out, size_t capacity);
+			//the most frames one process call with frames of input produces
+			size_t maxOutput(size_t frames) const;
+			//input frames past an output frame needed to produce it
+			size_t lookahead() const { return mHalf; }
+
+			//converts a whole interleaved buffer, the result has frames * to / from frames, rounded up
+			static std::vector<float> convert(const float * in, size_t frames, size_t channels, int32_t from, int32_t to);
+
+		private:
+			const uint64_t mUp;
+			const uint64_t mDown;
+			const size_t mChannels;
+			size_t mHalf;
+			size_t mTaps;
+			size_t mPhases;
+			//mPhases + 1 rows of mTaps, row p is the filter for a fractional position of p / mPhases
+			std::vector<float> mTable;
+
+			//per channel history, mCount frames each, mCapacity apart
+			std::vector<float> mHistory;
+			size_t mCapacity;
+			size_t mCount;
+			//position of the next output in the history, in 1 / mUp input frames
+			uint64_t mTime;
+	};
+
+	//2x, 4x or 8x oversampling around a core, for patches that alias (distortion, waveshaping, FM).
+	//A cascade of linear phase half band FIR stages, each doubling the rate on the way in and halving it on the way out.
+	//Planar state and buffers are allocated up front for blocks of up to maxFrames.
+	class Oversampler {
+		public:
+			Oversampler(int32_t factor, int32_t inChannels, int32_t outChannels, size_t maxFrames);
+
+			bool matches(int32_t factor, int32_t inChannels, int32_t outChannels, size_t frames) const;
+
+			int32_t factor() const { return mFactor; }
+			//of the round trip, in frames at the outer rate, rounded up
+			size_t latency() const { return mLatency; }
+
+			//interleaved frames in, returns frames * factor interleaved frames for the core, silence if in is nullptr
+			float * up(const float * in, size_t frames);
+			//where the core writes its frames * factor output
+			float * coreOutput() { return mCoreOutput.data(); }
+			//brings the core output back down to frames interleaved frames
+			void down(size_t frames, float * out);
+
+		private:
+			struct Stage {
+				//2 * half taps, the half sample interpolator, the other half band phase is a plain delay
+				size_t half;
+				std::vector<float> taps;
+				//per channel, 2 * half - 1 frames of history ahead of the block
+				std::vector<float> upHistory;
+				std::vector<float> downEven;
+				std::vector<float> downOdd;
+				size_t stride;
+			};
+
+			const int32_t mFactor;
+			const int32_t mInChannels;
+			const int32_t mOutChannels;
+			const size_t mMaxFrames;
+			size_t mLatency;
+
+			std::vector<Stage> mStages;
+			//planar, one per rate from the outer rate up, maxFrames << level frames per channel
+			std::vector<std::vector<float>> mLevels;
+			std::vector<float> mCoreInput;
+			std::vector<float> mCoreOutput;
+	};
+
+	//Runs a core at a fixed rate inside a host running at another one. Host input is converted down to the
+	//core rate, the core output is converted back and handed out through a queue primed with enough silence
+	//that a whole host block is always ready, which is the latency it adds.
+	class RateConverter {
+		public:
+			RateConverter(int32_t hostRate, int32_t coreRate, int32_t inChannels, int32_t outChannels, size_t maxFrames);
+
+			bool matches(int32_t hostRate, int32_t coreRate, int32_t inChannels, int32_t outChannels, size_t frames) const;
+
+			int32_t coreRate() const { return mCoreRate; }
+			//the most core frames a host block of up to maxFrames turns into, what the core is prepared for
+			size_t maxCoreFrames() const { return mMaxCoreFrames; }
+			//in host frames
+			size_t latency() const { return mLatency; }
+
+			//host input in, returns how many core frames to process, their input is coreInput()
+			size_t input(const float * in, size_t frames);
+			float * coreInput() { return mCoreInput.data(); }
+			float * coreOutput() { return mCoreOutput.data(); }
+			//the core output of the frames input returned, fills a host block of out
+			void output(size_t coreFrames, float * out, size_t frames);
+
+		private:
+			const int32_t mHostRate;
+			const int32_t mCoreRate;
+			const int32_t mInChannels;
+			const int32_t mOutChannels;
+			const size_t mMaxFrames;
+
+			Resampler mDown;
+			Resampler mUp;
+			size_t mMaxCoreFrames;
+			size_t mLatency;
+
+			std::vector<float> mCoreInput;
+			std::vector<float> mCoreOutput;
+			//converted output waiting to be handed out, interleaved
+			std::vector<float> mQueue;
+			size_t mQueued;
+	};
+}
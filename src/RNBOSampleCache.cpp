@@ -0,0 +1,341 @@
+#include "RNBOSampleCache.h"
+#include "RNBOResampler.h"
+#include "RNBOThreads.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if RNBO_UNITY_HAVE_DR_FLAC == 1
+#define DR_FLAC_IMPLEMENTATION
+#include <dr_flac.h>
+#endif
+
+namespace {
+	uint16_t readU16(const uint8_t * p) {
+		return static_cast<uint16_t>(p[0] | (p[1] << 8));
+	}
+
+	uint32_t readU32(const uint8_t * p) {
+		return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+	}
+
+	const uint16_t wavePCM = 0x0001;
+	const uint16_t waveFloat = 0x0003;
+	const uint16_t waveExtensible = 0xFFFE;
+
+	//PCM 8, 16, 24 and 32 bit and 32 and 64 bit float, plain or extensible
+	RNBOUnity::SampleCache::Status decodeWav(const uint8_t * encoded, size_t len, RNBOUnity::Sample& sample) {
+		using Status = RNBOUnity::SampleCache::Status;
+
+		uint16_t format = 0;
+		uint16_t channels = 0;
+		uint32_t samplerate = 0;
+		uint16_t blockAlign = 0;
+		const uint8_t * data = nullptr;
+		size_t dataLen = 0;
+
+		size_t offset = 12;
+		while (offset + 8 <= len) {
+			const uint8_t * chunk = encoded + offset;
+			//streaming writers may leave the size of the last chunk unset, so never read past the end
+			const size_t size = std::min<size_t>(readU32(chunk + 4), len - offset - 8);
+			if (std::memcmp(chunk, "fmt ", 4) == 0 && size >= 16) {
+				format = readU16(chunk + 8);
+				channels = readU16(chunk + 10);
+				samplerate = readU32(chunk + 12);
+				blockAlign = readU16(chunk + 20);
+				if (format == waveExtensible && size >= 40) {
+					//the first two bytes of the sub format GUID are the actual format
+					format = readU16(chunk + 32);
+				}
+			} else if (std::memcmp(chunk, "data", 4) == 0) {
+				data = chunk + 8;
+				dataLen = size;
+			}
+			offset += 8 + size + (size & 1);
+		}
+
+		if (data == nullptr || channels == 0 || samplerate == 0 || blockAlign == 0 || blockAlign % channels != 0)
+			return Status::Failed;
+
+		//decode by the container size, a 24 bit sample in a 32 bit container is read as 32 bit
+		const size_t width = blockAlign / channels;
+		const size_t frames = dataLen / blockAlign;
+		const size_t count = frames * channels;
+		if (!((format == wavePCM && width >= 1 && width <= 4) || (format == waveFloat && (width == 4 || width == 8))))
+			return Status::Unsupported;
+
+		sample.channels = channels;
+		sample.samplerate = static_cast<int32_t>(samplerate);
+		sample.data.resize(count);
+		float * out = sample.data.data();
+		const uint8_t * in = data;
+
+		if (format == waveFloat) {
+			for (size_t i = 0; i < count; i++, in += width) {
+				if (width == 4) {
+					float v;
+					std::memcpy(&v, in, sizeof(v));
+					out[i] = v;
+				} else {
+					double v;
+					std::memcpy(&v, in, sizeof(v));
+					out[i] = static_cast<float>(v);
+				}
+			}
+			return Status::Ready;
+		}
+
+		switch (width) {
+			case 1:
+				//8 bit is the only unsigned one
+				for (size_t i = 0; i < count; i++, in++) {
+					out[i] = (static_cast<float>(*in) - 128.0f) / 128.0f;
+				}
+				break;
+			case 2:
+				for (size_t i = 0; i < count; i++, in += 2) {
+					out[i] = static_cast<float>(static_cast<int16_t>(readU16(in))) / 32768.0f;
+				}
+				break;
+			case 3:
+				for (size_t i = 0; i < count; i++, in += 3) {
+					const int32_t v = static_cast<int32_t>((static_cast<uint32_t>(in[0]) << 8) | (static_cast<uint32_t>(in[1]) << 16) | (static_cast<uint32_t>(in[2]) << 24)) >> 8;
+					out[i] = static_cast<float>(v) / 8388608.0f;
+				}
+				break;
+			case 4:
+				for (size_t i = 0; i < count; i++, in += 4) {
+					out[i] = static_cast<float>(static_cast<double>(static_cast<int32_t>(readU32(in))) / 2147483648.0);
+				}
+				break;
+		}
+		return Status::Ready;
+	}
+
+#if RNBO_UNITY_HAVE_DR_FLAC == 1
+	RNBOUnity::SampleCache::Status decodeFlac(const uint8_t * encoded, size_t len, RNBOUnity::Sample& sample) {
+		unsigned int channels = 0;
+		unsigned int samplerate = 0;
+		drflac_uint64 frames = 0;
+		float * decoded = drflac_open_memory_and_read_pcm_frames_f32(encoded, len, &channels, &samplerate, &frames, nullptr);
+		if (decoded == nullptr)
+			return RNBOUnity::SampleCache::Status::Failed;
+		sample.channels = static_cast<int32_t>(channels);
+		sample.samplerate = static_cast<int32_t>(samplerate);
+		sample.data.assign(decoded, decoded + frames * channels);
+		drflac_free(decoded, nullptr);
+		return RNBOUnity::SampleCache::Status::Ready;
+	}
+#endif
+}
+
+#if RNBO_UNITY_HAVE_STB_VORBIS == 1
+//last, stb_vorbis leaves a few single letter macros defined
+#include <stb_vorbis.c>
+
+namespace {
+	RNBOUnity::SampleCache::Status decodeVorbis(const uint8_t * encoded, size_t len, RNBOUnity::Sample& sample) {
+		int error = 0;
+		stb_vorbis * vorbis = stb_vorbis_open_memory(encoded, static_cast<int>(len), &error, nullptr);
+		if (vorbis == nullptr)
+			return RNBOUnity::SampleCache::Status::Failed;
+		const stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+		const size_t frames = stb_vorbis_stream_length_in_samples(vorbis);
+		sample.channels = info.channels;
+		sample.samplerate = static_cast<int32_t>(info.sample_rate);
+		sample.data.resize(frames * static_cast<size_t>(info.channels));
+		const int read = stb_vorbis_get_samples_float_interleaved(vorbis, info.channels, sample.data.data(), static_cast<int>(sample.data.size()));
+		stb_vorbis_close(vorbis);
+		sample.data.resize(static_cast<size_t>(std::max(0, read)) * static_cast<size_t>(info.channels));
+		return RNBOUnity::SampleCache::Status::Ready;
+	}
+}
+#endif
+
+namespace RNBOUnity {
+
+	SampleCache::SampleCache(size_t threads, size_t budget) :
+		mBudget(budget)
+	{
+		for (size_t i = 0; i < std::max<size_t>(1, threads); i++) {
+			mWorkers.emplace_back(&SampleCache::run, this);
+		}
+	}
+
+	SampleCache::~SampleCache() {
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			mRunning = false;
+		}
+		mWake.notify_all();
+		for (auto& w: mWorkers) {
+			w.join();
+		}
+	}
+
+	SampleCache::Status SampleCache::decode(const uint8_t * encoded, size_t len, Sample& sample) {
+		if (encoded == nullptr || len < 12)
+			return Failed;
+		if (std::memcmp(encoded, "RIFF", 4) == 0 && std::memcmp(encoded + 8, "WAVE", 4) == 0)
+			return decodeWav(encoded, len, sample);
+#if RNBO_UNITY_HAVE_DR_FLAC == 1
+		if (std::memcmp(encoded, "fLaC", 4) == 0)
+			return decodeFlac(encoded, len, sample);
+#endif
+#if RNBO_UNITY_HAVE_STB_VORBIS == 1
+		if (std::memcmp(encoded, "OggS", 4) == 0)
+			return decodeVorbis(encoded, len, sample);
+#endif
+		return Unsupported;
+	}
+
+	int64_t SampleCache::loadFile(const std::string& name, const std::string& path) {
+		Job job = { name, path, {} };
+		return request(name, &job);
+	}
+
+	int64_t SampleCache::loadMemory(const std::string& name, std::vector<uint8_t> encoded) {
+		Job job = { name, std::string(), std::move(encoded) };
+		return request(name, &job);
+	}
+
+	int64_t SampleCache::request(const std::string& name, Job * job) {
+		std::unique_lock<std::mutex> lock(mMutex);
+		const int64_t id = mNextRequest++;
+		if (mIndex.find(name) != mIndex.end()) {
+			mRequests[id] = { name, Ready };
+			return id;
+		}
+		mRequests[id] = { name, Pending };
+		if (mInFlight.insert(name).second) {
+			mJobs.push_back(std::move(*job));
+			lock.unlock();
+			mWake.notify_one();
+		}
+		return id;
+	}
+
+	SampleCache::Status SampleCache::status(int64_t request) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		auto it = mRequests.find(request);
+		if (it == mRequests.end())
+			return Unknown;
+		const Status s = it->second.status;
+		if (s != Pending) {
+			mRequests.erase(it);
+		}
+		return s;
+	}
+
+	std::shared_ptr<const Sample> SampleCache::get(const std::string& name) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		auto it = mIndex.find(name);
+		if (it == mIndex.end())
+			return nullptr;
+		mEntries.splice(mEntries.begin(), mEntries, it->second);
+		return it->second->sample;
+	}
+
+	bool SampleCache::evict(const std::string& name) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		auto it = mIndex.find(name);
+		if (it == mIndex.end())
+			return false;
+		mUsed -= it->second->sample->bytes();
+		mEntries.erase(it->second);
+		mIndex.erase(it);
+		return true;
+	}
+
+	void SampleCache::setBudget(size_t bytes) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		mBudget = bytes;
+		trim();
+	}
+
+	void SampleCache::setSampleRate(int32_t samplerate) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		mSampleRate = std::max(0, samplerate);
+	}
+
+	void SampleCache::usage(size_t& bytes, size_t& count) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		bytes = mUsed;
+		count = mEntries.size();
+	}
+
+	void SampleCache::trim() {
+		if (mEntries.empty())
+			return;
+		for (auto it = std::prev(mEntries.end()); mUsed > mBudget && it != mEntries.begin(); ) {
+			auto cur = it--;
+			//attached samples stay, they would only be decoded again if they were requested again
+			if (cur->sample.use_count() > 1)
+				continue;
+			mUsed -= cur->sample->bytes();
+			mIndex.erase(cur->name);
+			mEntries.erase(cur);
+		}
+	}
+
+	void SampleCache::finish(const std::string& name, std::shared_ptr<const Sample> sample, Status status) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		mInFlight.erase(name);
+		if (sample) {
+			mUsed += sample->bytes();
+			mEntries.push_front({ name, std::move(sample) });
+			mIndex[name] = mEntries.begin();
+			trim();
+		}
+		for (auto& r: mRequests) {
+			if (r.second.status == Pending && r.second.name == name) {
+				r.second.status = status;
+			}
+		}
+	}
+
+	void SampleCache::run() {
+		uint64_t applied = 0;
+		std::unique_lock<std::mutex> lock(mMutex);
+		while (true) {
+			mWake.wait(lock, [this] { return !mRunning || !mJobs.empty(); });
+			if (!mRunning)
+				return;
+			Job job = std::move(mJobs.front());
+			mJobs.pop_front();
+			lock.unlock();
+			threadManager().checkIn(ThreadManager::Offline, applied);
+			const double start = ThreadManager::cpuTimeMs();
+
+			if (!job.path.empty()) {
+				if (FILE * f = std::fopen(job.path.c_str(), "rb")) {
+					std::fseek(f, 0, SEEK_END);
+					const long size = std::ftell(f);
+					std::fseek(f, 0, SEEK_SET);
+					if (size > 0) {
+						job.encoded.resize(static_cast<size_t>(size));
+						job.encoded.resize(std::fread(job.encoded.data(), 1, job.encoded.size(), f));
+					}
+					std::fclose(f);
+				}
+			}
+
+			auto sample = std::make_shared<Sample>();
+			const Status status = decode(job.encoded.data(), job.encoded.size(), *sample);
+
+			lock.lock();
+			const int32_t samplerate = mSampleRate;
+			lock.unlock();
+			if (status == Ready && samplerate > 0 && sample->samplerate > 0 && sample->samplerate != samplerate) {
+				sample->data = Resampler::convert(sample->data.data(), sample->frames(), static_cast<size_t>(sample->channels), sample->samplerate, samplerate);
+				sample->samplerate = samplerate;
+			}
+			finish(job.name, status == Ready ? std::move(sample) : nullptr, status);
+			threadManager().record(ThreadManager::Offline, ThreadManager::cpuTimeMs() - start);
+
+			lock.lock();
+		}
+	}
+}
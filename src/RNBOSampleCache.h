@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//A decoded audio file, interleaved, never changed once it is in the cache.
+	struct Sample {
+		std::vector<float> data;
+		int32_t channels = 0;
+		int32_t samplerate = 0;
+
+		size_t frames() const { return channels > 0 ? data.size() / static_cast<size_t>(channels) : 0; }
+		size_t bytes() const { return data.size() * sizeof(float); }
+	};
+
+	//Decodes audio files on background threads into a process wide cache of samples, by name.
+	//Instances share the samples they attach, so a file is decoded and held in memory once however many use it.
+	//When the cache holds more than its budget it lets go of the least recently used samples nobody has attached.
+	class SampleCache {
+		public:
+			enum Status : int32_t {
+				Pending = 0,
+				Ready = 1,
+				Failed = -1,
+				//no decoder for this format in this build
+				Unsupported = -2,
+				//never requested, or already reported
+				Unknown = -3
+			};
+
+			SampleCache(size_t threads, size_t budget);
+			~SampleCache();
+
+			//any thread, returns a request to poll with status. A name that is cached or being decoded isn't decoded again.
+			int64_t loadFile(const std::string& name, const std::string& path);
+			int64_t loadMemory(const std::string& name, std::vector<uint8_t> encoded);
+
+			//any thread, a finished request is forgotten once its result has been reported
+			Status status(int64_t request);
+
+			//any thread, nullptr if name isn't cached, counts as a use for the eviction order
+			std::shared_ptr<const Sample> get(const std::string& name);
+			//drops the cache's reference, instances that attached it keep theirs
+			bool evict(const std::string& name);
+
+			void setBudget(size_t bytes);
+			//decoded samples are converted to samplerate, 0 keeps the rate of the file
+			void setSampleRate(int32_t samplerate);
+			void usage(size_t& bytes, size_t& count);
+
+			//WAV is built in, FLAC and Ogg Vorbis depend on the decoders this was built with
+			static Status decode(const uint8_t * encoded, size_t len, Sample& sample);
+
+		private:
+			struct Job {
+				std::string name;
+				std::string path;
+				std::vector<uint8_t> encoded;
+			};
+			struct Entry {
+				std::string name;
+				std::shared_ptr<const Sample> sample;
+			};
+
+			int64_t request(const std::string& name, Job * job);
+			void run();
+			void finish(const std::string& name, std::shared_ptr<const Sample> sample, Status status);
+			//with mMutex held, keeps the most recent entry even if it alone is over budget
+			void trim();
+
+			std::mutex mMutex;
+			std::condition_variable mWake;
+			bool mRunning = true;
+			std::deque<Job> mJobs;
+			std::unordered_set<std::string> mInFlight;
+
+			struct Request {
+				std::string name;
+				Status status;
+			};
+			std::unordered_map<int64_t, Request> mRequests;
+			int64_t mNextRequest = 1;
+
+			//most recently used first
+			std::list<Entry> mEntries;
+			std::unordered_map<std::string, std::list<Entry>::iterator> mIndex;
+			size_t mBudget;
+			size_t mUsed = 0;
+			int32_t mSampleRate = 0;
+
+			std::vector<std::thread> mWorkers;
+	};
+}
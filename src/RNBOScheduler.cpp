@@ -0,0 +1,121 @@
+#include "RNBOScheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+
+namespace RNBOUnity {
+
+	EventScheduler::EventScheduler() {
+		mHeap.reserve(initialCapacity);
+	}
+
+	EventScheduler::~EventScheduler() {
+		for (auto& e: mHeap) {
+			delete e.list;
+		}
+	}
+
+	void EventScheduler::schedule(RNBO::CoreObject& core, Event event) {
+		if (mHorizon.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> guard(mMutex);
+			if (event.time >= mReleasedUntil) {
+				event.sequence = mSequence++;
+				//only grows past what it has held before here, on the script thread
+				mHeap.push_back(event);
+				std::push_heap(mHeap.begin(), mHeap.end(), later);
+				return;
+			}
+		}
+		dispatch(core, event);
+	}
+
+	template <typename Match>
+	size_t EventScheduler::cancel(Match match) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		auto end = std::partition(mHeap.begin(), mHeap.end(), [&match](const Event& e) { return !match(e); });
+		const size_t cancelled = static_cast<size_t>(mHeap.end() - end);
+		for (auto it = end; it != mHeap.end(); ++it) {
+			delete it->list;
+		}
+		mHeap.erase(end, mHeap.end());
+		std::make_heap(mHeap.begin(), mHeap.end(), later);
+		return cancelled;
+	}
+
+	size_t EventScheduler::cancelTag(RNBO::MessageTag tag) {
+		return cancel([tag](const Event& e) { return e.type <= List && e.tag == tag; });
+	}
+
+	size_t EventScheduler::cancelGroup(int32_t group) {
+		return cancel([group](const Event& e) { return e.group == group; });
+	}
+
+	size_t EventScheduler::cancelAll() {
+		return cancel([](const Event&) { return true; });
+	}
+
+	size_t EventScheduler::pending() {
+		std::lock_guard<std::mutex> guard(mMutex);
+		return mHeap.size();
+	}
+
+	void EventScheduler::setHorizon(int32_t blocks) {
+		mHorizon.store(std::max(0, blocks), std::memory_order_relaxed);
+	}
+
+	void EventScheduler::release(RNBO::CoreObject& core, RNBO::MillisecondTime now, RNBO::MillisecondTime blockEnd) {
+		std::unique_lock<std::mutex> lock(mMutex, std::try_to_lock);
+		if (!lock.owns_lock())
+			return;
+		//with the horizon turned off, whatever is left goes out now
+		const int32_t blocks = mHorizon.load(std::memory_order_relaxed);
+		const RNBO::MillisecondTime until = blocks > 0 ? now + (blockEnd - now) * static_cast<RNBO::MillisecondTime>(blocks) : std::numeric_limits<RNBO::MillisecondTime>::max();
+		while (!mHeap.empty() && mHeap.front().time < until) {
+			std::pop_heap(mHeap.begin(), mHeap.end(), later);
+			dispatch(core, mHeap.back());
+			mHeap.pop_back();
+		}
+		//assigned rather than only moved forward, so the heap follows the host's clock if it jumps back
+		mReleasedUntil = blocks > 0 ? until : blockEnd;
+	}
+
+	void EventScheduler::releaseAll(RNBO::CoreObject& core) {
+		std::lock_guard<std::mutex> guard(mMutex);
+		while (!mHeap.empty()) {
+			std::pop_heap(mHeap.begin(), mHeap.end(), later);
+			dispatch(core, mHeap.back());
+			mHeap.pop_back();
+		}
+	}
+
+	void EventScheduler::dispatch(RNBO::CoreObject& core, Event& e) {
+		switch (e.type) {
+			case Bang:
+				core.scheduleEvent(RNBO::MessageEvent(e.tag, e.time));
+				break;
+			case Number:
+				core.scheduleEvent(RNBO::MessageEvent(e.tag, e.time, e.value));
+				break;
+			case List:
+				core.scheduleEvent(RNBO::MessageEvent(e.tag, e.time, std::unique_ptr<RNBO::list>(e.list)));
+				e.list = nullptr;
+				break;
+			case Midi:
+				core.scheduleEvent(RNBO::MidiEvent(e.time, static_cast<int>(e.tag), e.midi, static_cast<RNBO::Index>(e.extra)));
+				break;
+			case Transport:
+				core.scheduleEvent(RNBO::TransportEvent(e.time, e.value != 0.0 ? RNBO::TransportState::RUNNING : RNBO::TransportState::STOPPED));
+				break;
+			case Tempo:
+				core.scheduleEvent(RNBO::TempoEvent(e.time, e.value));
+				break;
+			case BeatTime:
+				core.scheduleEvent(RNBO::BeatTimeEvent(e.time, e.value));
+				break;
+			case TimeSignature:
+				core.scheduleEvent(RNBO::TimeSignatureEvent(e.time, static_cast<int>(e.value), e.extra));
+				break;
+		}
+	}
+}
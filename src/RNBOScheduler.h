@@ -0,0 +1,90 @@
+#pragma once
+
+#include <RNBO.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Holds events script schedules ahead of time in a time ordered heap and hands them to the core a few blocks
+	//before they are due, so a long sequence doesn't sit in the core's queue, where every block has to look at it.
+	//Events already inside the horizon go straight to the core. The heap keeps its capacity, so once it has grown
+	//to the longest sequence script schedules, neither thread allocates for it.
+	class EventScheduler {
+		public:
+			enum Type : int32_t {
+				Bang = 0,
+				Number = 1,
+				List = 2,
+				Midi = 3,
+				Transport = 4,
+				Tempo = 5,
+				BeatTime = 6,
+				TimeSignature = 7,
+			};
+
+			struct Event {
+				Type type = Bang;
+				RNBO::MillisecondTime time = 0.0;
+				//the message tag, or the MIDI port
+				RNBO::MessageTag tag = 0;
+				//0 for events sent without one
+				int32_t group = 0;
+				//number, bpm, beat time, transport running or not, time signature numerator
+				RNBO::number value = 0.0;
+				//time signature denominator, MIDI length
+				int32_t extra = 0;
+				uint8_t midi[3] = { 0, 0, 0 };
+				//owned by the event until it reaches the core
+				RNBO::list * list = nullptr;
+				uint64_t sequence = 0;
+			};
+
+			static const size_t initialCapacity = 1024;
+			static const int32_t defaultHorizon = 4;
+
+			EventScheduler();
+			~EventScheduler();
+
+			//script thread, takes ownership of event.list
+			void schedule(RNBO::CoreObject& core, Event event);
+			//script thread, events the core already has can't be cancelled, return how many were
+			size_t cancelTag(RNBO::MessageTag tag);
+			size_t cancelGroup(int32_t group);
+			size_t cancelAll();
+			//events waiting to be released
+			size_t pending();
+
+			//in blocks, 0 hands every event to the core right away
+			void setHorizon(int32_t blocks);
+			int32_t horizon() const { return mHorizon.load(std::memory_order_relaxed); }
+
+			//audio thread, before the core processes the block [now, blockEnd). Never waits on script:
+			//if script holds the heap the events stay for the next block, which the horizon leaves time for.
+			void release(RNBO::CoreObject& core, RNBO::MillisecondTime now, RNBO::MillisecondTime blockEnd);
+			//hands every held event to the core, waiting for script if it has to, for renders which aren't real time
+			void releaseAll(RNBO::CoreObject& core);
+
+			static void dispatch(RNBO::CoreObject& core, Event& event);
+
+		private:
+			//for a min heap, ties keep the order they were scheduled in
+			static bool later(const Event& a, const Event& b) {
+				return a.time > b.time || (a.time == b.time && a.sequence > b.sequence);
+			}
+			template <typename Match>
+			size_t cancel(Match match);
+
+			std::mutex mMutex;
+			std::vector<Event> mHeap;
+			uint64_t mSequence = 0;
+			//everything before this has been handed to the core, written by the audio thread with mMutex held
+			RNBO::MillisecondTime mReleasedUntil = 0.0;
+
+			std::atomic<int32_t> mHorizon = defaultHorizon;
+	};
+}
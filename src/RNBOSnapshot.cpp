@@ -0,0 +1,92 @@
+#include "RNBOSnapshot.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace RNBOUnity {
+
+	bool SnapshotHeader::read(const uint8_t * data, size_t len, uint32_t patch, size_t parameters, SnapshotHeader& header) {
+		if (data == nullptr || len < sizeof(SnapshotHeader))
+			return false;
+		std::memcpy(&header, data, sizeof(header));
+		if (header.mMagic != magic || header.mVersion != version || header.mPatch != patch || header.mParameters != parameters)
+			return false;
+		switch (header.mKind) {
+			case Full:
+				return header.mEntries == parameters && len >= fullSize(parameters);
+			case Delta:
+				return header.mEntries <= parameters && len >= sizeof(SnapshotHeader) + header.mEntries * deltaEntrySize();
+			default:
+				return false;
+		}
+	}
+
+	SnapshotSlot::SnapshotSlot(size_t parameters) :
+		mParameters(parameters),
+		mValues(parameters, 0.0),
+		mSet(parameters, 0)
+	{
+	}
+
+	void SnapshotSlot::resize(size_t parameters) {
+		mParameters = parameters;
+		mValues.assign(parameters, 0.0);
+		mSet.assign(parameters, 0);
+		mState.store(Idle, std::memory_order_relaxed);
+	}
+
+	bool SnapshotSlot::restore(uint32_t patch, const uint8_t * data, size_t len, const std::function<void(RNBO::ParameterIndex)>& restoring) {
+		SnapshotHeader header;
+		if (!SnapshotHeader::read(data, len, patch, mParameters, header))
+			return false;
+
+		//take the slot from idle or from a restore that is still waiting, wait out the audio thread applying one
+		int32_t state = mState.load(std::memory_order_acquire);
+		while (true) {
+			if (state == Applying || state == Writing) {
+				std::this_thread::yield();
+				state = mState.load(std::memory_order_acquire);
+				continue;
+			}
+			if (mState.compare_exchange_weak(state, Writing, std::memory_order_acquire))
+				break;
+		}
+		if (state == Idle) {
+			std::fill(mSet.begin(), mSet.end(), 0);
+		}
+
+		const uint8_t * pos = data + sizeof(header);
+		if (header.mKind == SnapshotHeader::Full) {
+			for (size_t i = 0; i < mParameters; i++) {
+				std::memcpy(&mValues[i], pos + i * sizeof(RNBO::ParameterValue), sizeof(RNBO::ParameterValue));
+				mSet[i] = 1;
+				restoring(static_cast<RNBO::ParameterIndex>(i));
+			}
+		} else {
+			for (uint32_t e = 0; e < header.mEntries; e++) {
+				uint32_t index;
+				std::memcpy(&index, pos, sizeof(index));
+				if (index < mParameters) {
+					std::memcpy(&mValues[index], pos + sizeof(index), sizeof(RNBO::ParameterValue));
+					mSet[index] = 1;
+					restoring(static_cast<RNBO::ParameterIndex>(index));
+				}
+				pos += SnapshotHeader::deltaEntrySize();
+			}
+		}
+		mState.store(Ready, std::memory_order_release);
+		return true;
+	}
+
+	void SnapshotSlot::apply(RNBO::CoreObject& core, RNBO::MillisecondTime now) {
+		int32_t ready = Ready;
+		if (!mState.compare_exchange_strong(ready, Applying, std::memory_order_acquire))
+			return;
+		for (size_t i = 0; i < mParameters; i++) {
+			if (mSet[i]) {
+				core.setParameterValue(static_cast<RNBO::ParameterIndex>(i), mValues[i], now);
+			}
+		}
+		mState.store(Idle, std::memory_order_release);
+	}
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <RNBO.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Binary parameter presets: snapshots of an instance's parameter values, restored without going through JSON.
+	//A full snapshot holds every value, a delta only the ones that differ from a full snapshot it was taken
+	//against. Native byte order, values are copied with memcpy so buffers don't need to be aligned.
+	struct SnapshotHeader {
+		static const uint32_t magic = 0x53424e52; //"RNBS"
+		static const uint16_t version = 1;
+		enum Kind : uint16_t {
+			Full = 0,
+			Delta = 1,
+		};
+
+		uint32_t mMagic;
+		uint16_t mVersion;
+		uint16_t mKind;
+		uint32_t mPatch;
+		uint32_t mParameters;
+		//values in a full snapshot, (index, value) pairs in a delta
+		uint32_t mEntries;
+		uint32_t mReserved;
+
+		static size_t fullSize(size_t parameters) { return sizeof(SnapshotHeader) + parameters * sizeof(RNBO::ParameterValue); }
+		static size_t deltaEntrySize() { return sizeof(uint32_t) + sizeof(RNBO::ParameterValue); }
+		//a delta where every value changed
+		static size_t maxDeltaSize(size_t parameters) { return sizeof(SnapshotHeader) + parameters * deltaEntrySize(); }
+
+		//false if data isn't a snapshot of patch with that many parameters, or is cut short
+		static bool read(const uint8_t * data, size_t len, uint32_t patch, size_t parameters, SnapshotHeader& header);
+	};
+
+	//value(i) is the current value of parameter i, returns the bytes written or 0 if capacity is too small
+	template <typename Value>
+	size_t captureSnapshot(uint32_t patch, size_t parameters, Value value, uint8_t * out, size_t capacity) {
+		const size_t size = SnapshotHeader::fullSize(parameters);
+		if (out == nullptr || capacity < size)
+			return 0;
+		SnapshotHeader header = { SnapshotHeader::magic, SnapshotHeader::version, SnapshotHeader::Full, patch, static_cast<uint32_t>(parameters), static_cast<uint32_t>(parameters), 0 };
+		std::memcpy(out, &header, sizeof(header));
+		uint8_t * pos = out + sizeof(header);
+		for (size_t i = 0; i < parameters; i++) {
+			const RNBO::ParameterValue v = value(i);
+			std::memcpy(pos, &v, sizeof(v));
+			pos += sizeof(v);
+		}
+		return size;
+	}
+
+	//only the values that differ from the full snapshot base, bit for bit, returns 0 if base isn't a full snapshot
+	//of the same patch or capacity is too small. A delta where nothing changed is just the header.
+	template <typename Value>
+	size_t captureSnapshotDelta(uint32_t patch, size_t parameters, Value value, const uint8_t * base, size_t baselen, uint8_t * out, size_t capacity) {
+		SnapshotHeader header;
+		if (out == nullptr || capacity < sizeof(header) || !SnapshotHeader::read(base, baselen, patch, parameters, header) || header.mKind != SnapshotHeader::Full)
+			return 0;
+		const uint8_t * previous = base + sizeof(header);
+		uint8_t * pos = out + sizeof(header);
+		uint32_t entries = 0;
+		for (size_t i = 0; i < parameters; i++) {
+			const RNBO::ParameterValue v = value(i);
+			if (std::memcmp(&v, previous + i * sizeof(v), sizeof(v)) == 0)
+				continue;
+			if (static_cast<size_t>(pos - out) + SnapshotHeader::deltaEntrySize() > capacity)
+				return 0;
+			const uint32_t index = static_cast<uint32_t>(i);
+			std::memcpy(pos, &index, sizeof(index));
+			std::memcpy(pos + sizeof(index), &v, sizeof(v));
+			pos += SnapshotHeader::deltaEntrySize();
+			entries++;
+		}
+		header = { SnapshotHeader::magic, SnapshotHeader::version, SnapshotHeader::Delta, patch, static_cast<uint32_t>(parameters), entries, 0 };
+		std::memcpy(out, &header, sizeof(header));
+		return static_cast<size_t>(pos - out);
+	}
+
+	//A snapshot waiting to be restored, handed to the audio thread whole so it lands in a single block.
+	//Sized for every parameter up front, neither side allocates.
+	class SnapshotSlot {
+		public:
+			SnapshotSlot(size_t parameters);
+			//only while nothing else uses it, drops a restore that wasn't applied yet
+			void resize(size_t parameters);
+			size_t parameters() const { return mParameters; }
+
+			//script thread, false if data isn't a snapshot of this patch. A delta restored before the audio thread
+			//applied the previous restore is merged into it. restoring is called for every index the snapshot sets,
+			//before the audio thread can apply it.
+			bool restore(uint32_t patch, const uint8_t * data, size_t len, const std::function<void(RNBO::ParameterIndex)>& restoring);
+
+			//audio thread, at the start of a block, sets the values at time now
+			void apply(RNBO::CoreObject& core, RNBO::MillisecondTime now);
+
+		private:
+			enum State : int32_t {
+				Idle,
+				Writing,
+				Ready,
+				Applying,
+			};
+
+			size_t mParameters;
+			std::vector<RNBO::ParameterValue> mValues;
+			std::vector<uint8_t> mSet;
+			std::atomic<int32_t> mState = Idle;
+	};
+}
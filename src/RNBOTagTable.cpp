@@ -0,0 +1,53 @@
+#include "RNBOTagTable.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+	void appendU32(std::vector<uint8_t>& blob, uint32_t v) {
+		for (int i = 0; i < 4; i++) {
+			blob.push_back(static_cast<uint8_t>((v >> (8 * i)) & 0xFF));
+		}
+	}
+}
+
+namespace RNBOUnity {
+
+	TagTable::TagTable(const std::vector<const char *>& descriptions) {
+		for (auto d: descriptions) {
+			if (d == nullptr)
+				continue;
+			try {
+				nlohmann::json desc = nlohmann::json::parse(d);
+				for (auto key: { "inports", "outports" }) {
+					if (!desc.contains(key) || !desc[key].is_array())
+						continue;
+					for (auto& port: desc[key]) {
+						if (port.is_object() && port.contains("tag") && port["tag"].is_string()) {
+							std::string name = port["tag"].get<std::string>();
+							mEntries.push_back({ RNBO::TAG(name.c_str()), name });
+						}
+					}
+				}
+			} catch (std::exception& e) {
+				std::cerr << "exception reading message tags " << e.what() << std::endl;
+			}
+		}
+
+		//ports of the same name show up in several patches
+		std::stable_sort(mEntries.begin(), mEntries.end(), [](const Entry& a, const Entry& b) { return a.tag < b.tag; });
+		mEntries.erase(std::unique(mEntries.begin(), mEntries.end(), [](const Entry& a, const Entry& b) { return a.tag == b.tag; }), mEntries.end());
+
+		appendU32(mBlob, static_cast<uint32_t>(mEntries.size()));
+		for (auto& e: mEntries) {
+			appendU32(mBlob, static_cast<uint32_t>(e.tag));
+			appendU32(mBlob, static_cast<uint32_t>(e.name.size()));
+			mBlob.insert(mBlob.end(), e.name.begin(), e.name.end());
+		}
+	}
+
+	const char * TagTable::resolve(RNBO::MessageTag tag) const {
+		auto it = std::lower_bound(mEntries.begin(), mEntries.end(), tag, [](const Entry& e, RNBO::MessageTag t) { return e.tag < t; });
+		return it != mEntries.end() && it->tag == tag ? it->name.c_str() : nullptr;
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <RNBO.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//Message tags of the inports and outports of every patch in this library, interned once at load.
+	//Read only once built, so lookups need no lock and no allocation.
+	class TagTable {
+		public:
+			//descriptions are the patchers' description.json contents
+			TagTable(const std::vector<const char *>& descriptions);
+
+			//nullptr if the tag isn't one of the ports
+			const char * resolve(RNBO::MessageTag tag) const;
+
+			//all of the entries, sorted by tag: uint32 count, then per entry uint32 tag, uint32 length and the utf-8 name, little endian
+			const std::vector<uint8_t>& blob() const { return mBlob; }
+
+		private:
+			struct Entry {
+				RNBO::MessageTag tag;
+				std::string name;
+			};
+
+			std::vector<Entry> mEntries;
+			std::vector<uint8_t> mBlob;
+	};
+}
@@ -0,0 +1,133 @@
+#include "RNBOThreads.h"
+
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+
+namespace RNBOUnity {
+
+	ThreadManager& threadManager() {
+		static ThreadManager manager;
+		return manager;
+	}
+
+	void ThreadManager::configure(Role role, const Config& config) {
+		if (!valid(role))
+			return;
+		std::lock_guard<std::mutex> guard(mMutex);
+		mConfigs[role] = config;
+		mBudgets[role].store(std::max(0.0, config.budgetMs), std::memory_order_relaxed);
+		mGenerations[role].fetch_add(1, std::memory_order_release);
+	}
+
+	void ThreadManager::stats(Role role, Stats& stats) {
+		if (!valid(role))
+			return;
+		stats.cycles = mCycles[role].load(std::memory_order_relaxed);
+		stats.misses = mMisses[role].load(std::memory_order_relaxed);
+		stats.worstMs = mWorst[role].load(std::memory_order_relaxed);
+		stats.denied = mDenied[role].load(std::memory_order_relaxed);
+	}
+
+	void ThreadManager::resetStats(Role role) {
+		if (!valid(role))
+			return;
+		mCycles[role].store(0, std::memory_order_relaxed);
+		mMisses[role].store(0, std::memory_order_relaxed);
+		mWorst[role].store(0.0, std::memory_order_relaxed);
+		mDenied[role].store(0, std::memory_order_relaxed);
+	}
+
+	void ThreadManager::checkIn(Role role, uint64_t& applied) {
+		if (!valid(role))
+			return;
+		const uint64_t generation = mGenerations[role].load(std::memory_order_acquire);
+		if (generation == applied)
+			return;
+		Config config;
+		{
+			std::lock_guard<std::mutex> guard(mMutex);
+			config = mConfigs[role];
+			applied = mGenerations[role].load(std::memory_order_relaxed);
+		}
+		if (!apply(config)) {
+			mDenied[role].fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void ThreadManager::record(Role role, double ms) {
+		if (!valid(role))
+			return;
+		mCycles[role].fetch_add(1, std::memory_order_relaxed);
+		const double budget = mBudgets[role].load(std::memory_order_relaxed);
+		if (budget > 0.0 && ms > budget) {
+			mMisses[role].fetch_add(1, std::memory_order_relaxed);
+		}
+		double worst = mWorst[role].load(std::memory_order_relaxed);
+		while (ms > worst && !mWorst[role].compare_exchange_weak(worst, ms, std::memory_order_relaxed)) {}
+	}
+
+	double ThreadManager::cpuTimeMs() {
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+			return 0.0;
+		//100ns units
+		const uint64_t k = (static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+		const uint64_t u = (static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+		return static_cast<double>(k + u) / 10000.0;
+#else
+		timespec ts;
+		if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+			return 0.0;
+		return static_cast<double>(ts.tv_sec) * 1000.0 + static_cast<double>(ts.tv_nsec) / 1000000.0;
+#endif
+	}
+
+	bool ThreadManager::apply(const Config& config) {
+		bool ok = true;
+#ifdef _WIN32
+		DWORD_PTR mask = static_cast<DWORD_PTR>(config.affinity);
+		if (mask == 0) {
+			DWORD_PTR system = 0;
+			GetProcessAffinityMask(GetCurrentProcess(), &mask, &system);
+		}
+		ok = SetThreadAffinityMask(GetCurrentThread(), mask) != 0 && ok;
+		const int priority = config.priority <= 0 ? THREAD_PRIORITY_NORMAL : config.priority >= 50 ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+		ok = SetThreadPriority(GetCurrentThread(), priority) != 0 && ok;
+#else
+#if defined(__linux__)
+		//sched_setaffinity with pid 0 is the calling thread, unlike pthread_setaffinity_np it is on Android too
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		const unsigned int cpus = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < cpus && i < CPU_SETSIZE; i++) {
+			if (config.affinity == 0 || (i < 64 && ((config.affinity >> i) & 1) != 0)) {
+				CPU_SET(i, &set);
+			}
+		}
+		if (CPU_COUNT(&set) > 0) {
+			ok = sched_setaffinity(0, sizeof(set), &set) == 0 && ok;
+		}
+#endif
+		sched_param param = {};
+		int policy = SCHED_OTHER;
+		if (config.priority > 0) {
+			policy = SCHED_FIFO;
+			param.sched_priority = std::clamp(config.priority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+		}
+		ok = pthread_setschedparam(pthread_self(), policy, &param) == 0 && ok;
+#endif
+		return ok;
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace RNBOUnity {
+
+	//Where the plugin's own threads run and at what priority, so they don't compete with the engine's job system
+	//for the same cores. Script configures a role, every thread of that role applies it the next time it checks in,
+	//between pieces of work. Threads of roles that were never configured are left as the platform created them.
+	class ThreadManager {
+		public:
+			enum Role : int32_t {
+				//graph workers, which have to finish their share of a block before the audio thread needs it
+				Graph = 0,
+				//decoding samples for the sample cache, batch rendering
+				Offline = 1,
+				//the reclaimer, capture writers, the hot reload watcher
+				Background = 2,
+			};
+			static const int32_t numRoles = 3;
+
+			struct Config {
+				//bit n allows CPU n, 0 allows all of them. Not supported on Apple platforms, where it is ignored.
+				uint64_t affinity = 0;
+				//0 is the normal scheduler, 1 to 99 real time (SCHED_FIFO, a time critical priority on Windows),
+				//which needs the process to be permitted to, through RLIMIT_RTPRIO on Linux
+				int32_t priority = 0;
+				//thread CPU time a cycle may take before it counts as a deadline miss, 0 doesn't count misses
+				double budgetMs = 0.0;
+			};
+
+			struct Stats {
+				uint64_t cycles = 0;
+				uint64_t misses = 0;
+				double worstMs = 0.0;
+				//times a thread couldn't apply the affinity or priority it was configured with
+				uint64_t denied = 0;
+			};
+
+			static bool valid(int32_t role) { return role >= 0 && role < numRoles; }
+
+			//any thread
+			void configure(Role role, const Config& config);
+			void stats(Role role, Stats& stats);
+			void resetStats(Role role);
+
+			//a thread of role, applies its configuration if it changed since applied, which the thread keeps, starting at 0
+			void checkIn(Role role, uint64_t& applied);
+			//a thread of role, the thread CPU time of one cycle of its work
+			void record(Role role, double ms);
+
+			//of the calling thread
+			static double cpuTimeMs();
+
+		private:
+			//platform specific, false if any part of it was refused
+			static bool apply(const Config& config);
+
+			std::mutex mMutex;
+			Config mConfigs[numRoles];
+			std::atomic<uint64_t> mGenerations[numRoles] = {};
+
+			std::atomic<uint64_t> mCycles[numRoles] = {};
+			std::atomic<uint64_t> mMisses[numRoles] = {};
+			std::atomic<double> mWorst[numRoles] = {};
+			std::atomic<uint64_t> mDenied[numRoles] = {};
+			std::atomic<double> mBudgets[numRoles] = {};
+	};
+
+	//shared by every thread the plugin starts
+	ThreadManager& threadManager();
+}
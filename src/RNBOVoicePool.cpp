@@ -0,0 +1,321 @@
+#include "RNBOVoicePool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RNBO_UNITY_VOICEPOOL_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RNBO_UNITY_VOICEPOOL_NEON 1
+#endif
+
+namespace {
+	//dst += src, returns the peak absolute value of src
+	float mixAndPeak(float * dst, const float * src, size_t n) {
+		size_t i = 0;
+		float peak = 0.0f;
+#if defined(RNBO_UNITY_VOICEPOOL_SSE)
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 vpeak = _mm_setzero_ps();
+		for (; i + 4 <= n; i += 4) {
+			__m128 s = _mm_loadu_ps(src + i);
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s));
+			vpeak = _mm_max_ps(vpeak, _mm_andnot_ps(signMask, s));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, vpeak);
+		peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(RNBO_UNITY_VOICEPOOL_NEON)
+		float32x4_t vpeak = vdupq_n_f32(0.0f);
+		for (; i + 4 <= n; i += 4) {
+			float32x4_t s = vld1q_f32(src + i);
+			vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), s));
+			vpeak = vmaxq_f32(vpeak, vabsq_f32(s));
+		}
+		float lanes[4];
+		vst1q_f32(lanes, vpeak);
+		peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+		for (; i < n; i++) {
+			dst[i] += src[i];
+			peak = std::max(peak, std::fabs(src[i]));
+		}
+		return peak;
+	}
+}
+
+namespace RNBOUnity {
+
+	VoicePool::VoicePool(int32_t voices, int32_t channels, int32_t samplerate, int32_t maxBlockSize, RNBO::PatcherFactoryFunctionPtr patcher) :
+		mVoices(static_cast<size_t>(std::clamp(voices, 1, maxVoices))),
+		mChannels(std::max(1, channels))
+	{
+		for (auto& v: mVoices) {
+			if (patcher) {
+				v.core = std::make_unique<RNBO::CoreObject>(RNBO::UniquePtr<RNBO::PatcherInterface>(patcher()));
+			} else {
+				v.core = std::make_unique<RNBO::CoreObject>();
+			}
+		}
+		prepare(mChannels, std::max(1, maxBlockSize), std::max(1, samplerate));
+	}
+
+	VoicePool::~VoicePool() {
+		delete mReloaded.exchange(nullptr);
+		for (Cores * c = mReplaced.takeAll(); c != nullptr;) {
+			Cores * next = c->mReleaseNext;
+			delete c;
+			c = next;
+		}
+	}
+
+	void VoicePool::reload(RNBO::PatcherFactoryFunctionPtr patcher) {
+		for (Cores * c = mReplaced.takeAll(); c != nullptr;) {
+			Cores * next = c->mReleaseNext;
+			delete c;
+			c = next;
+		}
+		Cores * fresh = new Cores();
+		fresh->rate = mPreparedRate.load(std::memory_order_relaxed);
+		fresh->frames = mPreparedFrames.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < mVoices.size(); i++) {
+			fresh->cores.push_back(std::make_unique<RNBO::CoreObject>(RNBO::UniquePtr<RNBO::PatcherInterface>(patcher())));
+			fresh->cores.back()->prepareToProcess(fresh->rate, static_cast<size_t>(fresh->frames));
+		}
+		//replaces a set the audio thread hasn't picked up yet
+		delete mReloaded.exchange(fresh, std::memory_order_acq_rel);
+	}
+
+	void VoicePool::prepare(int32_t channels, int32_t nframes, int32_t samplerate) {
+		const size_t samples = static_cast<size_t>(channels) * static_cast<size_t>(nframes);
+		//only grows, so after the first few blocks there is nothing to allocate
+		if (mInput.size() < samples) {
+			mInput.resize(samples, 0.0f);
+			mScratch.resize(samples, 0.0f);
+		}
+		const int32_t preparedFrames = mPreparedFrames.load(std::memory_order_relaxed);
+		if (samplerate != mPreparedRate.load(std::memory_order_relaxed) || nframes > preparedFrames) {
+			mPreparedRate.store(samplerate, std::memory_order_relaxed);
+			mPreparedFrames.store(std::max(nframes, preparedFrames), std::memory_order_relaxed);
+			for (auto& v: mVoices) {
+				v.core->prepareToProcess(samplerate, static_cast<size_t>(std::max(nframes, preparedFrames)));
+			}
+		}
+	}
+
+	int32_t VoicePool::trigger(int32_t priority,
+			const RNBO::ParameterIndex * paramIndices, const RNBO::ParameterValue * paramValues, int32_t numParams,
+			RNBO::MessageTag bangTag,
+			const uint8_t * midi, int32_t midiLen,
+			RNBO::MillisecondTime attime) {
+		Command cmd = {};
+		cmd.type = CommandType::Trigger;
+		cmd.priority = priority;
+		cmd.numParams = (paramIndices != nullptr && paramValues != nullptr) ? std::clamp(numParams, 0, maxTriggerParams) : 0;
+		for (int32_t i = 0; i < cmd.numParams; i++) {
+			cmd.paramIndices[i] = paramIndices[i];
+			cmd.paramValues[i] = paramValues[i];
+		}
+		cmd.bangTag = bangTag;
+		cmd.midiLen = midi != nullptr ? std::clamp(midiLen, 0, 3) : 0;
+		for (int32_t i = 0; i < cmd.midiLen; i++) {
+			cmd.midi[i] = midi[i];
+		}
+		cmd.attime = attime;
+
+		std::lock_guard<std::mutex> guard(mProducerMutex);
+		cmd.voiceId = mNextId;
+		if (!mCommands.try_enqueue(cmd)) {
+			return invalidVoice;
+		}
+		mNextId = (mNextId + 1) & 0x7FFFFFFF;
+		return cmd.voiceId;
+	}
+
+	bool VoicePool::stop(int32_t voiceId) {
+		Command cmd = {};
+		cmd.type = CommandType::Stop;
+		cmd.voiceId = voiceId;
+
+		std::lock_guard<std::mutex> guard(mProducerMutex);
+		return mCommands.try_enqueue(cmd);
+	}
+
+	void VoicePool::setCulling(float threshold, RNBO::MillisecondTime holdMs) {
+		mThreshold.store(std::max(0.0f, threshold));
+		mHoldMs.store(std::max(0.0, holdMs));
+	}
+
+	void VoicePool::setStopMessage(RNBO::MessageTag tag) {
+		mStopTag.store(tag);
+	}
+
+	VoicePool::Stats VoicePool::stats() const {
+		Stats s;
+		s.active = mActive.load();
+		s.triggered = mTriggered.load();
+		s.stolen = mStolen.load();
+		s.rejected = mRejected.load();
+		s.culled = mCulled.load();
+		return s;
+	}
+
+	int32_t VoicePool::allocate(int32_t priority) {
+		int32_t candidate = -1;
+		for (int32_t i = 0; i < static_cast<int32_t>(mVoices.size()); i++) {
+			const auto& v = mVoices[i];
+			if (!v.active) {
+				return i;
+			}
+			if (v.priority > priority) {
+				continue;
+			}
+			if (candidate < 0) {
+				candidate = i;
+				continue;
+			}
+			//steal the lowest priority first, then the quietest, then the oldest
+			const auto& c = mVoices[candidate];
+			if (v.priority < c.priority
+					|| (v.priority == c.priority && (v.peak < c.peak || (v.peak == c.peak && v.startedAt < c.startedAt)))) {
+				candidate = i;
+			}
+		}
+		if (candidate >= 0) {
+			mStolen.fetch_add(1, std::memory_order_relaxed);
+		}
+		return candidate;
+	}
+
+	//ends whatever the voice played before, at the time its next trigger is due and ahead of the trigger's events
+	void VoicePool::reset(Voice& v, RNBO::MillisecondTime attime) {
+		if (v.note >= 0) {
+			const uint8_t off[3] = { static_cast<uint8_t>(0x80 | v.noteChannel), static_cast<uint8_t>(v.note), 0 };
+			v.core->scheduleEvent(RNBO::MidiEvent(attime, 0, off, 3));
+		}
+		const RNBO::MessageTag tag = mStopTag.load(std::memory_order_relaxed);
+		if (v.played && tag != 0) {
+			v.core->scheduleEvent(RNBO::MessageEvent(tag, attime));
+		}
+		v.played = false;
+		v.note = -1;
+	}
+
+	void VoicePool::handleCommand(const Command& cmd) {
+		if (cmd.type == CommandType::Stop) {
+			for (auto& v: mVoices) {
+				if (v.active && v.id == cmd.voiceId) {
+					v.active = false;
+					v.id = invalidVoice;
+					break;
+				}
+			}
+			return;
+		}
+
+		int32_t index = allocate(cmd.priority);
+		if (index < 0) {
+			mRejected.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		auto& v = mVoices[index];
+		reset(v, cmd.attime);
+		v.active = true;
+		v.played = true;
+		v.id = cmd.voiceId;
+		v.priority = cmd.priority;
+		v.startedAt = mBlockCount;
+		v.startAt = cmd.attime;
+		//don't cull or steal a voice as silent before it has had a chance to sound
+		v.peak = std::numeric_limits<float>::max();
+		v.silentFor = 0.0;
+		if (cmd.midiLen == 3 && (cmd.midi[0] & 0xF0) == 0x90 && cmd.midi[2] > 0) {
+			v.note = cmd.midi[1];
+			v.noteChannel = cmd.midi[0] & 0x0F;
+		}
+
+		for (int32_t i = 0; i < cmd.numParams; i++) {
+			v.core->setParameterValue(cmd.paramIndices[i], cmd.paramValues[i], cmd.attime);
+		}
+		if (cmd.bangTag != 0) {
+			v.core->scheduleEvent(RNBO::MessageEvent(cmd.bangTag, cmd.attime));
+		}
+		if (cmd.midiLen > 0) {
+			v.core->scheduleEvent(RNBO::MidiEvent(cmd.attime, 0, cmd.midi, static_cast<size_t>(cmd.midiLen)));
+		}
+		mTriggered.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void VoicePool::process(RNBO::MillisecondTime now, float * buffer, int32_t channels, int32_t nframes, int32_t samplerate) {
+		if (buffer == nullptr || channels <= 0 || nframes <= 0 || samplerate <= 0) {
+			return;
+		}
+
+		Cores * reloaded = mReloaded.exchange(nullptr, std::memory_order_acq_rel);
+		if (reloaded != nullptr) {
+			for (size_t i = 0; i < mVoices.size(); i++) {
+				Voice& v = mVoices[i];
+				std::swap(v.core, reloaded->cores[i]);
+				v.active = false;
+				v.id = invalidVoice;
+				v.silentFor = 0.0;
+				//the new core hasn't played anything
+				v.played = false;
+				v.note = -1;
+			}
+			//prepared for a rate that changed since, prepare below catches up
+			if (reloaded->rate != mPreparedRate.load(std::memory_order_relaxed) || reloaded->frames != mPreparedFrames.load(std::memory_order_relaxed)) {
+				mPreparedRate.store(0, std::memory_order_relaxed);
+			}
+			mReplaced.push(reloaded);
+		}
+		prepare(channels, nframes, samplerate);
+
+		Command cmd;
+		while (mCommands.try_dequeue(cmd)) {
+			handleCommand(cmd);
+		}
+
+		const size_t samples = static_cast<size_t>(channels) * static_cast<size_t>(nframes);
+		std::memcpy(mInput.data(), buffer, samples * sizeof(float));
+		std::memset(buffer, 0, samples * sizeof(float));
+
+		const float threshold = mThreshold.load(std::memory_order_relaxed);
+		const RNBO::MillisecondTime hold = mHoldMs.load(std::memory_order_relaxed);
+		const RNBO::MillisecondTime blockMs = 1000.0 * static_cast<RNBO::MillisecondTime>(nframes) / static_cast<RNBO::MillisecondTime>(samplerate);
+
+		int32_t active = 0;
+		for (auto& v: mVoices) {
+			if (!v.active) {
+				continue;
+			}
+			v.core->setCurrentTime(now);
+			v.core->process(mInput.data(), channels, mScratch.data(), channels, static_cast<size_t>(nframes), nullptr, nullptr);
+			v.peak = mixAndPeak(buffer, mScratch.data(), samples);
+
+			//triggered ahead of time, it hasn't had a chance to sound yet
+			if (v.startAt >= now + blockMs) {
+				v.peak = std::numeric_limits<float>::max();
+				v.silentFor = 0.0;
+			} else if (v.peak < threshold) {
+				v.silentFor += blockMs;
+				if (v.silentFor >= hold) {
+					v.active = false;
+					v.id = invalidVoice;
+					mCulled.fetch_add(1, std::memory_order_relaxed);
+					continue;
+				}
+			} else {
+				v.silentFor = 0.0;
+			}
+			active++;
+		}
+		mActive.store(active, std::memory_order_relaxed);
+		mBlockCount++;
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "RNBOReclaim.h"
+
+#include <RNBO.h>
+#include <readerwriterqueue/readerwriterqueue.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace RNBOUnity {
+
+	//A fixed set of pre-prepared instances of the patch that are played as voices and mixed into one output.
+	//Script triggers voices, the audio thread allocates them by priority, steals the quietest (then oldest)
+	//voice when the pool is full and culls voices once their output stays below a threshold.
+	class VoicePool {
+		public:
+			static constexpr int32_t maxVoices = 4096;
+			static constexpr int32_t maxTriggerParams = 8;
+			static const int32_t invalidVoice = -1;
+
+			struct Stats {
+				int32_t active = 0;
+				uint64_t triggered = 0;
+				uint64_t stolen = 0;
+				uint64_t rejected = 0;
+				uint64_t culled = 0;
+			};
+
+			//patcher creates the voices' patchers, nullptr uses the default export
+			VoicePool(int32_t voices, int32_t channels, int32_t samplerate, int32_t maxBlockSize, RNBO::PatcherFactoryFunctionPtr patcher = nullptr);
+			~VoicePool();
+
+			//hot reload, builds a new set of voices with patcher's code, which the audio thread switches to at its next
+			//block, stopping every voice. The voices they replace are freed by the next reload or the destructor.
+			void reload(RNBO::PatcherFactoryFunctionPtr patcher);
+
+			//script thread, returns a voice id that can be used with stop, or invalidVoice if the command queue is full
+			//higher priority voices are never stolen by lower priority ones
+			int32_t trigger(int32_t priority,
+					const RNBO::ParameterIndex * paramIndices, const RNBO::ParameterValue * paramValues, int32_t numParams,
+					RNBO::MessageTag bangTag,
+					const uint8_t * midi, int32_t midiLen,
+					RNBO::MillisecondTime attime);
+			bool stop(int32_t voiceId);
+
+			//peak level below which a voice counts as silent, and for how long it has to be silent before it is culled
+			void setCulling(float threshold, RNBO::MillisecondTime holdMs);
+
+			//Message sent (as a bang) to a voice that was stolen, stopped or culled, before it plays its next trigger, so the
+			//patch can reset itself. 0, the default, sends none. A voice triggered with a note on gets the note off either way.
+			void setStopMessage(RNBO::MessageTag tag);
+
+			//audio thread, processes all active voices and mixes them into buffer (interleaved, also used as the voices' input)
+			void process(RNBO::MillisecondTime now, float * buffer, int32_t channels, int32_t nframes, int32_t samplerate);
+
+			Stats stats() const;
+
+		private:
+			enum class CommandType : uint8_t { Trigger, Stop };
+			struct Command {
+				CommandType type;
+				int32_t voiceId;
+				int32_t priority;
+				int32_t numParams;
+				RNBO::ParameterIndex paramIndices[maxTriggerParams];
+				RNBO::ParameterValue paramValues[maxTriggerParams];
+				RNBO::MessageTag bangTag;
+				uint8_t midi[3];
+				int32_t midiLen;
+				RNBO::MillisecondTime attime;
+			};
+
+			struct Voice {
+				std::unique_ptr<RNBO::CoreObject> core;
+				bool active = false;
+				int32_t priority = 0;
+				int32_t id = invalidVoice;
+				uint64_t startedAt = 0; //block counter, for age
+				float peak = 0.0f;
+				RNBO::MillisecondTime silentFor = 0.0;
+				//when the trigger's events are due, the voice isn't silent before that
+				RNBO::MillisecondTime startAt = 0.0;
+				//whether it has played since it was last reset, and the note its trigger started, if it started one
+				bool played = false;
+				int32_t note = -1;
+				uint8_t noteChannel = 0;
+			};
+
+			//voices' cores built off the audio thread, the ones they replaced go back in the same struct
+			struct Cores {
+				std::vector<std::unique_ptr<RNBO::CoreObject>> cores;
+				int32_t rate = 0;
+				int32_t frames = 0;
+				Cores * mReleaseNext = nullptr;
+			};
+
+			void handleCommand(const Command& cmd);
+			int32_t allocate(int32_t priority);
+			void reset(Voice& v, RNBO::MillisecondTime attime);
+			void prepare(int32_t channels, int32_t nframes, int32_t samplerate);
+
+			std::vector<Voice> mVoices;
+			int32_t mChannels;
+
+			std::vector<float> mInput;
+			std::vector<float> mScratch;
+			//written by the audio thread, read by reload
+			std::atomic<int32_t> mPreparedRate = 0;
+			std::atomic<int32_t> mPreparedFrames = 0;
+			uint64_t mBlockCount = 0;
+
+			std::atomic<float> mThreshold = 0.0001f;
+			std::atomic<RNBO::MillisecondTime> mHoldMs = 500.0;
+			std::atomic<RNBO::MessageTag> mStopTag = 0;
+
+			std::mutex mProducerMutex;
+			int32_t mNextId = 0;
+			moodycamel::ReaderWriterQueue<Command, 256> mCommands;
+
+			std::atomic<Cores *> mReloaded = nullptr;
+			ReleaseStack<Cores> mReplaced;
+
+			std::atomic<int32_t> mActive = 0;
+			std::atomic<uint64_t> mTriggered = 0;
+			std::atomic<uint64_t> mStolen = 0;
+			std::atomic<uint64_t> mRejected = 0;
+			std::atomic<uint64_t> mCulled = 0;
+	};
+}
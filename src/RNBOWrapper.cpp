@@ -4,11 +4,45 @@
 #include <mutex>
 #include <limits>
 #include <atomic>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <cmath>
+#include <thread>
+#include <condition_variable>
+#include <memory>
 #include <readerwriterqueue/readerwriterqueue.h>
 
 #include <rnbo_description.h>
 #include <iostream>
 
+#include "RNBOCapture.h"
+#include "RNBOMidi.h"
+#include "RNBOVoicePool.h"
+#include "RNBORamps.h"
+#include "RNBOParameterStaging.h"
+#include "RNBOReclaim.h"
+#include "RNBOTagTable.h"
+#include "RNBOSampleCache.h"
+#include "RNBOResampler.h"
+#include "RNBOLatency.h"
+#include "RNBOScheduler.h"
+#include "RNBOSnapshot.h"
+#include "RNBOThreads.h"
+
+#if RNBO_UNITY_HOT_RELOAD == 1
+#include "RNBOHotReload.h"
+#endif
+
+#if RNBO_UNITY_SPECIALIZED == 1
+#include <rnbo_unity_specialization.h>
+#endif
+
+//the oversampling factor instances start with, see docs/SAMPLE_RATES.md
+#ifndef RNBO_UNITY_OVERSAMPLING
+#define RNBO_UNITY_OVERSAMPLING 1
+#endif
+
 
 // if there is no shared lock, we simply use unique lock
 // there may be a slight performance hit when calling functions that use
@@ -39,16 +73,134 @@ extern "C" {
 
 	typedef void (UNITY_AUDIODSP_CALLBACK * CTransportRequestCallback)(void * handle, RNBO::MillisecondTime time, uint8_t* running, RNBO::number* bpm, RNBO::number* beatTime, int32_t *timeSigNum, int32_t *timeSigDenom);
 	typedef void (UNITY_AUDIODSP_CALLBACK * CPresetCallback)(void * handle, const char * payload);
+	typedef void (UNITY_AUDIODSP_CALLBACK * CMIDIBatchCallback)(void * handle, const uint8_t * packed, size_t len, int32_t count);
+
+	//offline rendering
+	enum RNBORenderEventType : int32_t {
+		RNBORenderEventParameter = 0,
+		RNBORenderEventParameterNormalized = 1,
+		RNBORenderEventBang = 2,
+		RNBORenderEventNumber = 3,
+		RNBORenderEventList = 4,
+		RNBORenderEventMIDI = 5,
+		RNBORenderEventTransport = 6,
+		RNBORenderEventTempo = 7,
+		RNBORenderEventBeatTime = 8,
+		RNBORenderEventTimeSignature = 9,
+	};
+
+	//time is in milliseconds from the start of the render
+	//id is the parameter index, message tag, MIDI port or time signature numerator depending on the type
+	//lists and MIDI reference [offset, offset + length) of the job's values or bytes
+	struct RNBORenderEvent {
+		RNBO::MillisecondTime time;
+		int32_t type;
+		uint32_t id;
+		RNBO::number value;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct RNBORenderJob {
+		void * instance; //from RNBOInstanceCreate
+		const float * input; //interleaved, nullptr renders silence into the inputs
+		int32_t inchannels;
+		int64_t inframes; //frames in input, a shorter input than nframes is padded with silence
+		float * output; //interleaved, nframes * outchannels
+		int32_t outchannels;
+		int64_t nframes;
+		int32_t samplerate;
+		int32_t blocksize;
+		const RNBORenderEvent * events;
+		size_t numevents;
+		const RNBO::number * values;
+		size_t numvalues;
+		const uint8_t * bytes;
+		size_t numbytes;
+	};
+}
+
+//defined by the plugin's own export
+extern "C" RNBO::PatcherFactoryFunctionPtr GetPatcherFactoryFunction(RNBO::PlatformInterface* platformInterface);
+
+namespace RNBOUnity
+{
+	typedef RNBO::PatcherFactoryFunctionPtr (*PatchFactoryFunction)(RNBO::PlatformInterface *);
+
+	//an exported patcher built into this library, each is registered as its own effect
+	struct Patch {
+		const char * name;
+		PatchFactoryFunction factory;
+		const char * description;
+		const char * presets;
+	};
 }
 
+#if RNBO_UNITY_MULTI_PATCH == 1
+//generated by rnbo_unity_add_extra_patches, defines extraPatches
+#include <rnbo_unity_patches.h>
+#endif
+
 namespace RNBOUnity
 {
+#if RNBO_UNITY_MULTI_PATCH == 1
+	constexpr size_t numPatches = 1 + std::size(extraPatches);
+#else
+	constexpr size_t numPatches = 1;
+#endif
+
+	//the first patch is always the plugin's own export
+	const Patch& getPatch(size_t index) {
+		static const Patch main = { PLUGIN_NAME, GetPatcherFactoryFunction, RNBO::patcher_description.c_str(), RNBO::patcher_presets.c_str() };
+#if RNBO_UNITY_MULTI_PATCH == 1
+		if (index > 0)
+			return extraPatches[index - 1];
+#else
+		(void)index;
+#endif
+		return main;
+	}
+
+	//the port tags of every patch, built the first time it is needed
+	const TagTable& tagTable() {
+		static const TagTable table = []() {
+			std::vector<const char *> descriptions;
+			for (size_t i = 0; i < numPatches; i++) {
+				descriptions.push_back(getPatch(i).description);
+			}
+			return TagTable(descriptions);
+		}();
+		return table;
+	}
+
+	//what each patch says about its latency, read the first time it is needed
+	const PatchLatency& patchLatency(size_t patch) {
+		static const std::vector<PatchLatency> latencies = []() {
+			std::vector<PatchLatency> l;
+			for (size_t i = 0; i < numPatches; i++) {
+				l.push_back(PatchLatency::parse(getPatch(i).description));
+			}
+			return l;
+		}();
+		return latencies[patch];
+	}
+
+	//decoded audio files shared by every instance, started the first time script loads one
+	SampleCache& sampleCache() {
+		//outlives the cache, whose decoders check in with it until they are joined
+		threadManager();
+		static SampleCache cache(std::clamp<size_t>(std::thread::hardware_concurrency() / 2, 1, 4), 256 * 1024 * 1024);
+		return cache;
+	}
+
+	template <size_t P>
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK CreateCallback            (UnityAudioEffectState* state);
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK ReleaseCallback           (UnityAudioEffectState* state);
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK ProcessCallback           (UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels);
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK SetFloatParameterCallback (UnityAudioEffectState* state, int index, float value);
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK GetFloatParameterCallback (UnityAudioEffectState* state, int index, float* value, char *valuestr);
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK GetFloatBufferCallback    (UnityAudioEffectState* state, const char* name, float* buffer, int numsamples);
+	template <size_t P>
 	int InternalRegisterEffectDefinition(UnityAudioEffectDefinition& definition);
 }
 namespace {
@@ -59,6 +211,8 @@ namespace {
 			template<typename T>
 				T callback() const { return reinterpret_cast<T>(mCallback); }
 			void * handle() const { return mHandle; }
+
+			Callback * mReleaseNext = nullptr;
 		private:
 			//static method that we don't have to release
 			void (* mCallback)();
@@ -66,36 +220,111 @@ namespace {
 			void * mHandle;
 	};
 
+	//published in place of nullptr to tell the audio thread to drop its callback, never called or released
+	Callback * clearedCallback() {
+		static Callback cleared(nullptr, nullptr);
+		return &cleared;
+	}
+
 	//we have a pointer to a GCHandle that we are holding, we need to notify the c# side that it should release
-	std::mutex callbackReleaseQueueMutex; //only for reading from it
-	moodycamel::ReaderWriterQueue<Callback *, 32> callbackReleaseQueue;
+	//pushed from the audio thread and instance destructors
+	RNBOUnity::ReleaseStack<Callback> callbackReleaseStack;
+
+	//audio threads calling the global transport callback right now, several when graphs process in parallel.
+	//A replaced global callback waits in retiredTransportCallbacks until reclaim sees none of them are.
+	std::atomic<int32_t> globalTransportReaders = 0;
+	std::mutex retiredTransportMutex;
+	std::vector<Callback *> retiredTransportCallbacks;
+	//the GCHandles of reclaimed callbacks, until script collects them with RNBOReleaseHandles
+	std::mutex releasedHandlesMutex;
+	std::vector<void *> releasedHandles;
+
+	//RNBO calls the release callback of data refs in the audio thread
+	RNBOUnity::ReleaseStack<RNBOUnity::DataRef> datarefReleaseStack;
+
+	void DataRefRelease(RNBO::ExternalDataId, char* d) {
+		if (d) {
+			datarefReleaseStack.push(RNBOUnity::DataRef::fromData(d));
+		}
+	}
+
+	//frees destroyed instances once no caller can still be using them, defined after InnerData
+	void reclaimInstances();
+
+	//any thread but the audio thread
+	void reclaim() {
+		//first, the instances release callbacks and data refs as they are freed
+		reclaimInstances();
+		RNBOUnity::DataRef::freeAll(datarefReleaseStack.takeAll());
+
+		{
+			//a reader that started before the callback was replaced is still counted, any later one got the new callback
+			std::lock_guard<std::mutex> guard(retiredTransportMutex);
+			if (!retiredTransportCallbacks.empty() && globalTransportReaders.load() == 0) {
+				for (auto c: retiredTransportCallbacks) {
+					callbackReleaseStack.push(c);
+				}
+				retiredTransportCallbacks.clear();
+			}
+		}
+
+		Callback * c = callbackReleaseStack.takeAll();
+		if (c == nullptr)
+			return;
+		std::lock_guard<std::mutex> guard(releasedHandlesMutex);
+		while (c != nullptr) {
+			Callback * next = c->mReleaseNext;
+			releasedHandles.push_back(c->handle());
+			delete c;
+			c = next;
+		}
+	}
+
+	//frees what the audio thread let go of, whether or not script polls
+	void startReclaimer() {
+		//constructed first so it is destroyed after the reclaimer, whose thread checks in with it until it is joined
+		RNBOUnity::threadManager();
+		static RNBOUnity::Reclaimer reclaimer(reclaim, std::chrono::milliseconds(100));
+	}
+}
+
+namespace {
+	template <size_t... P>
+	void DeclareEffects(UnityAudioEffectDefinition * definitions, UInt32 flags, std::index_sequence<P...>) {
+		(AudioPluginUtil::DeclareEffect(
+				definitions[P],
+				RNBOUnity::getPatch(P).name,
+				flags,
+				RNBOUnity::CreateCallback<P>,
+				RNBOUnity::ReleaseCallback,
+				RNBOUnity::ProcessCallback,
+				RNBOUnity::SetFloatParameterCallback,
+				RNBOUnity::GetFloatParameterCallback,
+				RNBOUnity::GetFloatBufferCallback,
+				RNBOUnity::InternalRegisterEffectDefinition<P>
+				), ...);
+	}
 }
 
 extern "C" UNITY_AUDIODSP_EXPORT_API int AUDIO_CALLING_CONVENTION UnityGetAudioEffectDefinitions(UnityAudioEffectDefinition*** definitionptr)
 {
-		static UnityAudioEffectDefinition definition;
-		static UnityAudioEffectDefinition* definitionp = &definition;
+		static std::array<UnityAudioEffectDefinition, RNBOUnity::numPatches> definitions;
+		static std::array<UnityAudioEffectDefinition*, RNBOUnity::numPatches> definitionps;
 		UInt32 flags = 0;
 
 #if PLUGIN_IS_SPATIALIZER==1
 		flags |= UnityAudioEffectDefinitionFlags_IsSpatializer;
 #endif
 
-		AudioPluginUtil::DeclareEffect(
-				definition,
-				PLUGIN_NAME,
-				flags,
-				RNBOUnity::CreateCallback,
-				RNBOUnity::ReleaseCallback,
-				RNBOUnity::ProcessCallback,
-				RNBOUnity::SetFloatParameterCallback,
-				RNBOUnity::GetFloatParameterCallback,
-				RNBOUnity::GetFloatBufferCallback,
-				RNBOUnity::InternalRegisterEffectDefinition
-				);
+		DeclareEffects(definitions.data(), flags, std::make_index_sequence<RNBOUnity::numPatches>());
+		//build it while the library is loaded, rather than when a message first arrives
+		RNBOUnity::tagTable();
+		for (size_t i = 0; i < definitions.size(); i++) {
+			definitionps[i] = &definitions[i];
+		}
 
-		*definitionptr = &definitionp;
-		return 1;
+		*definitionptr = definitionps.data();
+		return static_cast<int>(RNBOUnity::numPatches);
 }
 
 namespace RNBOUnity
@@ -111,6 +340,12 @@ namespace RNBOUnity
 			typedef std::function<void(const RNBO::ParameterEvent)> ParameterEventCallback;
 			typedef std::function<void()> PresetTouchedCallback;
 			typedef std::function<void(std::shared_ptr<const RNBO::Preset>)> PresetCallback;
+			typedef std::function<void(const uint8_t *, size_t, int32_t)> MidiBatchCallback;
+
+			//outgoing MIDI is packed like RNBOSendMIDIPacked input: float64 time, uint8 port, uint16 length, bytes
+			static const size_t midiRecordHeaderSize = sizeof(double) + 1 + 2;
+			//bound the buffer in case script never collects it
+			static const size_t maxMidiOutBytes = 1 << 16;
 
 			UnityEventHandler(
 					MessageEventCallback mc = nullptr,
@@ -140,19 +375,21 @@ namespace RNBOUnity
 				{
 				}
 
-			//only call from the poll thread
-			void setMessageEventCallback(MessageEventCallback cb) { mMessageEventCallback = cb; };
-			void setMidiEventCallback(MidiEventCallback cb) { mMidiEventCallback = cb; };
-			void setTransportEventCallback(TransportEventCallback cb) { mTransportEventCallback = cb; };
-			void setTempoEventCallback(TempoEventCallback cb) { mTempoEventCallback = cb; };
-			void setBeatTimeEventCallback(BeatTimeEventCallback cb) { mBeatTimeEventCallback = cb; };
-			void setTimeSignatureEventCallback(TimeSignatureEventCallback cb) { mTimeSignatureEventCallback = cb; };
-			void setParameterEventCallback(ParameterEventCallback cb) { mParameterEventCallback = cb; };
-			void setPresetTouchedCallback(PresetTouchedCallback cb) { mPresetTouchedCallback = cb; };
-			void setPresetCallback(PresetCallback cb) { mPresetCallback = cb; };
+			//any script thread, poll holds the same lock while it hands events to the callbacks
+			void setMessageEventCallback(MessageEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mMessageEventCallback = cb; };
+			void setMidiEventCallback(MidiEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mMidiEventCallback = cb; };
+			void setTransportEventCallback(TransportEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mTransportEventCallback = cb; };
+			void setTempoEventCallback(TempoEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mTempoEventCallback = cb; };
+			void setBeatTimeEventCallback(BeatTimeEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mBeatTimeEventCallback = cb; };
+			void setTimeSignatureEventCallback(TimeSignatureEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mTimeSignatureEventCallback = cb; };
+			void setParameterEventCallback(ParameterEventCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mParameterEventCallback = cb; };
+			void setPresetTouchedCallback(PresetTouchedCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mPresetTouchedCallback = cb; };
+			void setPresetCallback(PresetCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mPresetCallback = cb; };
+			void setMidiBatchCallback(MidiBatchCallback cb) { std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex); mMidiBatchCallback = cb; if (cb) setMidiOutEnabled(true); };
+			void setMidiOutEnabled(bool enabled) { mMidiOutEnabled.store(enabled); };
 
-			//only call from the poll thread
 			void clearCallbacks() {
+				std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex);
 				setMessageEventCallback(nullptr);
 				setMidiEventCallback(nullptr);
 				setTransportEventCallback(nullptr);
@@ -162,26 +399,76 @@ namespace RNBOUnity
 				setParameterEventCallback(nullptr);
 				setPresetTouchedCallback(nullptr);
 				setPresetCallback(nullptr);
+				setMidiBatchCallback(nullptr);
+				setMidiOutEnabled(false);
 			}
 
 			void eventsAvailable() override {
 				mEventsAvailable.store(true);
 			}
 
+			//callbacks may set callbacks again, so the lock is recursive
 			void poll() {
+				std::lock_guard<std::recursive_mutex> callbacks(mCallbacksMutex);
+				if (mParameterStaging)
+					mParameterStaging->settling();
 				bool expected = true;
 				if (mEventsAvailable.compare_exchange_weak(expected, false)) {
 					drainEvents();
 				}
+				if (mParameterStaging)
+					mParameterStaging->settled();
+
+				//deliver all of the MIDI collected while draining with a single callback
+				if (mMidiBatchCallback) {
+					std::lock_guard<std::mutex> guard(mMidiOutMutex);
+					if (mMidiOutCount > 0) {
+						mMidiBatchCallback(mMidiOut.data(), mMidiOut.size(), mMidiOutCount);
+						mMidiOut.clear();
+						mMidiOutCount = 0;
+					}
+				}
+			}
+
+			//copy out as many whole MIDI records as fit into dest, returns the number of bytes written
+			size_t copyMidiOut(uint8_t * dest, size_t capacity, int32_t * count) {
+				std::lock_guard<std::mutex> guard(mMidiOutMutex);
+				size_t pos = 0;
+				int32_t records = 0;
+				while (dest != nullptr && pos + midiRecordHeaderSize <= mMidiOut.size()) {
+					const size_t length = static_cast<size_t>(mMidiOut[pos + sizeof(double) + 1]) | (static_cast<size_t>(mMidiOut[pos + sizeof(double) + 2]) << 8);
+					const size_t record = midiRecordHeaderSize + length;
+					if (pos + record > capacity) {
+						break;
+					}
+					pos += record;
+					records++;
+				}
+				if (pos > 0) {
+					std::memcpy(dest, mMidiOut.data(), pos);
+					mMidiOut.erase(mMidiOut.begin(), mMidiOut.begin() + static_cast<std::ptrdiff_t>(pos));
+					mMidiOutCount -= records;
+				}
+				if (count) {
+					*count = records;
+				}
+				return pos;
 			}
 
+			uint64_t midiOutDropped() const { return mMidiOutDropped.load(); }
+
 			void handlePresetEvent(const RNBO::PresetEvent& pe) override {
 				if (mPresetTouchedCallback && pe.getType() == RNBO::PresetEvent::Touched) {
 					mPresetTouchedCallback();
 				}
 			}
 
+			//changes script stages are not reported back to it
+			void setParameterStaging(RNBOUnity::ParameterStaging * staging) { mParameterStaging = staging; }
+
 			void handleParameterEvent(const RNBO::ParameterEvent& event) override {
+				if (mParameterStaging && mParameterStaging->echo(event.getIndex(), event.getValue()))
+					return;
 				if (mParameterEventCallback)
 					mParameterEventCallback(event);
 			}
@@ -194,6 +481,23 @@ namespace RNBOUnity
 			void handleMidiEvent(const RNBO::MidiEvent& event) override {
 				if (mMidiEventCallback)
 					mMidiEventCallback(event);
+
+				if (mMidiOutEnabled.load()) {
+					std::lock_guard<std::mutex> guard(mMidiOutMutex);
+					const size_t length = std::min<size_t>(event.getLength(), 0xFFFF);
+					if (mMidiOut.size() + midiRecordHeaderSize + length > maxMidiOutBytes) {
+						mMidiOutDropped.fetch_add(1);
+						return;
+					}
+					const double time = event.getTime();
+					const uint8_t * t = reinterpret_cast<const uint8_t *>(&time);
+					mMidiOut.insert(mMidiOut.end(), t, t + sizeof(double));
+					mMidiOut.push_back(static_cast<uint8_t>(event.getPortIndex()));
+					mMidiOut.push_back(static_cast<uint8_t>(length & 0xFF));
+					mMidiOut.push_back(static_cast<uint8_t>(length >> 8));
+					mMidiOut.insert(mMidiOut.end(), event.getData(), event.getData() + length);
+					mMidiOutCount++;
+				}
 			}
 
 			void handleTransportEvent(const RNBO::TransportEvent& e) override
@@ -221,6 +525,7 @@ namespace RNBOUnity
 			}
 
 			void handlePreset(std::shared_ptr<const RNBO::Preset> p) {
+				std::lock_guard<std::recursive_mutex> guard(mCallbacksMutex);
 				if (mPresetCallback)
 					mPresetCallback(p);
 			}
@@ -228,6 +533,8 @@ namespace RNBOUnity
 		private:
 			std::atomic<bool> mEventsAvailable;
 
+			std::recursive_mutex mCallbacksMutex;
+
 			MessageEventCallback mMessageEventCallback;
 			MidiEventCallback mMidiEventCallback;
 			TransportEventCallback mTransportEventCallback;
@@ -236,23 +543,211 @@ namespace RNBOUnity
 			TimeSignatureEventCallback mTimeSignatureEventCallback;
 
 			ParameterEventCallback mParameterEventCallback;
+			RNBOUnity::ParameterStaging * mParameterStaging = nullptr;
 			PresetTouchedCallback mPresetTouchedCallback;
 			PresetCallback mPresetCallback;
+
+			MidiBatchCallback mMidiBatchCallback;
+			std::atomic<bool> mMidiOutEnabled = false;
+			std::mutex mMidiOutMutex;
+			std::vector<uint8_t> mMidiOut;
+			int32_t mMidiOutCount = 0;
+			std::atomic<uint64_t> mMidiOutDropped = 0;
 	};
 
 	const int32_t invalidKey = 0;
 	const int32_t maxKey = 16777216;
 
 	static std::atomic<Callback *> globalTransportCallback = nullptr;
-	Callback * globalTransportCallbackCurrent = nullptr;
+
+	//transport state shared by every instance that doesn't have its own transport
+	//written by script via RNBOSetGlobalTransportState, read from the audio thread(s) without locking (seqlock)
+	//beat time is extrapolated from the last update so script only has to write when something changes
+	class SharedTransportState {
+		public:
+			struct Snapshot {
+				bool running = false;
+				RNBO::number bpm = 0.0;
+				RNBO::number beatTime = 0.0;
+				int32_t timeSigNum = 4;
+				int32_t timeSigDenom = 4;
+				RNBO::MillisecondTime atTime = 0.0;
+
+				RNBO::number beatTimeAt(RNBO::MillisecondTime now) const {
+					if (!running || now <= atTime) {
+						return beatTime;
+					}
+					//mstobeats from rnbo
+					return beatTime + (now - atTime) * bpm * 0.008 / 480.0;
+				}
+			};
+
+			bool active() const { return mActive.load(std::memory_order_acquire); }
+
+			//writers are serialized by mWriteMutex, readers never take it
+			//a negative beatTime continues from the current (extrapolated) position, so tempo changes don't jump
+			void write(bool running, RNBO::number bpm, RNBO::number beatTime, int32_t timeSigNum, int32_t timeSigDenom, RNBO::MillisecondTime atTime) {
+				std::lock_guard<std::mutex> guard(mWriteMutex);
+				if (beatTime < 0.0) {
+					Snapshot cur;
+					beatTime = (mActive.load(std::memory_order_relaxed) && read(cur)) ? cur.beatTimeAt(atTime) : 0.0;
+				}
+
+				auto seq = mSequence.load(std::memory_order_relaxed);
+				mSequence.store(seq + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+
+				mRunning.store(running, std::memory_order_relaxed);
+				mBPM.store(bpm, std::memory_order_relaxed);
+				mBeatTime.store(beatTime, std::memory_order_relaxed);
+				mTimeSigNum.store(timeSigNum, std::memory_order_relaxed);
+				mTimeSigDenom.store(timeSigDenom, std::memory_order_relaxed);
+				mAtTime.store(atTime, std::memory_order_relaxed);
+
+				mSequence.store(seq + 2, std::memory_order_release);
+				mActive.store(true, std::memory_order_release);
+			}
+
+			void clear() {
+				mActive.store(false, std::memory_order_release);
+			}
+
+			//retries while a write is in progress, gives up rather than spinning forever on the audio thread
+			bool read(Snapshot& out) const {
+				for (int attempt = 0; attempt < 64; attempt++) {
+					auto before = mSequence.load(std::memory_order_acquire);
+					if (before & 1) {
+						continue;
+					}
+
+					out.running = mRunning.load(std::memory_order_relaxed);
+					out.bpm = mBPM.load(std::memory_order_relaxed);
+					out.beatTime = mBeatTime.load(std::memory_order_relaxed);
+					out.timeSigNum = mTimeSigNum.load(std::memory_order_relaxed);
+					out.timeSigDenom = mTimeSigDenom.load(std::memory_order_relaxed);
+					out.atTime = mAtTime.load(std::memory_order_relaxed);
+
+					std::atomic_thread_fence(std::memory_order_acquire);
+					if (mSequence.load(std::memory_order_relaxed) == before) {
+						return true;
+					}
+				}
+				return false;
+			}
+
+		private:
+			std::mutex mWriteMutex;
+			std::atomic<bool> mActive = false;
+			std::atomic<uint32_t> mSequence = 0;
+
+			std::atomic<bool> mRunning = false;
+			std::atomic<RNBO::number> mBPM = 0.0;
+			std::atomic<RNBO::number> mBeatTime = 0.0;
+			std::atomic<int32_t> mTimeSigNum = 4;
+			std::atomic<int32_t> mTimeSigDenom = 4;
+			std::atomic<RNBO::MillisecondTime> mAtTime = 0.0;
+	};
+	SharedTransportState globalTransportState;
+
+	//entered by every call that gets an instance by pointer rather than by key, see RNBOInstanceDestroy
+	GracePeriod instanceGrace;
+
+	//hands an object from script to the audio thread
+	//swap only returns the previous object once nobody is using it any longer, the caller then owns it
+	template<typename T>
+	class GuardedSlot {
+		public:
+			T * swap(T * value) {
+				T * prev = mValue.exchange(value);
+				while (mUsers.load() != 0) {
+					std::this_thread::yield();
+				}
+				return prev;
+			}
+
+			template<typename F>
+			void with(F func) {
+				mUsers.fetch_add(1);
+				T * value = mValue.load();
+				if (value != nullptr) {
+					func(value);
+				}
+				mUsers.fetch_sub(1);
+			}
+
+			//like with, but func also runs when there is no object, with nullptr
+			template<typename F>
+			void use(F func) {
+				mUsers.fetch_add(1);
+				func(mValue.load());
+				mUsers.fetch_sub(1);
+			}
+
+		private:
+			std::atomic<T *> mValue = nullptr;
+			std::atomic<int32_t> mUsers = 0;
+	};
+
+	inline float peakAbs(const float * buffer, size_t samples) {
+		float peak = 0.0f;
+		for (size_t i = 0; i < samples; i++) {
+			peak = std::max(peak, std::fabs(buffer[i]));
+		}
+		return peak;
+	}
+
+#if RNBO_UNITY_MULTI_PATCH == 1
+	RNBO::UniquePtr<RNBO::PatcherInterface> createPatcher(size_t patch) {
+		return RNBO::UniquePtr<RNBO::PatcherInterface>(getPatch(patch).factory(RNBO::Platform::get())());
+	}
+#endif
+
+#if RNBO_UNITY_HOT_RELOAD == 1
+	struct InnerData;
+
+	//every instance and voice pool, so they can all be moved to newly loaded code
+	std::mutex hotReloadMutex;
+	std::vector<InnerData *> hotReloadInstances;
+	std::vector<VoicePool *> hotReloadPools;
+
+	PatchReloader& patchReloader();
+
+	//the newest reloaded code if there is any, otherwise the code built into the plugin
+	RNBO::PatcherFactoryFunctionPtr currentPatcherFactory() {
+		RNBO::PatcherFactoryFunctionPtr f = patchReloader().factory();
+		return f ? f : GetPatcherFactoryFunction(RNBO::Platform::get());
+	}
+
+	RNBO::UniquePtr<RNBO::PatcherInterface> createPatcher(size_t) {
+		return RNBO::UniquePtr<RNBO::PatcherInterface>(currentPatcherFactory()());
+	}
+#endif
 
 	struct InnerData {
 			UnityEventHandler mEventHandler;
+#if RNBO_UNITY_HOT_RELOAD == 1
+			//replaced whole when the code is reloaded, owned by mCoreSlot. Whatever touches the core, or the staging and
+			//snapshot sized for it, does so inside useCore or waitForCore, see reloadPatcher.
+			RNBO::CoreObject * mCore;
+			GuardedSlot<RNBO::CoreObject> mCoreSlot;
+			RNBO::CoreObject& core() { return *mCore; }
+#else
 			RNBO::CoreObject mCore;
+			RNBO::CoreObject& core() { return mCore; }
+#endif
 			int32_t mInstanceKey = invalidKey;
-
+			//index into the patches built into this library
+			const size_t mPatch;
+			//immediate parameter changes from script and the mixer, applied at the start of the next block
+			ParameterStaging mStaging { core().getNumParameters() };
+			//a binary snapshot restored from script, applied whole at the start of the next block
+			SnapshotSlot mSnapshot { core().getNumParameters() };
+
+			//set by script, taken by the audio thread at the start of its next block, which then owns it as current
 			std::atomic<Callback *> mTransportCallback = nullptr;
 			Callback * mTransportCallbackCurrent = nullptr;
+			//set by RNBOInstanceDestroy, callers that get here by pointer after that leave the instance alone
+			std::atomic<bool> mDestroyed = false;
 
 			bool mTransportRunning = false;
 			RNBO::number mTransportBPM = 0.0;
@@ -260,146 +755,1276 @@ namespace RNBOUnity
 			int32_t mTransportTimeSigNum = 0;
 			int32_t mTransportTimeSigDenom = 0;
 
-			InnerData() : mCore(&mEventHandler) {}
+			//optional idle bypass, settings written from script, state only touched by the audio thread
+			std::atomic<bool> mIdleEnabled = false;
+			std::atomic<float> mIdleThreshold = 0.0001f;
+			std::atomic<RNBO::MillisecondTime> mIdleTailMs = 1000.0;
+			//set by anything script sends, and the latest time of any event it scheduled
+			std::atomic<bool> mWakePending = false;
+			std::atomic<RNBO::MillisecondTime> mPendingUntil = 0.0;
+
+			std::atomic<bool> mIdle = false;
+			RNBO::MillisecondTime mSilentFor = 0.0;
+			std::atomic<uint64_t> mIdleBlocks = 0;
+			std::atomic<uint64_t> mProcessedBlocks = 0;
+			std::atomic<uint64_t> mIdleTransitions = 0;
+
+			GuardedSlot<Capture> mCapture;
+			GuardedSlot<MidiFilePlayer> mMidiFilePlayer;
+			ParameterRamps mRamps;
+			//events script scheduled ahead, handed to the core a few blocks before they are due
+			EventScheduler mScheduler;
+
+			//optional fixed rate to run the core at, 0 follows the host, and oversampling around the core.
+			//Requested from script, the converters are built there for the host the audio thread last processed for.
+			std::atomic<int32_t> mInternalRate = 0;
+			std::atomic<int32_t> mOversampling = RNBO_UNITY_OVERSAMPLING;
+			GuardedSlot<RateConverter> mRateConverter;
+			GuardedSlot<Oversampler> mOversampler;
+			//set by the audio thread when the converters don't fit the host, script builds new ones
+			std::atomic<bool> mConverterMismatch = false;
+			//in frames at the host rate
+			std::atomic<size_t> mRateLatency = 0;
+			std::atomic<size_t> mOversamplingLatency = 0;
+			//the host as the audio thread last saw it, 0 until it is known, the most frames it processed at once
+			std::atomic<int32_t> mHostRate = 0;
+			std::atomic<int32_t> mInChannels = 2;
+			std::atomic<size_t> mHostFrames = 0;
+			//what the core was last prepared for, whichever way it runs
+			std::atomic<int32_t> mPreparedRate = 0;
+			std::atomic<size_t> mPreparedFrames = 0;
+			//converts the patch's latency, in samples at the rate the core runs at, to host frames
+			std::atomic<double> mCoreToHost = 1.0;
+
+			//optional delay after the output, so instances with less latency line up with ones that have more
+			GuardedSlot<DelayLine> mCompensation;
+			std::atomic<int32_t> mOutChannels = 2;
+			//set by the audio thread when the delay doesn't fit the channels it processes, script rebuilds it
+			std::atomic<bool> mCompensationMismatch = false;
+
+			//running status per MIDI input port for packed MIDI from script
+			std::mutex mMidiInMutex;
+			std::array<MidiStreamParser, 16> mMidiInParsers;
+
+			//samples from the sample cache attached by data ref id, and the ones that were replaced or released,
+			//which the core may still read until it has started a block after the change
+			std::mutex mSamplesMutex;
+			std::unordered_map<std::string, std::shared_ptr<const Sample>> mSamples;
+			std::vector<std::pair<uint64_t, std::shared_ptr<const Sample>>> mRetiredSamples;
+
+#if RNBO_UNITY_MULTI_PATCH == 1
+			InnerData(size_t patch = 0) : mCore(createPatcher(patch), &mEventHandler), mPatch(patch) {
+				mEventHandler.setParameterStaging(&mStaging);
+			}
+#elif RNBO_UNITY_HOT_RELOAD == 1
+			InnerData(size_t patch = 0) : mCore(new RNBO::CoreObject(createPatcher(patch), &mEventHandler)), mPatch(patch) {
+				mCoreSlot.swap(mCore);
+				mEventHandler.setParameterStaging(&mStaging);
+				std::lock_guard<std::mutex> guard(hotReloadMutex);
+				hotReloadInstances.push_back(this);
+			}
+#else
+			InnerData(size_t patch = 0) : mCore(&mEventHandler), mPatch(patch) {
+				mEventHandler.setParameterStaging(&mStaging);
+			}
+#endif
 			~InnerData() {
+#if RNBO_UNITY_HOT_RELOAD == 1
+				{
+					std::lock_guard<std::mutex> guard(hotReloadMutex);
+					hotReloadInstances.erase(std::remove(hotReloadInstances.begin(), hotReloadInstances.end(), this), hotReloadInstances.end());
+				}
+#endif
 				if (mTransportCallbackCurrent) {
-					callbackReleaseQueue.try_enqueue(mTransportCallbackCurrent);
+					callbackReleaseStack.push(mTransportCallbackCurrent);
 				}
-				auto transport = mTransportCallback.load();
-				if (transport) {
-					callbackReleaseQueue.try_enqueue(transport);
+				auto transport = mTransportCallback.exchange(nullptr);
+				if (transport && transport != clearedCallback()) {
+					callbackReleaseStack.push(transport);
 				}
+				delete mCapture.swap(nullptr);
+				delete mMidiFilePlayer.swap(nullptr);
+				delete mCompensation.swap(nullptr);
+				delete mRateConverter.swap(nullptr);
+				delete mOversampler.swap(nullptr);
+#if RNBO_UNITY_HOT_RELOAD == 1
+				delete mCoreSlot.swap(nullptr);
+#endif
 			}
 
-			void updateTimeAndTransport(RNBO::MillisecondTime now) {
-				mCore.setCurrentTime(now);
+			//runs func unless a reload is switching the core over, for the audio thread, which can't wait for that
+			template <typename F>
+			bool useCore(F func) {
+#if RNBO_UNITY_HOT_RELOAD == 1
+				bool ran = false;
+				mCoreSlot.with([&func, &ran](RNBO::CoreObject *) {
+						func();
+						ran = true;
+				});
+				return ran;
+#else
+				func();
+				return true;
+#endif
+			}
 
-				//sync to transport
-				//first, release any old transports
-				Callback * transport = mTransportCallback.load();
-				if (transport != mTransportCallbackCurrent) {
-					if (mTransportCallbackCurrent != nullptr) {
-						callbackReleaseQueue.try_enqueue(mTransportCallbackCurrent);
-					}
-					mTransportCallbackCurrent = transport;
+			//runs func, after a reload that is switching the core over is done, for everyone else
+			template <typename F>
+			void waitForCore(F func) {
+				while (!useCore(func)) {
+					std::this_thread::yield();
 				}
+			}
 
-				Callback * globalTransport = globalTransportCallback.load();
-				if (globalTransport != globalTransportCallbackCurrent) {
-					if (globalTransportCallbackCurrent != nullptr) {
-						callbackReleaseQueue.try_enqueue(globalTransportCallbackCurrent);
-					}
-					globalTransportCallbackCurrent = globalTransport;
+			void prepareCore(int32_t samplerate, size_t frames) {
+				mPreparedRate.store(samplerate, std::memory_order_relaxed);
+				mPreparedFrames.store(frames, std::memory_order_relaxed);
+				core().prepareToProcess(samplerate, frames);
+			}
+
+#if RNBO_UNITY_HOT_RELOAD == 1
+			//Watcher thread, moves the instance to a new core running the reloaded code, with the state of the old one.
+			//The new core is built and prepared here, the switch only closes the core for as long as it takes to swap
+			//pointers and resize the staging and snapshot, the audio thread outputs silence if it gets there meanwhile.
+			//Returns the old core, for the caller to free once nothing refers to it any longer.
+			std::unique_ptr<RNBO::CoreObject> reloadPatcher(RNBO::PatcherFactoryFunctionPtr factory) {
+				RNBO::UniquePresetPtr preset;
+				waitForCore([this, &preset]() {
+						auto state = core().getPresetSync();
+						if (state) {
+							preset = RNBO::convertJSONToPreset(RNBO::convertPresetToJSON(*state));
+						}
+				});
+
+				std::unique_ptr<RNBO::CoreObject> fresh(new RNBO::CoreObject(RNBO::UniquePtr<RNBO::PatcherInterface>(factory()), &mEventHandler));
+				int32_t rate = mPreparedRate.load(std::memory_order_relaxed);
+				size_t frames = mPreparedFrames.load(std::memory_order_relaxed);
+				if (rate > 0 && frames > 0) {
+					fresh->prepareToProcess(rate, frames, true);
+				}
+				if (preset) {
+					fresh->setPreset(std::move(preset));
 				}
 
-				if (transport == nullptr)
-					transport = globalTransport;
+				//nobody else uses the old core after this, or the staging and snapshot
+				std::unique_ptr<RNBO::CoreObject> old(mCoreSlot.swap(nullptr));
+				//the audio thread may have prepared the old core for another rate in the meantime
+				if (mPreparedRate.load(std::memory_order_relaxed) != rate || mPreparedFrames.load(std::memory_order_relaxed) != frames) {
+					rate = mPreparedRate.load(std::memory_order_relaxed);
+					frames = mPreparedFrames.load(std::memory_order_relaxed);
+					fresh->prepareToProcess(rate, frames, true);
+				}
+				//values staged for the old core still count
+				mStaging.flush(*fresh, 0.0);
+				mStaging.resize(fresh->getNumParameters());
+				mSnapshot.resize(fresh->getNumParameters());
+				mCore = fresh.get();
+				mCoreSlot.swap(fresh.release());
+				wake();
+				return old;
+			}
+#endif
 
-				if (transport != nullptr) {
-					RNBO::number bpm = 0.0, beatTime = 0.0;
-					int32_t timeSigNum = 4, timeSigDenom = 4;
+			void capture(const float * output, size_t frames, int32_t channels, int32_t samplerate) {
+				mCapture.with([=](Capture * capture) { capture->push(output, frames, channels, samplerate); });
+			}
 
-					uint8_t runningByte = 0;
-					transport->callback<CTransportRequestCallback>()(
-							transport->handle(),
-							now, &runningByte, &bpm, &beatTime, &timeSigNum, &timeSigDenom);
+			//schedule the MIDI file events that land in this block, following the transport
+			void streamMidiFile(RNBO::MillisecondTime now, size_t frames, int32_t samplerate) {
+				if (!mTransportRunning || mTransportBPM <= 0.0 || mTransportBeatTime < 0.0) {
+					return;
+				}
+				const RNBO::number beatsPerMs = mTransportBPM / 60000.0;
+				const RNBO::number start = mTransportBeatTime;
+				const RNBO::number end = start + beatsPerMs * 1000.0 * static_cast<RNBO::number>(frames) / static_cast<RNBO::number>(std::max(1, samplerate));
+				mMidiFilePlayer.with([this, now, start, end, beatsPerMs](MidiFilePlayer * player) {
+						player->advance(start, end, [this, now, start, beatsPerMs, player](const MidiFile::Event& e, double beat) {
+								RNBO::MidiEvent event(now + (beat - start) / beatsPerMs, player->port(), e.bytes, e.length);
+								core().scheduleEvent(event);
+						});
+				});
+			}
 
-					bool running = runningByte != 0;
-					if (running != mTransportRunning) {
-						mTransportRunning = running;
+			static RNBO::MillisecondTime blockEnd(RNBO::MillisecondTime now, size_t frames, int32_t samplerate) {
+				return now + 1000.0 * static_cast<RNBO::MillisecondTime>(frames) / static_cast<RNBO::MillisecondTime>(std::max(1, samplerate));
+			}
 
-						RNBO::TransportEvent event(now, running ? RNBO::TransportState::RUNNING : RNBO::TransportState::STOPPED);
-						mCore.scheduleEvent(event);
-					}
+			bool streamingMidiFile() {
+				bool streaming = false;
+				mMidiFilePlayer.with([&streaming](MidiFilePlayer * player) { streaming = !player->finished(); });
+				return streaming;
+			}
 
-					if (bpm != mTransportBPM) {
-						mTransportBPM = bpm;
+			//immediate changes are staged, scheduled ones go straight to the core
+			void setParameterValue(RNBO::ParameterIndex index, RNBO::ParameterValue value, RNBO::MillisecondTime attime = 0.0) {
+				if (attime > 0.0 || !mStaging.stage(index, value)) {
+					//an older staged value would otherwise be flushed after this one
+					mStaging.discard(index);
+					core().setParameterValue(index, value, attime);
+				}
+				wake(attime);
+			}
 
-						RNBO::TempoEvent event(now, bpm);
-						mCore.scheduleEvent(event);
-					}
+			//includes a staged value that hasn't reached the core yet
+			RNBO::ParameterValue getParameterValue(RNBO::ParameterIndex index) {
+				RNBO::ParameterValue value;
+				return mStaging.pending(index, value) ? value : core().getParameterValue(index);
+			}
 
-					if (beatTime != mTransportBeatTime) {
-						mTransportBeatTime = beatTime;
+			//blocks the audio thread has finished, processed or idle
+			uint64_t blocks() const {
+				return mProcessedBlocks.load(std::memory_order_acquire) + mIdleBlocks.load(std::memory_order_acquire);
+			}
 
-						RNBO::BeatTimeEvent event(now, beatTime);
-						mCore.scheduleEvent(event);
-					}
+			//script thread, after the data ref id was given new data or released
+			void attachSample(const std::string& id, std::shared_ptr<const Sample> sample) {
+				std::lock_guard<std::mutex> guard(mSamplesMutex);
+				//the block running now may still use the old data, the one after it can't
+				const uint64_t safe = blocks() + 2;
+				auto it = mSamples.find(id);
+				if (it != mSamples.end()) {
+					mRetiredSamples.emplace_back(safe, std::move(it->second));
+					mSamples.erase(it);
+				}
+				if (sample) {
+					mSamples.emplace(id, std::move(sample));
+				}
+				sweepSamples();
+			}
 
-					if (timeSigNum != mTransportTimeSigNum || timeSigDenom != mTransportTimeSigDenom) {
-						mTransportTimeSigNum = timeSigNum;
-						mTransportTimeSigDenom = timeSigDenom;
+			//frees the retired samples the core is done with, with mSamplesMutex held
+			void sweepSamples() {
+				const uint64_t done = blocks();
+				mRetiredSamples.erase(std::remove_if(mRetiredSamples.begin(), mRetiredSamples.end(), [done](const auto& r) { return r.first <= done; }), mRetiredSamples.end());
+			}
 
-						RNBO::TimeSignatureEvent event(now, timeSigNum, timeSigDenom);
-						mCore.scheduleEvent(event);
-					}
+			//call whenever script sends something to the instance, so an idle instance resumes processing
+			void wake(RNBO::MillisecondTime attime = 0.0) {
+				auto until = mPendingUntil.load(std::memory_order_relaxed);
+				while (attime > until && !mPendingUntil.compare_exchange_weak(until, attime, std::memory_order_relaxed)) {}
+				mWakePending.store(true, std::memory_order_release);
+			}
 
+			//the latency of the patch and of running it at another rate, in host frames, script thread
+			int32_t latency() {
+				const PatchLatency& patch = patchLatency(mPatch);
+				RNBO::number samples = patch.samples;
+				if (patch.parameter >= 0 && static_cast<RNBO::ParameterIndex>(patch.parameter) < core().getNumParameters()) {
+					samples = std::max(0.0, getParameterValue(static_cast<RNBO::ParameterIndex>(patch.parameter)));
 				}
+				const double frames = samples * mCoreToHost.load(std::memory_order_relaxed) + static_cast<double>(mRateLatency.load(std::memory_order_relaxed) + mOversamplingLatency.load(std::memory_order_relaxed));
+				return static_cast<int32_t>(std::lround(frames));
 			}
-	};
 
-	//TODO do align
-	struct EffectData {
-		union
-		{
-			InnerData inner;
-			//pad for ps3
-			unsigned char pad[(sizeof(RNBO::CoreObject) + 15) & ~15];
-		};
-		EffectData() : inner() { }
-		~EffectData() { }
-	};
+			//script thread, 0 removes the delay, keeps the current one if it is already that long for the channels last processed
+			void setCompensation(size_t frames) {
+				const int32_t channels = mOutChannels.load(std::memory_order_relaxed);
+				mCompensationMismatch.store(false, std::memory_order_relaxed);
+				bool same = false;
+				mCompensation.with([frames, channels, &same](DelayLine * d) { same = d->delay() == frames && d->channels() == channels; });
+				if (same)
+					return;
+				delete mCompensation.swap(frames > 0 ? new DelayLine(frames, channels) : nullptr);
+			}
 
-	std::vector<RNBO::ParameterIndex> param_index_map;
+			//script thread, rebuilds the delay for the channel count the audio thread found it didn't fit
+			void updateCompensation() {
+				if (mCompensationMismatch.load(std::memory_order_relaxed)) {
+					setCompensation(compensation());
+				}
+			}
 
-#if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
-	rw_mutex instances_mutex;
-	std::unordered_map<int32_t, InnerData *> instances;
-#endif
+			size_t compensation() {
+				size_t frames = 0;
+				mCompensation.with([&frames](DelayLine * d) { frames = d->delay(); });
+				return frames;
+			}
 
-	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK CreateCallback(UnityAudioEffectState* state) {
-		EffectData * effectdata = new EffectData();
-		state->effectdata = effectdata;
-		effectdata->inner.mCore.prepareToProcess(state->samplerate, state->dspbuffersize);
-		return UNITY_AUDIODSP_OK;
-	}
+			//process a block of interleaved audio at time now, then delay it by the compensation if there is one
+			void process(float * inbuffer, int32_t inchannels, float * outbuffer, int32_t outchannels, size_t frames, RNBO::MillisecondTime now, int32_t samplerate) {
+				mOutChannels.store(outchannels, std::memory_order_relaxed);
+				const bool processed = useCore([=]() { processUncompensated(inbuffer, inchannels, outbuffer, outchannels, frames, now, samplerate); });
+				if (!processed) {
+					std::memset(outbuffer, 0, frames * static_cast<size_t>(outchannels) * sizeof(float));
+				}
+				//a layout change leaves the output undelayed until script has rebuilt the line, the audio thread can't
+				mCompensation.with([this, outbuffer, outchannels, frames](DelayLine * d) {
+						if (!d->process(outbuffer, outchannels, frames)) {
+							mCompensationMismatch.store(true, std::memory_order_relaxed);
+						}
+				});
+			}
 
-	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK ReleaseCallback(UnityAudioEffectState* state) {
-		EffectData* effectdata = state->GetEffectData<EffectData>();
+			//bypassing the core while idle
+			void processUncompensated(float * inbuffer, int32_t inchannels, float * outbuffer, int32_t outchannels, size_t frames, RNBO::MillisecondTime now, int32_t samplerate) {
+				mHostRate.store(samplerate, std::memory_order_relaxed);
+				mInChannels.store(inchannels, std::memory_order_relaxed);
+				if (frames > mHostFrames.load(std::memory_order_relaxed)) {
+					mHostFrames.store(frames, std::memory_order_relaxed);
+				}
+				bool processed = false;
+				mRateConverter.use([&](RateConverter * converter) {
+						mOversampler.use([&](Oversampler * oversampler) {
+								//converters for another host or none where they are needed, the audio thread can't build them
+								if (!fits(converter, oversampler, inchannels, outchannels, frames, samplerate)) {
+									mConverterMismatch.store(true, std::memory_order_relaxed);
+									return;
+								}
+								configure(converter, oversampler, samplerate);
+								if (converter) {
+									const size_t coreFrames = converter->input(inbuffer, frames);
+									processBlock(inbuffer ? converter->coreInput() : nullptr, inchannels, converter->coreOutput(), outchannels, coreFrames, now, converter->coreRate(), oversampler);
+									converter->output(coreFrames, outbuffer, frames);
+								} else {
+									processBlock(inbuffer, inchannels, outbuffer, outchannels, frames, now, samplerate, oversampler);
+								}
+								processed = true;
+						});
+				});
+				if (!processed) {
+					std::memset(outbuffer, 0, frames * static_cast<size_t>(outchannels) * sizeof(float));
+				}
+			}
 
-#if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
-		{
-			auto key = effectdata->inner.mInstanceKey;
-			if (key != invalidKey) {
-				write_lock wlock(instances_mutex);
-				instances.erase(key);
+			bool converts(int32_t samplerate) const {
+				const int32_t rate = mInternalRate.load(std::memory_order_relaxed);
+				return rate > 0 && rate != samplerate;
 			}
-		}
-#endif
 
-		delete effectdata;
-		state->effectdata = nullptr;
+			//the most frames the core gets at once before oversampling
+			size_t outerFrames(const RateConverter * converter) const {
+				return converter ? converter->maxCoreFrames() : mHostFrames.load(std::memory_order_relaxed);
+			}
 
-		return UNITY_AUDIODSP_OK;
-	}
+			//whether the converters are what the internal rate and oversampling need for this block, nullptr for either that is off
+			bool fits(const RateConverter * converter, const Oversampler * oversampler, int32_t inchannels, int32_t outchannels, size_t frames, int32_t samplerate) const {
+				if (converts(samplerate)) {
+					if (converter == nullptr || !converter->matches(samplerate, mInternalRate.load(std::memory_order_relaxed), inchannels, outchannels, frames))
+						return false;
+				} else if (converter != nullptr) {
+					return false;
+				}
+				const int32_t factor = mOversampling.load(std::memory_order_relaxed);
+				if (factor <= 1)
+					return oversampler == nullptr;
+				return oversampler != nullptr && oversampler->matches(factor, inchannels, outchannels, outerFrames(converter));
+			}
 
-	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK ProcessCallback(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels) {
-		EffectData* effectdata = state->GetEffectData<EffectData>();
-		if (state->flags & (UnityAudioEffectStateFlags_IsMuted | UnityAudioEffectStateFlags_IsPaused) || (state->flags & UnityAudioEffectStateFlags_IsPlaying) == 0) {
-			memset(outbuffer, 0, length * outchannels * sizeof(float));
-			return UNITY_AUDIODSP_OK;
-		}
+			//Script thread, builds the converters for the internal rate, oversampling and the host last processed for,
+			//keeping the ones that already fit. Until the host is known there is nothing to build them for, then the audio
+			//thread outputs silence and flags the mismatch, and RNBOPoll builds them.
+			void buildConverters() {
+				mConverterMismatch.store(false, std::memory_order_relaxed);
+				const int32_t samplerate = mHostRate.load(std::memory_order_relaxed);
+				const int32_t inchannels = mInChannels.load(std::memory_order_relaxed);
+				const int32_t outchannels = mOutChannels.load(std::memory_order_relaxed);
+				const size_t frames = mHostFrames.load(std::memory_order_relaxed);
+				if (samplerate <= 0 || frames == 0) {
+					//nothing to build yet, but turning them off needs no host
+					if (mInternalRate.load(std::memory_order_relaxed) <= 0) {
+						delete mRateConverter.swap(nullptr);
+					}
+					if (mOversampling.load(std::memory_order_relaxed) <= 1) {
+						delete mOversampler.swap(nullptr);
+					}
+					return;
+				}
 
-		auto& inner = effectdata->inner;
+				const int32_t rate = mInternalRate.load(std::memory_order_relaxed);
+				const bool converting = converts(samplerate);
+				bool same = false;
+				mRateConverter.use([&](RateConverter * converter) {
+						same = converting ? converter != nullptr && converter->matches(samplerate, rate, inchannels, outchannels, frames) : converter == nullptr;
+				});
+				if (!same) {
+					delete mRateConverter.swap(converting ? new RateConverter(samplerate, rate, inchannels, outchannels, frames) : nullptr);
+				}
 
-		const RNBO::MillisecondTime stoms = 1000.0;
-		RNBO::MillisecondTime now = stoms * (static_cast<RNBO::MillisecondTime>(state->currdsptick) / static_cast<RNBO::MillisecondTime>(state->samplerate));
-		inner.updateTimeAndTransport(now);
+				//oversampling wraps the core, inside any rate conversion, so it is sized for what the converter hands the core
+				const int32_t factor = mOversampling.load(std::memory_order_relaxed);
+				size_t outer = 0;
+				mRateConverter.use([this, &outer](RateConverter * converter) { outer = outerFrames(converter); });
+				same = false;
+				mOversampler.use([&](Oversampler * oversampler) {
+						same = factor > 1 ? oversampler != nullptr && oversampler->matches(factor, inchannels, outchannels, outer) : oversampler == nullptr;
+				});
+				if (!same) {
+					delete mOversampler.swap(factor > 1 ? new Oversampler(factor, inchannels, outchannels, outer) : nullptr);
+				}
+			}
 
-		inner.mCore.process(inbuffer, inchannels, outbuffer, outchannels, length, nullptr, nullptr);
+			//script thread, rebuilds the converters the audio thread found didn't fit the host
+			void updateConverters() {
+				if (mConverterMismatch.load(std::memory_order_relaxed)) {
+					buildConverters();
+				}
+			}
 
-		return UNITY_AUDIODSP_OK;
-	}
+			//prepares the core again when the rate or frames it runs at change, and keeps the latencies they add up to date
+			void configure(const RateConverter * converter, const Oversampler * oversampler, int32_t samplerate) {
+				const int32_t outerRate = converter ? converter->coreRate() : samplerate;
+				const size_t frames = outerFrames(converter);
+				const int32_t oversampling = oversampler ? oversampler->factor() : 1;
+				const int32_t coreRate = outerRate * oversampling;
+				const size_t coreFrames = frames * static_cast<size_t>(oversampling);
+				//compared with what the core was last prepared for, which an offline render may have changed
+				if (coreRate != mPreparedRate.load(std::memory_order_relaxed) || coreFrames != mPreparedFrames.load(std::memory_order_relaxed)) {
+					prepareCore(coreRate, coreFrames);
+				}
+				mRateLatency.store(converter ? converter->latency() : 0, std::memory_order_relaxed);
+				const double outerLatency = oversampler ? static_cast<double>(oversampler->latency()) : 0.0;
+				mOversamplingLatency.store(static_cast<size_t>(std::ceil(outerLatency * samplerate / outerRate)), std::memory_order_relaxed);
+				mCoreToHost.store(static_cast<double>(samplerate) / static_cast<double>(coreRate), std::memory_order_relaxed);
+			}
+
+			//the core itself, oversampled if it is set up to be
+			void processCore(float * inbuffer, int32_t inchannels, float * outbuffer, int32_t outchannels, size_t frames, Oversampler * oversampler) {
+				if (oversampler) {
+					const size_t factor = static_cast<size_t>(oversampler->factor());
+					core().process(oversampler->up(inbuffer, frames), inchannels, oversampler->coreOutput(), outchannels, frames * factor, nullptr, nullptr);
+					oversampler->down(frames, outbuffer);
+					return;
+				}
+				core().process(inbuffer, inchannels, outbuffer, outchannels, frames, nullptr, nullptr);
+			}
+
+			void processBlock(float * inbuffer, int32_t inchannels, float * outbuffer, int32_t outchannels, size_t frames, RNBO::MillisecondTime now, int32_t samplerate, Oversampler * oversampler) {
+				if (!mIdleEnabled.load(std::memory_order_relaxed)) {
+					mIdle.store(false, std::memory_order_relaxed);
+					updateTimeAndTransport(now);
+					streamMidiFile(now, frames, samplerate);
+					//a restored snapshot first, values set after the restore were staged after it and win
+					mSnapshot.apply(core(), now);
+					mStaging.flush(core(), now);
+					mRamps.process(core(), now, blockEnd(now, frames, samplerate));
+					mScheduler.release(core(), now, blockEnd(now, frames, samplerate));
+					processCore(inbuffer, inchannels, outbuffer, outchannels, frames, oversampler);
+					mProcessedBlocks.fetch_add(1, std::memory_order_relaxed);
+					capture(outbuffer, frames, outchannels, samplerate);
+					return;
+				}
+
+				const float threshold = mIdleThreshold.load(std::memory_order_relaxed);
+				const bool woken = mWakePending.exchange(false, std::memory_order_acquire);
+				const bool pending = now < mPendingUntil.load(std::memory_order_relaxed) || streamingMidiFile() || mRamps.active();
+				const bool inputSilent = inbuffer == nullptr || peakAbs(inbuffer, frames * static_cast<size_t>(inchannels)) < threshold;
+				//read while idle too, a running transport drives sequencers and the like that make sound without input
+				TransportReading reading;
+				const bool transport = readTransport(now, reading);
+				const bool quiet = !woken && !pending && inputSilent && !(transport && reading.running);
+
+				if (mIdle.load(std::memory_order_relaxed)) {
+					if (quiet) {
+						//the transport and time are not updated either, so nothing piles up in the core's queue,
+						//they are brought up to date by the first processed block
+						std::memset(outbuffer, 0, frames * static_cast<size_t>(outchannels) * sizeof(float));
+						mIdleBlocks.fetch_add(1, std::memory_order_relaxed);
+						capture(outbuffer, frames, outchannels, samplerate);
+						return;
+					}
+					mIdle.store(false, std::memory_order_relaxed);
+					mSilentFor = 0.0;
+				}
+
+				updateTimeAndTransport(now, transport ? &reading : nullptr);
+				streamMidiFile(now, frames, samplerate);
+				mSnapshot.apply(core(), now);
+				mStaging.flush(core(), now);
+				mRamps.process(core(), now, blockEnd(now, frames, samplerate));
+				mScheduler.release(core(), now, blockEnd(now, frames, samplerate));
+				processCore(inbuffer, inchannels, outbuffer, outchannels, frames, oversampler);
+				mProcessedBlocks.fetch_add(1, std::memory_order_relaxed);
+
+				if (quiet && peakAbs(outbuffer, frames * static_cast<size_t>(outchannels)) < threshold) {
+					mSilentFor += 1000.0 * static_cast<RNBO::MillisecondTime>(frames) / static_cast<RNBO::MillisecondTime>(std::max(1, samplerate));
+					if (mSilentFor >= mIdleTailMs.load(std::memory_order_relaxed)) {
+						mIdle.store(true, std::memory_order_relaxed);
+						mIdleTransitions.fetch_add(1, std::memory_order_relaxed);
+					}
+				} else {
+					mSilentFor = 0.0;
+				}
+				capture(outbuffer, frames, outchannels, samplerate);
+			}
+
+			//the transport as the instance's callback, the shared native state or the global callback has it
+			struct TransportReading {
+				bool running = false;
+				RNBO::number bpm = 0.0;
+				RNBO::number beatTime = 0.0;
+				int32_t timeSigNum = 4;
+				int32_t timeSigDenom = 4;
+			};
+
+			void updateTimeAndTransport(RNBO::MillisecondTime now) {
+				TransportReading reading;
+				updateTimeAndTransport(now, readTransport(now, reading) ? &reading : nullptr);
+			}
+
+			void updateTimeAndTransport(RNBO::MillisecondTime now, const TransportReading * reading) {
+				core().setCurrentTime(now);
+				if (reading != nullptr) {
+					applyTransport(now, reading->running, reading->bpm, reading->beatTime, reading->timeSigNum, reading->timeSigDenom);
+				}
+			}
+
+			//reads the transport without passing it on to the core, false if nothing provides one
+			bool readTransport(RNBO::MillisecondTime now, TransportReading& reading) {
+				//first, take a new callback from script and release the one it replaces
+				Callback * replacement = mTransportCallback.exchange(nullptr);
+				if (replacement != nullptr) {
+					if (mTransportCallbackCurrent != nullptr) {
+						callbackReleaseStack.push(mTransportCallbackCurrent);
+					}
+					mTransportCallbackCurrent = replacement != clearedCallback() ? replacement : nullptr;
+				}
+				Callback * transport = mTransportCallbackCurrent;
+
+				//counted before loading, so a global callback replaced meanwhile isn't released while it is called
+				globalTransportReaders.fetch_add(1);
+				Callback * globalTransport = globalTransportCallback.load();
+
+				//the shared native state takes precedence over the global request callback
+				if (transport == nullptr && !globalTransportState.active())
+					transport = globalTransport;
+
+				bool read = false;
+				if (transport != nullptr) {
+					uint8_t runningByte = 0;
+					transport->callback<CTransportRequestCallback>()(
+							transport->handle(),
+							now, &runningByte, &reading.bpm, &reading.beatTime, &reading.timeSigNum, &reading.timeSigDenom);
+					reading.running = runningByte != 0;
+					read = true;
+				} else if (globalTransportState.active()) {
+					SharedTransportState::Snapshot state;
+					if (globalTransportState.read(state)) {
+						reading.running = state.running;
+						reading.bpm = state.bpm;
+						reading.beatTime = state.beatTimeAt(now);
+						reading.timeSigNum = state.timeSigNum;
+						reading.timeSigDenom = state.timeSigDenom;
+						read = true;
+					}
+				}
+				globalTransportReaders.fetch_sub(1);
+				return read;
+			}
+
+			//a call that got the instance by pointer, for as long as it is in scope the instance isn't freed.
+			//Check valid before touching it, a destroyed instance stays allocated for a while but must not be used.
+			struct Caller {
+				InnerData * inner;
+				const uint32_t slot;
+				Caller(InnerData * i) : inner(i), slot(instanceGrace.enter()) {}
+				~Caller() { instanceGrace.leave(slot); }
+				bool valid() const { return inner != nullptr && !inner->mDestroyed.load(std::memory_order_seq_cst); }
+			};
+
+			//script thread, a callback the audio thread hasn't taken yet is released right away
+			void setTransportCallback(Callback * callback) {
+				Callback * prev = mTransportCallback.exchange(callback != nullptr ? callback : clearedCallback());
+				if (prev != nullptr && prev != clearedCallback()) {
+					callbackReleaseStack.push(prev);
+				}
+			}
+
+			//only schedules events for values that changed since the last block
+			void applyTransport(RNBO::MillisecondTime now, bool running, RNBO::number bpm, RNBO::number beatTime, int32_t timeSigNum, int32_t timeSigDenom) {
+				if (running != mTransportRunning) {
+					mTransportRunning = running;
+
+					RNBO::TransportEvent event(now, running ? RNBO::TransportState::RUNNING : RNBO::TransportState::STOPPED);
+					core().scheduleEvent(event);
+				}
+
+				if (bpm != mTransportBPM) {
+					mTransportBPM = bpm;
+
+					RNBO::TempoEvent event(now, bpm);
+					core().scheduleEvent(event);
+				}
+
+				if (beatTime != mTransportBeatTime) {
+					mTransportBeatTime = beatTime;
+
+					RNBO::BeatTimeEvent event(now, beatTime);
+					core().scheduleEvent(event);
+				}
+
+				if (timeSigNum != mTransportTimeSigNum || timeSigDenom != mTransportTimeSigDenom) {
+					mTransportTimeSigNum = timeSigNum;
+					mTransportTimeSigDenom = timeSigDenom;
+
+					RNBO::TimeSignatureEvent event(now, timeSigNum, timeSigDenom);
+					core().scheduleEvent(event);
+				}
+			}
+	};
+
+	//TODO do align
+	struct EffectData {
+		union
+		{
+			InnerData inner;
+			//pad for ps3
+			unsigned char pad[(sizeof(RNBO::CoreObject) + 15) & ~15];
+		};
+		EffectData(size_t patch) : inner(patch) { }
+		~EffectData() { }
+	};
+
+#if RNBO_UNITY_SPECIALIZED == 1
+	constexpr auto& param_index_map = Specialization::paramIndexMap;
+	constexpr const auto& paramIndexMap(size_t) { return param_index_map; }
+#else
+	//one map per patch, filled in when its effect definition is registered
+	std::array<std::vector<RNBO::ParameterIndex>, numPatches> param_index_maps;
+	inline std::vector<RNBO::ParameterIndex>& paramIndexMap(size_t patch) { return param_index_maps[numPatches == 1 ? 0 : patch]; }
+#endif
+
+#if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
+	rw_mutex instances_mutex;
+	std::unordered_map<int32_t, InnerData *> instances;
+
+	//Issues the (negative) keys for instances created from script in O(1).
+	//A key encodes a slot and the slot's generation, the generation is bumped when the slot is recycled
+	//so a key that outlives its instance never aliases a newer instance.
+	//Not thread safe, only used with instances_mutex held for writing.
+	class ScriptKeyAllocator {
+		public:
+			static const uint32_t slotBits = 16;
+			static const uint32_t maxSlots = 1u << slotBits;
+			static const uint32_t generationMask = (1u << (31 - slotBits)) - 1;
+
+			//returns invalidKey if all the slots are in use
+			int32_t allocate() {
+				uint32_t slot;
+				if (!mFree.empty()) {
+					slot = mFree.back();
+					mFree.pop_back();
+				} else if (mGenerations.size() < maxSlots) {
+					slot = static_cast<uint32_t>(mGenerations.size());
+					mGenerations.push_back(0);
+				} else {
+					return invalidKey;
+				}
+				return encode(slot, mGenerations[slot]);
+			}
+
+			//whether key is one this issued and hasn't been released since
+			bool live(int32_t key) const {
+				uint32_t slot, generation;
+				return decode(key, slot, generation) && mGenerations[slot] == generation;
+			}
+
+			void release(int32_t key) {
+				uint32_t slot, generation;
+				if (decode(key, slot, generation) && mGenerations[slot] == generation) {
+					mGenerations[slot] = (generation + 1) & generationMask;
+					mFree.push_back(slot);
+				}
+			}
+
+		private:
+			static int32_t encode(uint32_t slot, uint32_t generation) {
+				return -static_cast<int32_t>((generation << slotBits) | slot) - 1;
+			}
+
+			bool decode(int32_t key, uint32_t& slot, uint32_t& generation) const {
+				if (key >= 0) {
+					return false;
+				}
+				const uint32_t v = static_cast<uint32_t>(-(static_cast<int64_t>(key) + 1));
+				slot = v & (maxSlots - 1);
+				generation = v >> slotBits;
+				return slot < mGenerations.size();
+			}
+
+			std::vector<uint32_t> mGenerations;
+			std::vector<uint32_t> mFree;
+	};
+	ScriptKeyAllocator scriptKeys;
+
+	//Connects instances created from script to each other natively, audio outputs to audio inputs and outports to inports.
+	//Script edits the graph, the audio thread processes every instance in it from one call, in dependency order,
+	//so routed audio and messages arrive in the same block. Instances that don't depend on each other are
+	//processed in parallel when the graph has worker threads. Instances in a graph must not be processed on their own.
+	class Graph {
+		public:
+			//stands for the graph's input or output in place of an instance key
+			static const int32_t io = invalidKey;
+			static constexpr int32_t maxThreads = 16;
+
+			//channels and maxBlockSize size the buffers up front, blocks that don't fit are processed in pieces that do
+			Graph(int32_t threads, int32_t channels, int32_t maxBlockSize) :
+				mMaxFrames(static_cast<size_t>(std::max(1, maxBlockSize))),
+				mInput(mMaxFrames * static_cast<size_t>(std::max(1, channels)), 0.0f)
+			{
+				for (int32_t i = 0; i < std::clamp(threads, 0, maxThreads); i++) {
+					mWorkers.emplace_back(&Graph::work, this);
+				}
+			}
+
+			~Graph() {
+				{
+					std::lock_guard<std::mutex> guard(mWorkMutex);
+					mRunning = false;
+				}
+				mWorkReady.notify_all();
+				for (auto& w: mWorkers) {
+					w.join();
+				}
+				delete mTopology.swap(nullptr);
+			}
+
+			//script thread, the edits return false if they aren't possible: unknown instances, or a cycle
+			bool add(InnerData * inner, int32_t inChannels, int32_t outChannels) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				if (inner == nullptr || find(inner->mInstanceKey) != nullptr)
+					return false;
+				auto member = std::make_unique<Member>();
+				member->inner = inner;
+				member->inChannels = std::max(0, inChannels);
+				member->outChannels = std::max(0, outChannels);
+				member->router.mGraph = this;
+				member->router.mSource = inner;
+				//trigger interfaces get the instance's outport messages on the audio thread, as they are sent
+				member->routerInterface = inner->core().createParameterInterface(RNBO::ParameterEventInterface::Trigger, &member->router);
+				mMembers.push_back(std::move(member));
+				return publish(mAudioEdges, mMessageEdges);
+			}
+
+#if RNBO_UNITY_HOT_RELOAD == 1
+			//watcher thread, after inner switched to a reloaded core, routes that core's outport messages again
+			void rebind(InnerData * inner) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				for (auto& member: mMembers) {
+					if (member->inner == inner) {
+						member->routerInterface = inner->core().createParameterInterface(RNBO::ParameterEventInterface::Trigger, &member->router);
+					}
+				}
+			}
+#endif
+
+			bool remove(InnerData * inner) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				auto it = std::find_if(mMembers.begin(), mMembers.end(), [inner](const std::unique_ptr<Member>& m) { return m->inner == inner; });
+				if (it == mMembers.end())
+					return false;
+				const int32_t key = inner->mInstanceKey;
+				mAudioEdges.erase(std::remove_if(mAudioEdges.begin(), mAudioEdges.end(), [key](const AudioEdge& e) { return e.from == key || e.to == key; }), mAudioEdges.end());
+				mMessageEdges.erase(std::remove_if(mMessageEdges.begin(), mMessageEdges.end(), [key](const MessageEdge& e) { return e.from == key || e.to == key; }), mMessageEdges.end());
+				//publish waits until the audio thread is done with the old order, after that nothing in the graph touches the instance
+				std::unique_ptr<Member> member = std::move(*it);
+				mMembers.erase(it);
+				publish(mAudioEdges, mMessageEdges);
+				return true;
+			}
+
+			bool connectAudio(int32_t from, int32_t to) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				if ((from == io && to == io) || (from != io && find(from) == nullptr) || (to != io && find(to) == nullptr))
+					return false;
+				AudioEdge edge = { from, to };
+				if (std::find(mAudioEdges.begin(), mAudioEdges.end(), edge) != mAudioEdges.end())
+					return true;
+				auto edges = mAudioEdges;
+				edges.push_back(edge);
+				if (!publish(edges, mMessageEdges))
+					return false;
+				mAudioEdges = std::move(edges);
+				return true;
+			}
+
+			bool disconnectAudio(int32_t from, int32_t to) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				AudioEdge edge = { from, to };
+				auto it = std::find(mAudioEdges.begin(), mAudioEdges.end(), edge);
+				if (it == mAudioEdges.end())
+					return false;
+				mAudioEdges.erase(it);
+				return publish(mAudioEdges, mMessageEdges);
+			}
+
+			bool connectMessage(int32_t from, RNBO::MessageTag outport, int32_t to, RNBO::MessageTag inport) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				if (find(from) == nullptr || find(to) == nullptr)
+					return false;
+				MessageEdge edge = { from, outport, to, inport };
+				if (std::find(mMessageEdges.begin(), mMessageEdges.end(), edge) != mMessageEdges.end())
+					return true;
+				auto edges = mMessageEdges;
+				edges.push_back(edge);
+				if (!publish(mAudioEdges, edges))
+					return false;
+				mMessageEdges = std::move(edges);
+				return true;
+			}
+
+			bool disconnectMessage(int32_t from, RNBO::MessageTag outport, int32_t to, RNBO::MessageTag inport) {
+				std::lock_guard<std::mutex> guard(mMutex);
+				MessageEdge edge = { from, outport, to, inport };
+				auto it = std::find(mMessageEdges.begin(), mMessageEdges.end(), edge);
+				if (it == mMessageEdges.end())
+					return false;
+				mMessageEdges.erase(it);
+				return publish(mAudioEdges, mMessageEdges);
+			}
+
+			//audio thread, buffer is the graph's interleaved input and is replaced with its output
+			void process(RNBO::MillisecondTime now, float * buffer, int32_t channels, int32_t nframes, int32_t samplerate) {
+				if (buffer == nullptr || channels <= 0 || nframes <= 0 || samplerate <= 0) {
+					return;
+				}
+				//buffers are sized by script, a longer block or more channels than expected are processed a piece at a time
+				const size_t piece = std::min(mMaxFrames, mInput.size() / static_cast<size_t>(channels));
+				if (piece == 0) {
+					std::memset(buffer, 0, static_cast<size_t>(channels) * static_cast<size_t>(nframes) * sizeof(float));
+					return;
+				}
+				for (size_t offset = 0; offset < static_cast<size_t>(nframes); offset += piece) {
+					const size_t frames = std::min(piece, static_cast<size_t>(nframes) - offset);
+					const RNBO::MillisecondTime at = now + 1000.0 * static_cast<RNBO::MillisecondTime>(offset) / static_cast<RNBO::MillisecondTime>(samplerate);
+					processBlock(at, buffer + offset * static_cast<size_t>(channels), channels, frames, samplerate);
+				}
+			}
+
+		private:
+			void processBlock(RNBO::MillisecondTime now, float * buffer, int32_t channels, size_t nframes, int32_t samplerate) {
+				const size_t samples = static_cast<size_t>(channels) * nframes;
+				std::memcpy(mInput.data(), buffer, samples * sizeof(float));
+				std::memset(buffer, 0, samples * sizeof(float));
+
+				mTopology.with([&](Topology * topology) {
+						mBlock = { now, nframes, samplerate, channels };
+						for (auto& level: topology->levels) {
+							level.next.store(0, std::memory_order_relaxed);
+							level.done.store(0, std::memory_order_relaxed);
+						}
+
+						const bool parallel = !mWorkers.empty() && topology->parallel;
+						mLevel.store(0, std::memory_order_relaxed);
+						mProcessing.store(topology, std::memory_order_seq_cst);
+						if (parallel) {
+							mEpoch.fetch_add(1, std::memory_order_release);
+							mWorkReady.notify_all();
+						}
+						for (size_t l = 0; l < topology->levels.size(); l++) {
+							auto& level = topology->levels[l];
+							mLevel.store(l, std::memory_order_release);
+							processLevel(*topology, level);
+							while (level.done.load(std::memory_order_acquire) < level.end - level.begin) {
+								std::this_thread::yield();
+							}
+						}
+						mLevel.store(topology->levels.size(), std::memory_order_release);
+						//workers may still be looking at the order, it can't go away before they are done with it
+						mProcessing.store(nullptr, std::memory_order_seq_cst);
+						while (mBusy.load(std::memory_order_seq_cst) != 0) {
+							std::this_thread::yield();
+						}
+
+						for (auto& node: topology->nodes) {
+							if (node->toOutput) {
+								mix(buffer, channels, node->output.data(), node->outChannels, mBlock.frames);
+							}
+						}
+				});
+			}
+
+			struct AudioEdge {
+				int32_t from;
+				int32_t to;
+				bool operator==(const AudioEdge& o) const { return from == o.from && to == o.to; }
+			};
+
+			struct MessageEdge {
+				int32_t from;
+				RNBO::MessageTag outport;
+				int32_t to;
+				RNBO::MessageTag inport;
+				bool operator==(const MessageEdge& o) const { return from == o.from && outport == o.outport && to == o.to && inport == o.inport; }
+			};
+
+			struct Node;
+
+			struct Route {
+				InnerData * from;
+				RNBO::MessageTag outport;
+				Node * to;
+				RNBO::MessageTag inport;
+			};
+
+			//hands a member's outport messages to the inports they are routed to, called while the member is processed
+			class Router : public RNBO::EventHandler {
+				public:
+					Graph * mGraph = nullptr;
+					InnerData * mSource = nullptr;
+
+					void eventsAvailable() override {}
+
+					void handleMessageEvent(const RNBO::MessageEvent& event) override {
+						//only while the graph processes, routes belong to the order being processed
+						Topology * topology = mGraph->mProcessing.load(std::memory_order_acquire);
+						if (topology == nullptr)
+							return;
+						for (auto& r: topology->routes) {
+							if (r.from == mSource && r.outport == event.getTag()) {
+								r.to->schedule(r.inport, event);
+							}
+						}
+					}
+			};
+
+			struct Member {
+				InnerData * inner = nullptr;
+				int32_t inChannels = 0;
+				int32_t outChannels = 0;
+				Router router;
+				RNBO::ParameterEventInterfaceUniquePtr routerInterface;
+			};
+
+			struct Node {
+				InnerData * inner = nullptr;
+				int32_t inChannels = 0;
+				int32_t outChannels = 0;
+				std::vector<Node *> sources;
+				bool fromInput = false;
+				bool toOutput = false;
+				std::vector<float> input;
+				std::vector<float> output;
+				//sources processed in parallel may route to the same node
+				std::atomic_flag scheduling = ATOMIC_FLAG_INIT;
+
+				//script thread, before the node is published
+				void prepare(size_t frames) {
+					input.assign(frames * static_cast<size_t>(inChannels), 0.0f);
+					output.assign(frames * static_cast<size_t>(outChannels), 0.0f);
+				}
+
+				void schedule(RNBO::MessageTag inport, const RNBO::MessageEvent& event) {
+					while (scheduling.test_and_set(std::memory_order_acquire)) {}
+					//dropped while the target's code is being reloaded
+					inner->useCore([this, inport, &event]() {
+							switch (event.getType()) {
+								case RNBO::MessageEvent::Type::Number:
+									inner->core().scheduleEvent(RNBO::MessageEvent(inport, event.getTime(), event.getNumValue()));
+									break;
+								case RNBO::MessageEvent::Type::List:
+									inner->core().scheduleEvent(RNBO::MessageEvent(inport, event.getTime(), event.getListValue()));
+									break;
+								case RNBO::MessageEvent::Type::Bang:
+									inner->core().scheduleEvent(RNBO::MessageEvent(inport, event.getTime()));
+									break;
+								default:
+									break;
+							}
+					});
+					scheduling.clear(std::memory_order_release);
+					inner->wake(event.getTime());
+				}
+			};
+
+			struct Level {
+				size_t begin = 0;
+				size_t end = 0;
+				std::atomic<size_t> next = 0;
+				std::atomic<size_t> done = 0;
+			};
+
+			//what the audio thread runs, built by script for every edit
+			struct Topology {
+				//in processing order, grouped into levels whose nodes don't depend on each other
+				std::vector<std::unique_ptr<Node>> nodes;
+				std::vector<Level> levels;
+				std::vector<Route> routes;
+				bool parallel = false;
+
+				explicit Topology(size_t numLevels) : levels(numLevels) {}
+			};
+
+			struct Block {
+				RNBO::MillisecondTime now;
+				size_t frames;
+				int32_t samplerate;
+				int32_t channels;
+			};
+
+			Member * find(int32_t key) {
+				for (auto& m: mMembers) {
+					if (m->inner->mInstanceKey == key)
+						return m.get();
+				}
+				return nullptr;
+			}
+
+			//orders the members for the given edges and hands the order to the audio thread, false if the edges have a cycle
+			bool publish(const std::vector<AudioEdge>& audio, const std::vector<MessageEdge>& messages) {
+				const size_t n = mMembers.size();
+				auto indexOf = [this](int32_t key) {
+					for (size_t i = 0; i < mMembers.size(); i++) {
+						if (mMembers[i]->inner->mInstanceKey == key)
+							return static_cast<int64_t>(i);
+					}
+					return static_cast<int64_t>(-1);
+				};
+
+				std::vector<std::vector<size_t>> dependents(n);
+				std::vector<size_t> dependencies(n, 0);
+				auto depend = [&](int32_t from, int32_t to) {
+					int64_t f = indexOf(from);
+					int64_t t = indexOf(to);
+					if (f >= 0 && t >= 0) {
+						dependents[static_cast<size_t>(f)].push_back(static_cast<size_t>(t));
+						dependencies[static_cast<size_t>(t)]++;
+					}
+				};
+				for (auto& e: audio) {
+					depend(e.from, e.to);
+				}
+				for (auto& e: messages) {
+					depend(e.from, e.to);
+				}
+
+				//topological order, a level at a time
+				std::vector<size_t> order;
+				std::vector<size_t> levelEnds;
+				std::vector<size_t> ready;
+				for (size_t i = 0; i < n; i++) {
+					if (dependencies[i] == 0)
+						ready.push_back(i);
+				}
+				while (!ready.empty()) {
+					std::vector<size_t> upcoming;
+					for (size_t i: ready) {
+						order.push_back(i);
+						for (size_t d: dependents[i]) {
+							if (--dependencies[d] == 0)
+								upcoming.push_back(d);
+						}
+					}
+					levelEnds.push_back(order.size());
+					ready.swap(upcoming);
+				}
+				if (order.size() != n)
+					return false;
+
+				auto topology = std::make_unique<Topology>(levelEnds.size());
+				std::vector<Node *> nodes(n, nullptr);
+				for (size_t i: order) {
+					auto node = std::make_unique<Node>();
+					node->inner = mMembers[i]->inner;
+					node->inChannels = mMembers[i]->inChannels;
+					node->outChannels = mMembers[i]->outChannels;
+					node->prepare(mMaxFrames);
+					nodes[i] = node.get();
+					topology->nodes.push_back(std::move(node));
+				}
+				size_t begin = 0;
+				for (size_t l = 0; l < levelEnds.size(); l++) {
+					topology->levels[l].begin = begin;
+					topology->levels[l].end = levelEnds[l];
+					topology->parallel = topology->parallel || levelEnds[l] - begin > 1;
+					begin = levelEnds[l];
+				}
+				for (auto& e: audio) {
+					if (e.from == io) {
+						nodes[static_cast<size_t>(indexOf(e.to))]->fromInput = true;
+					} else if (e.to == io) {
+						nodes[static_cast<size_t>(indexOf(e.from))]->toOutput = true;
+					} else {
+						nodes[static_cast<size_t>(indexOf(e.to))]->sources.push_back(nodes[static_cast<size_t>(indexOf(e.from))]);
+					}
+				}
+				for (auto& e: messages) {
+					topology->routes.push_back({ mMembers[static_cast<size_t>(indexOf(e.from))]->inner, e.outport, nodes[static_cast<size_t>(indexOf(e.to))], e.inport });
+				}
+
+				delete mTopology.swap(topology.release());
+				return true;
+			}
+
+			//sums src into dest, wrapping src's channels around if it has fewer
+			static void mix(float * dest, int32_t destChannels, const float * src, int32_t srcChannels, size_t frames) {
+				if (srcChannels <= 0 || destChannels <= 0)
+					return;
+				for (size_t f = 0; f < frames; f++) {
+					for (int32_t c = 0; c < destChannels; c++) {
+						dest[f * static_cast<size_t>(destChannels) + static_cast<size_t>(c)] += src[f * static_cast<size_t>(srcChannels) + static_cast<size_t>(c % srcChannels)];
+					}
+				}
+			}
+
+			void processNode(Node& node) {
+				const size_t frames = mBlock.frames;
+				//a single source with the same layout is read in place
+				float * in = node.input.data();
+				if (node.sources.size() == 1 && !node.fromInput && node.sources[0]->outChannels == node.inChannels) {
+					in = node.sources[0]->output.data();
+				} else if (node.sources.empty() && node.fromInput && mBlock.channels == node.inChannels) {
+					in = mInput.data();
+				} else {
+					std::fill(node.input.begin(), node.input.begin() + static_cast<std::ptrdiff_t>(frames * static_cast<size_t>(node.inChannels)), 0.0f);
+					if (node.fromInput) {
+						mix(in, node.inChannels, mInput.data(), mBlock.channels, frames);
+					}
+					for (auto s: node.sources) {
+						mix(in, node.inChannels, s->output.data(), s->outChannels, frames);
+					}
+				}
+				node.inner->process(in, node.inChannels, node.output.data(), node.outChannels, frames, mBlock.now, mBlock.samplerate);
+			}
+
+			//takes nodes of the level until there are none left, on the audio thread and the workers
+			void processLevel(Topology& topology, Level& level) {
+				for (size_t i = level.next.fetch_add(1, std::memory_order_relaxed); i < level.end - level.begin; i = level.next.fetch_add(1, std::memory_order_relaxed)) {
+					processNode(*topology.nodes[level.begin + i]);
+					level.done.fetch_add(1, std::memory_order_release);
+				}
+			}
+
+			void work() {
+				uint64_t seen = 0;
+				uint64_t applied = 0;
+				while (true) {
+					{
+						std::unique_lock<std::mutex> lock(mWorkMutex);
+						//the audio thread notifies without the lock, the timeout covers a missed notification
+						mWorkReady.wait_for(lock, std::chrono::milliseconds(10), [this, seen]() { return !mRunning || mEpoch.load(std::memory_order_acquire) != seen; });
+						if (!mRunning)
+							return;
+					}
+					seen = mEpoch.load(std::memory_order_acquire);
+					threadManager().checkIn(ThreadManager::Graph, applied);
+
+					mBusy.fetch_add(1, std::memory_order_seq_cst);
+					Topology * topology = mProcessing.load(std::memory_order_seq_cst);
+					if (topology != nullptr) {
+						//only the time spent processing counts against the budget, not waiting for the next level
+						double used = 0.0;
+						for (size_t l = mLevel.load(std::memory_order_acquire); l < topology->levels.size(); l = mLevel.load(std::memory_order_acquire)) {
+							auto& level = topology->levels[l];
+							const double start = ThreadManager::cpuTimeMs();
+							processLevel(*topology, level);
+							used += ThreadManager::cpuTimeMs() - start;
+							//wait for the audio thread to open the next level. yield only gives way to threads of the same
+							//priority, a real time worker sharing a core with the audio thread has to sleep for it to run.
+							for (int spins = 0; mLevel.load(std::memory_order_acquire) == l && mProcessing.load(std::memory_order_acquire) != nullptr; spins++) {
+								if (spins < 64) {
+									std::this_thread::yield();
+								} else {
+									std::this_thread::sleep_for(std::chrono::microseconds(20));
+								}
+							}
+						}
+						threadManager().record(ThreadManager::Graph, used);
+					}
+					mBusy.fetch_sub(1, std::memory_order_seq_cst);
+				}
+			}
+
+			//script thread
+			std::mutex mMutex;
+			std::vector<std::unique_ptr<Member>> mMembers;
+			std::vector<AudioEdge> mAudioEdges;
+			std::vector<MessageEdge> mMessageEdges;
+
+			//audio thread, sized by the constructor
+			GuardedSlot<Topology> mTopology;
+			const size_t mMaxFrames;
+			std::vector<float> mInput;
+			Block mBlock = { 0.0, 0, 0, 0 };
+
+			//the order being processed, so workers and routers can find it
+			std::atomic<Topology *> mProcessing = nullptr;
+			std::atomic<size_t> mLevel = 0;
+			std::atomic<int32_t> mBusy = 0;
+
+			std::vector<std::thread> mWorkers;
+			std::mutex mWorkMutex;
+			std::condition_variable mWorkReady;
+			bool mRunning = true;
+			std::atomic<uint64_t> mEpoch = 0;
+	};
+
+	//every graph, so instances can be taken out of them before they are destroyed
+	std::mutex graphsMutex;
+	std::vector<Graph *> graphs;
+#endif
+
+#if RNBO_UNITY_HOT_RELOAD == 1
+	PatchReloader& patchReloader() {
+		//outlives the reloader, whose watcher checks in with it until it is joined
+		threadManager();
+		static PatchReloader reloader(RNBO_UNITY_PATCH_LIBRARY, [](RNBO::PatcherFactoryFunctionPtr factory, uint64_t) {
+				std::lock_guard<std::mutex> guard(hotReloadMutex);
+				for (auto inner: hotReloadInstances) {
+					std::unique_ptr<RNBO::CoreObject> old = inner->reloadPatcher(factory);
+#if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
+					//the graphs' interfaces on the old core go before it does
+					std::lock_guard<std::mutex> graphsGuard(graphsMutex);
+					for (auto g: graphs) {
+						g->rebind(inner);
+					}
+#endif
+				}
+				for (auto pool: hotReloadPools) {
+					pool->reload(factory);
+				}
+		});
+		return reloader;
+	}
+#endif
+
+	template <size_t P>
+	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK CreateCallback(UnityAudioEffectState* state) {
+		startReclaimer();
+		EffectData * effectdata = new EffectData(P);
+		state->effectdata = effectdata;
+		InnerData& inner = effectdata->inner;
+		inner.waitForCore([&inner, state]() { inner.prepareCore(state->samplerate, state->dspbuffersize); });
+		//so the default oversampling, and an internal rate script sets before the first block, can be built right away
+		inner.mHostRate.store(static_cast<int32_t>(state->samplerate));
+		inner.mHostFrames.store(state->dspbuffersize);
+		inner.buildConverters();
+		return UNITY_AUDIODSP_OK;
+	}
+
+	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK ReleaseCallback(UnityAudioEffectState* state) {
+		EffectData* effectdata = state->GetEffectData<EffectData>();
+
+#if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
+		{
+			auto key = effectdata->inner.mInstanceKey;
+			if (key != invalidKey) {
+				write_lock wlock(instances_mutex);
+				instances.erase(key);
+			}
+		}
+#endif
+
+		delete effectdata;
+		state->effectdata = nullptr;
+
+		return UNITY_AUDIODSP_OK;
+	}
+
+	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK ProcessCallback(UnityAudioEffectState* state, float* inbuffer, float* outbuffer, unsigned int length, int inchannels, int outchannels) {
+		EffectData* effectdata = state->GetEffectData<EffectData>();
+		if (state->flags & (UnityAudioEffectStateFlags_IsMuted | UnityAudioEffectStateFlags_IsPaused) || (state->flags & UnityAudioEffectStateFlags_IsPlaying) == 0) {
+			memset(outbuffer, 0, length * outchannels * sizeof(float));
+			return UNITY_AUDIODSP_OK;
+		}
+
+		auto& inner = effectdata->inner;
+
+		const RNBO::MillisecondTime stoms = 1000.0;
+		RNBO::MillisecondTime now = stoms * (static_cast<RNBO::MillisecondTime>(state->currdsptick) / static_cast<RNBO::MillisecondTime>(state->samplerate));
+		inner.process(inbuffer, inchannels, outbuffer, outchannels, length, now, static_cast<int32_t>(state->samplerate));
+
+		return UNITY_AUDIODSP_OK;
+	}
 
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK SetFloatParameterCallback(UnityAudioEffectState* state, int index, float value) {
 		EffectData* effectdata = state->GetEffectData<EffectData>();
@@ -426,15 +2051,18 @@ namespace RNBOUnity
 		}
 #endif
 
+		const auto& param_index_map = paramIndexMap(effectdata->inner.mPatch);
 		if (index < 0 || index >= param_index_map.size())
 			return UNITY_AUDIODSP_ERR_UNSUPPORTED;
 		auto mapped = param_index_map[index];
-		effectdata->inner.mCore.setParameterValue(mapped, value);
+		InnerData& inner = effectdata->inner;
+		inner.waitForCore([&inner, mapped, value]() { inner.setParameterValue(mapped, value); });
 		return UNITY_AUDIODSP_OK;
 	}
 
 	UNITY_AUDIODSP_RESULT UNITY_AUDIODSP_CALLBACK GetFloatParameterCallback(UnityAudioEffectState* state, int index, float* value, char *valuestr) {
 		EffectData* effectdata = state->GetEffectData<EffectData>();
+		const auto& param_index_map = paramIndexMap(effectdata->inner.mPatch);
 		if (index < 0 || index >= param_index_map.size())
 			return UNITY_AUDIODSP_ERR_UNSUPPORTED;
 
@@ -450,8 +2078,9 @@ namespace RNBOUnity
 #endif
 
 		auto mapped = param_index_map[index];
+		InnerData& inner = effectdata->inner;
 		if (value != NULL)
-			*value = static_cast<float>(effectdata->inner.mCore.getParameterValue(mapped));
+			inner.waitForCore([&inner, mapped, value]() { *value = static_cast<float>(inner.getParameterValue(mapped)); });
 		return UNITY_AUDIODSP_OK;
 	}
 
@@ -459,8 +2088,15 @@ namespace RNBOUnity
 		return UNITY_AUDIODSP_ERR_UNSUPPORTED;
 	}
 
+	template <size_t P>
 	int InternalRegisterEffectDefinition(UnityAudioEffectDefinition& definition) {
+#if RNBO_UNITY_MULTI_PATCH == 1
+		RNBO::CoreObject core(createPatcher(P));
+#else
 		RNBO::CoreObject core;
+#endif
+		auto& param_index_map = paramIndexMap(P);
+#if RNBO_UNITY_SPECIALIZED != 1
 		if (param_index_map.size() == 0) {
 #if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
 			param_index_map.push_back(0); // the first index is always the instance index
@@ -474,6 +2110,7 @@ namespace RNBOUnity
 				param_index_map.push_back(i);
 			}
 		}
+#endif
 
 		definition.paramdefs = new UnityAudioParameterDefinition[param_index_map.size()];
 
@@ -497,71 +2134,314 @@ namespace RNBOUnity
 namespace {
 
 #if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
-	//RNBO calls release callback in the audio thread, so we queue an ID to tell the csharp side to release on Poll()
-	std::mutex datarefReleaseQueueMutex; //only for reading from it
-	moodycamel::ReaderWriterQueue<char *, 32> datarefReleaseQueue;
-
-	void DataRefRelease(RNBO::ExternalDataId, char* d) {
-		datarefReleaseQueue.try_enqueue(d);
-	}
-
 	bool with_instance(int32_t key, std::function<void(RNBOUnity::InnerData *)> func) {
 		read_lock rlock(RNBOUnity::instances_mutex);
 		auto it = RNBOUnity::instances.find(key);
 		if (it != RNBOUnity::instances.end()) {
-			func(it->second);
+			RNBOUnity::InnerData * inner = it->second;
+			inner->waitForCore([&func, inner]() { func(inner); });
 			return true;
 		}
 		return false;
 	}
+
+	bool schedule(int32_t key, RNBOUnity::EventScheduler::Event event) {
+		bool found = with_instance(key, [&event](RNBOUnity::InnerData * inner) {
+				const RNBO::MillisecondTime attime = event.time;
+				inner->mScheduler.schedule(inner->core(), event);
+				inner->wake(attime);
+		});
+		if (!found) {
+			delete event.list;
+		}
+		return found;
+	}
+
+	RNBOUnity::EventScheduler::Event scheduledEvent(RNBOUnity::EventScheduler::Type type, RNBO::MillisecondTime attime, int32_t group) {
+		RNBOUnity::EventScheduler::Event event;
+		event.type = type;
+		event.time = attime;
+		event.group = group;
+		return event;
+	}
 #endif
+
+	//destroyed instances and the epoch they were destroyed in
+	std::mutex retiredInstancesMutex;
+	std::vector<std::pair<uint64_t, RNBOUnity::InnerData *>> retiredInstances;
+
+	void reclaimInstances() {
+		std::vector<RNBOUnity::InnerData *> done;
+		{
+			std::lock_guard<std::mutex> guard(retiredInstancesMutex);
+			if (retiredInstances.empty())
+				return;
+			//as far as callers allow, when there are none, everything retired so far is freed by this call,
+			//which the last one when the plugin is unloaded relies on
+			for (int i = 0; i < 3; i++) {
+				RNBOUnity::instanceGrace.advance();
+			}
+			auto it = std::partition(retiredInstances.begin(), retiredInstances.end(), [](const std::pair<uint64_t, RNBOUnity::InnerData *>& r) { return !RNBOUnity::instanceGrace.elapsed(r.first); });
+			for (auto r = it; r != retiredInstances.end(); ++r) {
+				done.push_back(r->second);
+			}
+			retiredInstances.erase(it, retiredInstances.end());
+		}
+		//destructors join capture writers, outside of the lock
+		for (auto inner: done) {
+			delete inner;
+		}
+	}
 }
 
 //custom entrypoints
 
 #if RNBO_UNITY_INSTANCE_ACCESS_HACK == 1
 
-extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOInstanceCreate(int32_t* outkey)
+extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOInstanceCreatePatch(int32_t patch, int32_t* outkey)
 {
-	write_lock wlock(RNBOUnity::instances_mutex);
+	if (patch < 0 || static_cast<size_t>(patch) >= RNBOUnity::numPatches)
+		return nullptr;
 
-	//TODO, better key lookup
-	int32_t key = -1;
-	while (RNBOUnity::instances.count(key) != 0 && key < 0) {
-		key -= 1;
-	}
+	startReclaimer();
+
+	//construct outside of the lock, the core can take a while to set up
+	RNBOUnity::InnerData * i = new RNBOUnity::InnerData(static_cast<size_t>(patch));
+
+	write_lock wlock(RNBOUnity::instances_mutex);
 
-	//XXX ERROR
-	if (key >= 0) {
+	int32_t key = RNBOUnity::scriptKeys.allocate();
+	if (key == RNBOUnity::invalidKey) {
+		delete i;
 		return nullptr;
 	}
 
-	RNBOUnity::InnerData * i = new RNBOUnity::InnerData();
 	i->mInstanceKey = key;
 	RNBOUnity::instances.insert({ key, i });
 	*outkey = key;
 	return i;
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOInstanceDestroy(RNBOUnity::InnerData * inst)
+extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOInstanceCreate(int32_t* outkey)
 {
-	auto key = inst->mInstanceKey;
-
-	write_lock wlock(RNBOUnity::instances_mutex);
-	auto it = RNBOUnity::instances.find(key);
-	if (it == RNBOUnity::instances.end()) {
-		//ERROR
-	} else {
-		delete inst;
-		RNBOUnity::instances.erase(key);
-	}
+	return RNBOInstanceCreatePatch(0, outkey);
+}
+
+//Takes the key RNBOInstanceCreate gave out along with the pointer, so neither is dereferenced before they are known to
+//match: destroying again, or with a key that was released and handed out again, does nothing.
+//The instance is taken out of the map right away and freed by the reclaimer once every call that could have had its
+//pointer (RNBOProcess, renders) has returned, those that get there in the meantime see it is destroyed and return.
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOInstanceDestroy(RNBOUnity::InnerData * inst, int32_t key)
+{
+	if (inst == nullptr)
+		return;
+	{
+		write_lock wlock(RNBOUnity::instances_mutex);
+		//the key carries its slot's generation, a stale one doesn't match a live entry
+		if (!RNBOUnity::scriptKeys.live(key))
+			return;
+		auto it = RNBOUnity::instances.find(key);
+		if (it == RNBOUnity::instances.end() || it->second != inst) {
+			//ERROR
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> guard(RNBOUnity::graphsMutex);
+			for (auto g: RNBOUnity::graphs) {
+				g->remove(inst);
+			}
+		}
+		RNBOUnity::instances.erase(it);
+		RNBOUnity::scriptKeys.release(key);
+		inst->mDestroyed.store(true, std::memory_order_seq_cst);
+	}
+
+	std::lock_guard<std::mutex> guard(retiredInstancesMutex);
+	retiredInstances.emplace_back(RNBOUnity::instanceGrace.epoch(), inst);
 }
 
 extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOProcess(RNBOUnity::InnerData * inner, RNBO::MillisecondTime now, float * buffer, int32_t channels, int32_t nframes, int32_t samplerate)
 {
-	inner->mCore.prepareToProcess(samplerate, nframes);
-	inner->updateTimeAndTransport(now);
-	inner->mCore.process(buffer, channels, buffer, channels, nframes, nullptr, nullptr);
+	RNBOUnity::InnerData::Caller caller(inner);
+	if (!caller.valid()) {
+		if (buffer != nullptr && channels > 0 && nframes > 0) {
+			std::memset(buffer, 0, static_cast<size_t>(channels) * static_cast<size_t>(nframes) * sizeof(float));
+		}
+		return;
+	}
+	inner->process(buffer, channels, buffer, channels, static_cast<size_t>(nframes), now, samplerate);
+}
+
+namespace {
+	void scheduleRenderEvent(RNBOUnity::InnerData * inner, const RNBORenderJob& job, const RNBORenderEvent& e) {
+		auto& core = inner->core();
+		switch (e.type) {
+			case RNBORenderEventParameter:
+				core.setParameterValue(e.id, e.value, e.time);
+				break;
+			case RNBORenderEventParameterNormalized:
+				core.setParameterValueNormalized(e.id, e.value, e.time);
+				break;
+			case RNBORenderEventBang:
+				core.scheduleEvent(RNBO::MessageEvent(e.id, e.time));
+				break;
+			case RNBORenderEventNumber:
+				core.scheduleEvent(RNBO::MessageEvent(e.id, e.time, e.value));
+				break;
+			case RNBORenderEventList:
+				{
+					if (job.values == nullptr || static_cast<size_t>(e.offset) + e.length > job.numvalues) {
+						break;
+					}
+					auto l = std::make_unique<RNBO::list>();
+					for (uint32_t i = 0; i < e.length; i++) {
+						l->push(job.values[e.offset + i]);
+					}
+					core.scheduleEvent(RNBO::MessageEvent(e.id, e.time, std::move(l)));
+				}
+				break;
+			case RNBORenderEventMIDI:
+				if (job.bytes != nullptr && static_cast<size_t>(e.offset) + e.length <= job.numbytes) {
+					core.scheduleEvent(RNBO::MidiEvent(e.time, static_cast<int>(e.id), job.bytes + e.offset, e.length));
+				}
+				break;
+			case RNBORenderEventTransport:
+				core.scheduleEvent(RNBO::TransportEvent(e.time, e.value != 0.0 ? RNBO::TransportState::RUNNING : RNBO::TransportState::STOPPED));
+				break;
+			case RNBORenderEventTempo:
+				core.scheduleEvent(RNBO::TempoEvent(e.time, e.value));
+				break;
+			case RNBORenderEventBeatTime:
+				core.scheduleEvent(RNBO::BeatTimeEvent(e.time, e.value));
+				break;
+			case RNBORenderEventTimeSignature:
+				core.scheduleEvent(RNBO::TimeSignatureEvent(e.time, static_cast<int>(e.id), static_cast<int>(e.value)));
+				break;
+			default:
+				break;
+		}
+	}
+
+	void renderCore(RNBOUnity::InnerData * inner, const RNBORenderJob& job) {
+		const int64_t blocksize = job.blocksize > 0 ? job.blocksize : 1024;
+		inner->prepareCore(job.samplerate, static_cast<size_t>(blocksize));
+
+		//what script set and sent before the render reaches the core first, as a live block would hand it over,
+		//events held by the scheduling horizon keep their times, as they do with the horizon turned off
+		inner->mSnapshot.apply(inner->core(), 0.0);
+		inner->mStaging.flush(inner->core(), 0.0);
+		inner->mScheduler.releaseAll(inner->core());
+
+		//sort the events by time, stable so simultaneous events keep their order
+		std::vector<size_t> order(job.events != nullptr ? job.numevents : 0);
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&job](size_t a, size_t b) { return job.events[a].time < job.events[b].time; });
+
+		//stands in for the input where there isn't any, or for the block where it runs out
+		const int64_t inframes = job.input != nullptr ? std::max<int64_t>(0, job.inframes) : 0;
+		std::vector<float> padded;
+		if (inframes < job.nframes && job.inchannels > 0) {
+			padded.resize(static_cast<size_t>(blocksize * job.inchannels), 0.0f);
+		}
+		bool partial = false;
+
+		const RNBO::MillisecondTime mspersample = 1000.0 / static_cast<RNBO::MillisecondTime>(job.samplerate);
+		size_t nextEvent = 0;
+		for (int64_t frame = 0; frame < job.nframes; frame += blocksize) {
+			const int64_t n = std::min(blocksize, job.nframes - frame);
+			const RNBO::MillisecondTime now = static_cast<RNBO::MillisecondTime>(frame) * mspersample;
+			const RNBO::MillisecondTime end = static_cast<RNBO::MillisecondTime>(frame + n) * mspersample;
+
+			inner->core().setCurrentTime(now);
+
+			//only hand RNBO the events that land in this block, keeps its queue small
+			while (nextEvent < order.size() && job.events[order[nextEvent]].time < end) {
+				scheduleRenderEvent(inner, job, job.events[order[nextEvent]]);
+				nextEvent++;
+			}
+
+			const float * in = padded.data();
+			if (frame + n <= inframes) {
+				in = job.input + frame * job.inchannels;
+			} else if (frame < inframes) {
+				//the block the input ends in, the blocks after it need padded silent again
+				const size_t available = static_cast<size_t>((inframes - frame) * job.inchannels);
+				std::copy(job.input + frame * job.inchannels, job.input + frame * job.inchannels + available, padded.begin());
+				std::fill(padded.begin() + static_cast<std::ptrdiff_t>(available), padded.end(), 0.0f);
+				partial = true;
+			} else if (partial) {
+				std::fill(padded.begin(), padded.end(), 0.0f);
+				partial = false;
+			}
+			float * out = job.output + frame * job.outchannels;
+			inner->core().process(const_cast<float *>(in), job.inchannels, out, job.outchannels, static_cast<size_t>(n), nullptr, nullptr);
+		}
+	}
+
+	//renders the whole job on the calling thread
+	//time is derived from the frame count alone and the transport callbacks are not consulted,
+	//so rendering a freshly created instance with the same job produces the same output every time
+	bool renderJob(const RNBORenderJob& job) {
+		auto inner = reinterpret_cast<RNBOUnity::InnerData *>(job.instance);
+		if (inner == nullptr || job.output == nullptr || job.nframes < 0 || job.samplerate <= 0 || job.inchannels < 0 || job.outchannels < 0) {
+			return false;
+		}
+		RNBOUnity::InnerData::Caller caller(inner);
+		if (!caller.valid()) {
+			return false;
+		}
+		inner->waitForCore([inner, &job]() { renderCore(inner, job); });
+		return true;
+	}
+}
+
+//Render a job offline, as fast as possible, on the calling thread. The instance must not be processed elsewhere at the same time.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORender(const RNBORenderJob * job)
+{
+	return job != nullptr && renderJob(*job);
+}
+
+//Render several jobs, each on a single thread, spread over up to threads workers (0 uses all cores).
+//Every job needs its own instance. Returns the number of jobs that rendered successfully.
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBORenderBatch(const RNBORenderJob * jobs, int32_t count, int32_t threads)
+{
+	if (jobs == nullptr || count <= 0) {
+		return 0;
+	}
+
+	if (threads <= 0) {
+		threads = static_cast<int32_t>(std::max(1u, std::thread::hardware_concurrency()));
+	}
+	threads = std::min(threads, count);
+
+	std::atomic<int32_t> next = 0;
+	std::atomic<int32_t> rendered = 0;
+	//every job is a cycle of the offline role, the calling thread's too
+	auto worker = [&]() {
+		for (int32_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+			const double start = RNBOUnity::ThreadManager::cpuTimeMs();
+			if (renderJob(jobs[i])) {
+				rendered.fetch_add(1);
+			}
+			RNBOUnity::threadManager().record(RNBOUnity::ThreadManager::Offline, RNBOUnity::ThreadManager::cpuTimeMs() - start);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (int32_t i = 1; i < threads; i++) {
+		pool.emplace_back([&worker]() {
+				uint64_t applied = 0;
+				RNBOUnity::threadManager().checkIn(RNBOUnity::ThreadManager::Offline, applied);
+				worker();
+		});
+	}
+	worker();
+	for (auto& t: pool) {
+		t.join();
+	}
+	return rendered.load();
 }
 
 extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOInstanceMapped(int32_t key)
@@ -574,19 +2454,52 @@ extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOG
 	return RNBO::patcher_description.c_str();
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOGetPresets()
+//how many times the patch code has been reloaded, always 0 unless built with RNBO_UNITY_HOT_RELOAD
+extern "C" UNITY_AUDIODSP_EXPORT_API uint64_t AUDIO_CALLING_CONVENTION RNBOGetPatchGeneration()
 {
+#if RNBO_UNITY_HOT_RELOAD == 1
+	return RNBOUnity::patchReloader().generation();
+#else
+	return 0;
+#endif
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOGetPatchCount()
+{
+	return static_cast<int32_t>(RNBOUnity::numPatches);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOGetPatchName(int32_t patch)
+{
+	if (patch < 0 || static_cast<size_t>(patch) >= RNBOUnity::numPatches)
+		return nullptr;
+	return RNBOUnity::getPatch(static_cast<size_t>(patch)).name;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOGetPatchDescription(int32_t patch)
+{
+	if (patch < 0 || static_cast<size_t>(patch) >= RNBOUnity::numPatches)
+		return nullptr;
+	return RNBOUnity::getPatch(static_cast<size_t>(patch)).description;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOGetPatchPresets(int32_t patch)
+{
+	if (patch < 0 || static_cast<size_t>(patch) >= RNBOUnity::numPatches)
+		return nullptr;
+
 	static std::mutex localmutex;
-	static std::string presetsString;
+	static std::array<std::string, RNBOUnity::numPatches> presetsStrings;
 
 	std::lock_guard guard(localmutex);
+	std::string& presetsString = presetsStrings[static_cast<size_t>(patch)];
 
 	//since we can't easily parse arbitrary JSON in unity yet, we simply convert the preset payloads
 	//to strings
 	if (presetsString.empty()) {
 		nlohmann::json presets = nlohmann::json::array();
 		try {
-			nlohmann::json local = nlohmann::json::parse(RNBO::patcher_presets);
+			nlohmann::json local = nlohmann::json::parse(RNBOUnity::getPatch(static_cast<size_t>(patch)).presets);
 
 			if (local.is_array()) {
 				for (auto p: local) {
@@ -620,12 +2533,18 @@ extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOG
 	return presetsString.c_str();
 }
 
+extern "C" UNITY_AUDIODSP_EXPORT_API const char * AUDIO_CALLING_CONVENTION RNBOGetPresets()
+{
+	return RNBOGetPatchPresets(0);
+}
+
 extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOLoadPreset(int32_t key, const char * payload)
 {
 	return with_instance(key, [payload](RNBOUnity::InnerData* inner) {
 			try {
 				auto preset = RNBO::convertJSONToPreset(std::string(payload));
-				inner->mCore.setPreset(std::move(preset));
+				inner->core().setPreset(std::move(preset));
+				inner->wake();
 			} catch (std::exception& e) {
 				std::cerr << "error converting preset payload to RNBO preset " << e.what() << std::endl;
 			}
@@ -638,227 +2557,807 @@ extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetPreset
 		return false;
 	}
 
-	*payload = nullptr;
+	*payload = nullptr;
+
+	return with_instance(key, [payload](RNBOUnity::InnerData * inner) {
+			try {
+				auto preset = inner->core().getPresetSync();
+				std::string s = RNBO::convertPresetToJSON(*preset);
+				*payload = new char[s.size() + 1];
+				std::strcpy(*payload, s.c_str());
+			} catch (std::exception& e) {
+				std::cerr << "error capturing preset " << e.what() << std::endl;
+			}
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetPreset(int32_t key)
+{
+	return with_instance(key, [](RNBOUnity::InnerData * inner) {
+			inner->core().getPreset([inner](std::shared_ptr<const RNBO::Preset> p) {
+					inner->mEventHandler.handlePreset(p);
+			});
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOFreePreset(char * payload)
+{
+	if (payload) {
+		delete [] payload;
+	}
+}
+
+//Binary snapshots of every parameter value, see RNBOSnapshot.h for the layout.
+//The buffers are the caller's, full is the size of a full snapshot, maxDelta the largest a delta can be.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetSnapshotSize(int32_t key, size_t * full, size_t * maxDelta)
+{
+	return with_instance(key, [full, maxDelta](RNBOUnity::InnerData * inner) {
+			const size_t parameters = inner->core().getNumParameters();
+			if (full) {
+				*full = RNBOUnity::SnapshotHeader::fullSize(parameters);
+			}
+			if (maxDelta) {
+				*maxDelta = RNBOUnity::SnapshotHeader::maxDeltaSize(parameters);
+			}
+	});
+}
+
+//Includes parameter changes script has made that haven't reached the core yet.
+//Returns false, with written set to 0, if there is no such instance or buffer is too small.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOCaptureSnapshot(int32_t key, uint8_t * buffer, size_t capacity, size_t * written)
+{
+	size_t size = 0;
+	with_instance(key, [buffer, capacity, &size](RNBOUnity::InnerData * inner) {
+			size = RNBOUnity::captureSnapshot(static_cast<uint32_t>(inner->mPatch), inner->core().getNumParameters(), [inner](size_t i) {
+					return inner->getParameterValue(static_cast<RNBO::ParameterIndex>(i));
+			}, buffer, capacity);
+	});
+	if (written) {
+		*written = size;
+	}
+	return size > 0;
+}
+
+//Only the values that changed since the full snapshot base was captured.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOCaptureSnapshotDelta(int32_t key, const uint8_t * base, size_t baselen, uint8_t * buffer, size_t capacity, size_t * written)
+{
+	size_t size = 0;
+	with_instance(key, [base, baselen, buffer, capacity, &size](RNBOUnity::InnerData * inner) {
+			size = RNBOUnity::captureSnapshotDelta(static_cast<uint32_t>(inner->mPatch), inner->core().getNumParameters(), [inner](size_t i) {
+					return inner->getParameterValue(static_cast<RNBO::ParameterIndex>(i));
+			}, base, baselen, buffer, capacity);
+	});
+	if (written) {
+		*written = size;
+	}
+	return size > 0;
+}
+
+//Full snapshots or deltas, applied together at the start of the next block.
+//A delta sets only the values it holds, so restore the full snapshot it was taken against first, they are merged if
+//both are restored before a block. Returns false if there is no such instance or data isn't a snapshot of its patch.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORestoreSnapshot(int32_t key, const uint8_t * data, size_t len)
+{
+	bool restored = false;
+	with_instance(key, [data, len, &restored](RNBOUnity::InnerData * inner) {
+			//the restored values replace whatever was staged or ramping towards them before, queued ahead of the
+			//restore so ramps started after it still run. A full snapshot stops every ramp with one command.
+			RNBOUnity::SnapshotHeader header;
+			const bool full = RNBOUnity::SnapshotHeader::read(data, len, static_cast<uint32_t>(inner->mPatch), inner->mSnapshot.parameters(), header)
+				&& header.mKind == RNBOUnity::SnapshotHeader::Full;
+			if (full) {
+				inner->mRamps.cancelAll();
+			}
+			restored = inner->mSnapshot.restore(static_cast<uint32_t>(inner->mPatch), data, len, [inner, full](RNBO::ParameterIndex index) {
+					inner->mStaging.discard(index);
+					if (!full) {
+						inner->mRamps.cancel(index);
+					}
+			});
+			if (restored) {
+				inner->wake();
+			}
+	});
+	return restored;
+}
+
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOPoll(int32_t key)
+{
+	//the reclaimer does this too, doing it here as well keeps memory use down when script polls often
+	reclaim();
+
+	return with_instance(key, [](RNBOUnity::InnerData * inner) {
+			inner->mEventHandler.poll();
+			inner->updateCompensation();
+			inner->updateConverters();
+			std::lock_guard<std::mutex> guard(inner->mSamplesMutex);
+			inner->sweepSamples();
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOReleaseHandles()
+{
+	reclaim();
+
+	void * handle = nullptr;
+	std::lock_guard<std::mutex> guard(releasedHandlesMutex);
+	if (!releasedHandles.empty()) {
+		handle = releasedHandles.back();
+		releasedHandles.pop_back();
+	}
+	return handle;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API RNBO::MessageTag AUDIO_CALLING_CONVENTION RNBOTag(const char * tagChar)
+{
+	return RNBO::TAG(tagChar);
+}
+
+//The port tags of every patch in this library, see TagTable::blob for the layout.
+//The data lives as long as the library does, script can read it once and resolve tags itself.
+extern "C" UNITY_AUDIODSP_EXPORT_API const uint8_t * AUDIO_CALLING_CONVENTION RNBOGetTagTable(size_t * size)
+{
+	const auto& blob = RNBOUnity::tagTable().blob();
+	if (size) {
+		*size = blob.size();
+	}
+	return blob.data();
+}
+
+//port tags are resolved from the tag table without touching the instance, so that succeeds for any key
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOResolveTag(int32_t key, RNBO::MessageTag tag, const char** tagChar)
+{
+	const char * interned = RNBOUnity::tagTable().resolve(tag);
+	if (interned != nullptr) {
+		if (tagChar) {
+			*tagChar = interned;
+		}
+		return true;
+	}
+	return with_instance(key, [tag, tagChar](RNBOUnity::InnerData * inner) {
+			if (tagChar) {
+				*tagChar = inner->core().resolveTag(tag);
+			}
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetParamValue(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue value, RNBO::MillisecondTime attime)
+{
+	return with_instance(key, [index, value, attime](RNBOUnity::InnerData * inner) {
+			inner->setParameterValue(index, value, attime);
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetParamValue(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue * valueOut)
+{
+	return with_instance(key, [index, valueOut](RNBOUnity::InnerData * inner) {
+			if (valueOut != nullptr) {
+				*valueOut = inner->getParameterValue(index);
+			}
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetParamValueNormalized(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue value, RNBO::MillisecondTime attime)
+{
+	return with_instance(key, [index, value, attime](RNBOUnity::InnerData * inner) {
+			inner->setParameterValue(index, inner->core().convertFromNormalizedParameterValue(index, value), attime);
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetParamValueNormalized(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue * valueOut)
+{
+	return with_instance(key, [index, valueOut](RNBOUnity::InnerData * inner) {
+			if (valueOut != nullptr) {
+				*valueOut = inner->core().convertToNormalizedParameterValue(index, inner->getParameterValue(index));
+			}
+	});
+}
+
+//ramps are interpolated natively at the instance's control rate, see docs/PARAMETERS.md
+//these return false if there is no such instance, or the ramp queue is full
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORampParamValue(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue target, RNBO::MillisecondTime duration, int32_t curve, RNBO::MillisecondTime attime)
+{
+	bool queued = false;
+	return with_instance(key, [index, target, duration, curve, attime, &queued](RNBOUnity::InnerData * inner) {
+			queued = inner->mRamps.ramp(index, target, duration, curve, attime);
+			inner->wake(attime + std::max(0.0, duration));
+	}) && queued;
+}
+
+//points are numpoints (value, duration) pairs
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORampParamEnvelope(int32_t key, RNBO::ParameterIndex index, const RNBO::number * points, size_t numpoints, int32_t curve, RNBO::MillisecondTime attime)
+{
+	bool queued = false;
+	return with_instance(key, [index, points, numpoints, curve, attime, &queued](RNBOUnity::InnerData * inner) {
+			queued = inner->mRamps.envelope(index, points, numpoints, curve, attime);
+			RNBO::MillisecondTime end = attime;
+			for (size_t i = 0; points != nullptr && i < numpoints; i++) {
+				end += std::max(0.0, points[2 * i + 1]);
+			}
+			inner->wake(end);
+	}) && queued;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOCancelParamRamp(int32_t key, RNBO::ParameterIndex index)
+{
+	bool queued = false;
+	return with_instance(key, [index, &queued](RNBOUnity::InnerData * inner) {
+			queued = inner->mRamps.cancel(index);
+			inner->wake();
+	}) && queued;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetParamRampRate(int32_t key, RNBO::number hz)
+{
+	return with_instance(key, [hz](RNBOUnity::InnerData * inner) {
+			inner->mRamps.setControlRate(hz);
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetParamRampsDropped(int32_t key, uint64_t * dropped)
+{
+	return with_instance(key, [dropped](RNBOUnity::InnerData * inner) {
+			if (dropped) {
+				*dropped = inner->mRamps.dropped();
+			}
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOScheduleMessageNumber(int32_t key, RNBO::MessageTag tag, RNBO::number v, RNBO::MillisecondTime attime, int32_t group)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::Number, attime, group);
+	event.tag = tag;
+	event.value = v;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOScheduleMessageBang(int32_t key, RNBO::MessageTag tag, RNBO::MillisecondTime attime, int32_t group)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::Bang, attime, group);
+	event.tag = tag;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOScheduleMessageList(int32_t key, RNBO::MessageTag tag, const RNBO::number* buffer, size_t bufferlen, RNBO::MillisecondTime attime, int32_t group)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::List, attime, group);
+	event.tag = tag;
+	event.list = new RNBO::list();
+	for (auto i = 0; i < bufferlen; i++) {
+		event.list->push(buffer[i]);
+	}
+	return schedule(key, event);
+}
+
+//Messages longer than 3 bytes aren't held, they go to the core right away
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOScheduleMIDI(int32_t key, const uint8_t* bytes, int len, RNBO::MillisecondTime attime, int32_t group)
+{
+	if (bytes == nullptr || len <= 0 || len > 3) {
+		return with_instance(key, [bytes, len, attime](RNBOUnity::InnerData * inner) {
+				RNBO::MidiEvent event(attime, 0, bytes, len);
+				inner->core().scheduleEvent(event);
+				inner->wake(attime);
+		});
+	}
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::Midi, attime, group);
+	std::memcpy(event.midi, bytes, static_cast<size_t>(len));
+	event.extra = len;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMessageNumber(int32_t key, RNBO::MessageTag tag, RNBO::number v, RNBO::MillisecondTime attime)
+{
+	return RNBOScheduleMessageNumber(key, tag, v, attime, 0);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMessageBang(int32_t key, RNBO::MessageTag tag, RNBO::MillisecondTime attime)
+{
+	return RNBOScheduleMessageBang(key, tag, attime, 0);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMessageList(int32_t key, RNBO::MessageTag tag, const RNBO::number* buffer, size_t bufferlen, RNBO::MillisecondTime attime)
+{
+	return RNBOScheduleMessageList(key, tag, buffer, bufferlen, attime, 0);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMIDI(int32_t key, const uint8_t* bytes, int len, RNBO::MillisecondTime attime)
+{
+	return RNBOScheduleMIDI(key, bytes, len, attime, 0);
+}
+
+//Drop scheduled events that haven't been handed to the core yet, messages to tag or everything in group, returns how many, -1 if there is no such instance
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOCancelScheduledTag(int32_t key, RNBO::MessageTag tag)
+{
+	int32_t cancelled = -1;
+	with_instance(key, [tag, &cancelled](RNBOUnity::InnerData * inner) {
+			cancelled = static_cast<int32_t>(inner->mScheduler.cancelTag(tag));
+	});
+	return cancelled;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOCancelScheduledGroup(int32_t key, int32_t group)
+{
+	int32_t cancelled = -1;
+	with_instance(key, [group, &cancelled](RNBOUnity::InnerData * inner) {
+			cancelled = static_cast<int32_t>(inner->mScheduler.cancelGroup(group));
+	});
+	return cancelled;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOCancelScheduled(int32_t key)
+{
+	int32_t cancelled = -1;
+	with_instance(key, [&cancelled](RNBOUnity::InnerData * inner) {
+			cancelled = static_cast<int32_t>(inner->mScheduler.cancelAll());
+	});
+	return cancelled;
+}
+
+//How many blocks ahead scheduled events are handed to the core, 0 hands them over as soon as they are sent
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetSchedulingHorizon(int32_t key, int32_t blocks)
+{
+	return with_instance(key, [blocks](RNBOUnity::InnerData * inner) {
+			inner->mScheduler.setHorizon(blocks);
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetSchedulingHorizon(int32_t key, int32_t * blocks, int32_t * pending)
+{
+	return with_instance(key, [blocks, pending](RNBOUnity::InnerData * inner) {
+			if (blocks) {
+				*blocks = inner->mScheduler.horizon();
+			}
+			if (pending) {
+				*pending = static_cast<int32_t>(inner->mScheduler.pending());
+			}
+	});
+}
+
+//Schedule many MIDI messages at once. The buffer is a sequence of records:
+//	float64 time (ms, little endian), uint8 port, uint16 length (little endian), length bytes of MIDI
+//The MIDI bytes of a record may hold several messages and may use running status, which carries over between records and calls per port.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMIDIPacked(int32_t key, const uint8_t * buffer, size_t len, int32_t * scheduled)
+{
+	if (scheduled) {
+		*scheduled = 0;
+	}
+	return with_instance(key, [buffer, len, scheduled](RNBOUnity::InnerData * inner) {
+			const size_t headerSize = sizeof(double) + 1 + 2;
+			int32_t count = 0;
+			RNBO::MillisecondTime latest = 0.0;
+
+			std::lock_guard<std::mutex> guard(inner->mMidiInMutex);
+			size_t pos = 0;
+			while (buffer != nullptr && pos + headerSize <= len) {
+				double attime;
+				std::memcpy(&attime, buffer + pos, sizeof(double));
+				const uint8_t port = buffer[pos + sizeof(double)];
+				const size_t length = static_cast<size_t>(buffer[pos + sizeof(double) + 1]) | (static_cast<size_t>(buffer[pos + sizeof(double) + 2]) << 8);
+				pos += headerSize;
+				if (pos + length > len) {
+					break;
+				}
+
+				if (port < inner->mMidiInParsers.size()) {
+					inner->mMidiInParsers[port].parse(buffer + pos, length, [inner, attime, port, &count](const uint8_t * bytes, size_t n) {
+							if (n <= 3) {
+								auto event = scheduledEvent(RNBOUnity::EventScheduler::Midi, attime, 0);
+								event.tag = port;
+								std::memcpy(event.midi, bytes, n);
+								event.extra = static_cast<int32_t>(n);
+								inner->mScheduler.schedule(inner->core(), event);
+							} else {
+								RNBO::MidiEvent event(attime, port, bytes, n);
+								inner->core().scheduleEvent(event);
+							}
+							count++;
+					});
+					latest = std::max(latest, attime);
+				}
+				pos += length;
+			}
+
+			if (count > 0) {
+				inner->wake(latest);
+			}
+			if (scheduled) {
+				*scheduled = count;
+			}
+	});
+}
+
+//Play a Standard MIDI File (format 0 or 1) against the instance's transport, replacing any file already playing
+//startBeat is the transport beat that lines up with the start of the file, negative starts right away
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOLoadMIDIFile(int32_t key, const uint8_t * data, size_t len, RNBO::number startBeat, int32_t port)
+{
+	RNBOUnity::MidiFile * file = RNBOUnity::MidiFile::parse(data, len);
+	if (file == nullptr) {
+		return false;
+	}
+
+	auto player = new RNBOUnity::MidiFilePlayer(file, startBeat, port);
+	RNBOUnity::MidiFilePlayer * prev = nullptr;
+	bool found = with_instance(key, [player, &prev](RNBOUnity::InnerData * inner) {
+			prev = inner->mMidiFilePlayer.swap(player);
+			inner->wake();
+	});
+	if (!found) {
+		delete player;
+	}
+	delete prev;
+	return found;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOStopMIDIFile(int32_t key)
+{
+	RNBOUnity::MidiFilePlayer * prev = nullptr;
+	bool found = with_instance(key, [&prev](RNBOUnity::InnerData * inner) {
+			prev = inner->mMidiFilePlayer.swap(nullptr);
+	});
+	delete prev;
+	return found;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendTransportEvent(int32_t key, bool running, RNBO::MillisecondTime attime)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::Transport, attime, 0);
+	event.value = running ? 1.0 : 0.0;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendTempoEvent(int32_t key, RNBO::number bpm, RNBO::MillisecondTime attime)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::Tempo, attime, 0);
+	event.value = bpm;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendBeatTimeEvent(int32_t key, RNBO::number beattime, RNBO::MillisecondTime attime)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::BeatTime, attime, 0);
+	event.value = beattime;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendTimeSignatureEvent(int32_t key, int32_t numerator, int32_t denominator, RNBO::MillisecondTime attime)
+{
+	auto event = scheduledEvent(RNBOUnity::EventScheduler::TimeSignature, attime, 0);
+	event.value = numerator;
+	event.extra = denominator;
+	return schedule(key, event);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOCopyLoadDataRef(int32_t key, const char * id, const float * data, size_t datalen, size_t channels, size_t samplerate)
+{
+	return with_instance(key, [id, data, datalen, channels, samplerate](RNBOUnity::InnerData * inner) {
+			RNBO::Float32AudioBuffer bufferType(channels, static_cast<double>(samplerate));
+
+			//we need to create our own copy as RNBO might write into the data AND it also might realloc
+			size_t bytes = sizeof(float) * datalen;
+			char * d = RNBOUnity::DataRef::allocate(bytes);
+			std::memcpy(d, data, bytes);
+			inner->core().setExternalData(id, d, bytes, bufferType, DataRefRelease);
+			inner->attachSample(id, nullptr);
+			inner->wake();
+	});
+}
+
+// here we simply send over the pointer to the data, since RNBO buffers are read/write, you have to be sure that your code doesn't try to write or resize
+// TODO can we indicate a real release?
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOUnsafeLoadReadOnlyDataRef(int32_t key, const char * id, const float * data, size_t datalen, size_t channels, size_t samplerate)
+{
+	return with_instance(key, [id, data, datalen, channels, samplerate](RNBOUnity::InnerData * inner) {
+			RNBO::Float32AudioBuffer bufferType(channels, static_cast<double>(samplerate));
 
-	return with_instance(key, [payload](RNBOUnity::InnerData * inner) {
-			try {
-				auto preset = inner->mCore.getPresetSync();
-				std::string s = RNBO::convertPresetToJSON(*preset);
-				*payload = new char[s.size() + 1];
-				std::strcpy(*payload, s.c_str());
-			} catch (std::exception& e) {
-				std::cerr << "error capturing preset " << e.what() << std::endl;
-			}
+			size_t bytes = sizeof(float) * datalen;
+      char * ptr = const_cast<char *>(reinterpret_cast<const char *>(data));
+			inner->core().setExternalData(id, ptr, bytes, bufferType, nullptr);
+			inner->attachSample(id, nullptr);
+			inner->wake();
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetPreset(int32_t key)
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOReleaseDataRef(int32_t key, const char * id)
 {
-	return with_instance(key, [](RNBOUnity::InnerData * inner) {
-			inner->mCore.getPreset([inner](std::shared_ptr<const RNBO::Preset> p) {
-					inner->mEventHandler.handlePreset(p);
-			});
+	return with_instance(key, [id](RNBOUnity::InnerData * inner) {
+			inner->core().releaseExternalData(id);
+			inner->attachSample(id, nullptr);
+			inner->wake();
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOFreePreset(char * payload)
+//Decode an audio file into the process wide sample cache on a background thread, see docs/BUFFERS.md.
+//WAV is always supported, FLAC and Ogg Vorbis when the plugin was built with their decoders.
+//Returns a request for RNBOSampleCacheStatus, name is what RNBOAttachSample refers to it by.
+extern "C" UNITY_AUDIODSP_EXPORT_API int64_t AUDIO_CALLING_CONVENTION RNBOSampleCacheLoadFile(const char * name, const char * path)
 {
-	if (payload) {
-		delete [] payload;
-	}
+	if (name == nullptr || path == nullptr)
+		return 0;
+	return RNBOUnity::sampleCache().loadFile(name, path);
 }
 
+//The same with the encoded file in memory, for files script can't open by path (Android streaming assets, downloads), the data is copied
+extern "C" UNITY_AUDIODSP_EXPORT_API int64_t AUDIO_CALLING_CONVENTION RNBOSampleCacheLoadMemory(const char * name, const uint8_t * data, size_t len)
+{
+	if (name == nullptr || data == nullptr)
+		return 0;
+	return RNBOUnity::sampleCache().loadMemory(name, std::vector<uint8_t>(data, data + len));
+}
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOPoll(int32_t key)
+//pending 0, ready 1, failed -1, unsupported format -2, unknown -3. A finished request is only reported once.
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOSampleCacheStatus(int64_t request)
 {
-	//service the shared release queue
-	{
+	return RNBOUnity::sampleCache().status(request);
+}
 
-#ifndef NO_SHARED_LOCK
-		std::unique_lock<std::mutex> guard(datarefReleaseQueueMutex, std::try_to_lock);
-		if (guard.owns_lock()) {
-#else
-		{
-			std::lock_guard<std::mutex> guard(datarefReleaseQueueMutex);
-#endif
-			char * d = nullptr;
-			while (datarefReleaseQueue.try_dequeue(d)) {
-				if (d) {
-					delete [] d;
-				}
-			}
-		}
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSampleCacheGetInfo(const char * name, int32_t * channels, int32_t * samplerate, int64_t * frames)
+{
+	auto sample = name ? RNBOUnity::sampleCache().get(name) : nullptr;
+	if (!sample)
+		return false;
+	if (channels) {
+		*channels = sample->channels;
 	}
-
-	return with_instance(key, [](RNBOUnity::InnerData * inner) {
-			inner->mEventHandler.poll();
-	});
+	if (samplerate) {
+		*samplerate = sample->samplerate;
+	}
+	if (frames) {
+		*frames = static_cast<int64_t>(sample->frames());
+	}
+	return true;
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOReleaseHandles()
+//instances that attached the sample keep it, it just won't be found by name any longer
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSampleCacheEvict(const char * name)
 {
-	void * handle = nullptr;
-#ifndef NO_SHARED_LOCK
-	std::unique_lock<std::mutex> guard(callbackReleaseQueueMutex, std::try_to_lock);
-	if (guard.owns_lock()) {
-#else
-	{
-		std::lock_guard<std::mutex> guard(callbackReleaseQueueMutex);
-#endif
-		Callback * d = nullptr;
-		if (callbackReleaseQueue.try_dequeue(d)) {
-			handle = d->handle();
-			delete d;
-		}
-	}
-	return handle;
+	return name != nullptr && RNBOUnity::sampleCache().evict(name);
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API RNBO::MessageTag AUDIO_CALLING_CONVENTION RNBOTag(const char * tagChar)
+//samples nobody has attached are evicted, least recently used first, while the cache holds more than bytes
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOSampleCacheSetBudget(size_t bytes)
 {
-	return RNBO::TAG(tagChar);
+	RNBOUnity::sampleCache().setBudget(bytes);
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOResolveTag(int32_t key, RNBO::MessageTag tag, const char** tagChar)
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOSampleCacheGetUsage(size_t * bytes, size_t * count)
 {
-	return with_instance(key, [tag, tagChar](RNBOUnity::InnerData * inner) {
-			if (tagChar) {
-				*tagChar = inner->mCore.resolveTag(tag);
-			}
-	});
+	size_t b = 0;
+	size_t c = 0;
+	RNBOUnity::sampleCache().usage(b, c);
+	if (bytes) {
+		*bytes = b;
+	}
+	if (count) {
+		*count = c;
+	}
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetParamValue(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue value, RNBO::MillisecondTime attime)
+//Samples decoded from now on are converted to this rate in the background, so RNBO doesn't read them at a mismatched rate.
+//Usually the rate Unity runs at, 0 keeps the rate of the file. Samples already in the cache are left as they are.
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOSampleCacheSetSampleRate(int32_t samplerate)
 {
-	return with_instance(key, [index, value, attime](RNBOUnity::InnerData * inner) {
-			inner->mCore.setParameterValue(index, value, attime);
-	});
+	RNBOUnity::sampleCache().setSampleRate(samplerate);
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetParamValue(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue * valueOut)
+//Load a cached sample into the data ref id. Shared with every other instance that attached it, unless copy is set,
+//so like RNBOUnsafeLoadReadOnlyDataRef the patch must not write into or resize the buffer if copy is false.
+//Returns false if there is no such instance or no such sample.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOAttachSample(int32_t key, const char * id, const char * name, bool copy)
 {
-	return with_instance(key, [index, valueOut](RNBOUnity::InnerData * inner) {
-			if (valueOut != nullptr) {
-				*valueOut = inner->mCore.getParameterValue(index);
+	auto sample = id && name ? RNBOUnity::sampleCache().get(name) : nullptr;
+	if (!sample)
+		return false;
+	return with_instance(key, [id, &sample, copy](RNBOUnity::InnerData * inner) {
+			RNBO::Float32AudioBuffer bufferType(sample->channels, static_cast<double>(sample->samplerate));
+			const size_t bytes = sample->bytes();
+			if (copy) {
+				char * d = RNBOUnity::DataRef::allocate(bytes);
+				std::memcpy(d, sample->data.data(), bytes);
+				inner->core().setExternalData(id, d, bytes, bufferType, DataRefRelease);
+				inner->attachSample(id, nullptr);
+			} else {
+				char * ptr = const_cast<char *>(reinterpret_cast<const char *>(sample->data.data()));
+				inner->core().setExternalData(id, ptr, bytes, bufferType, nullptr);
+				inner->attachSample(id, sample);
 			}
+			inner->wake();
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetParamValueNormalized(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue value, RNBO::MillisecondTime attime)
+//Run the core at a fixed rate, whatever rate the instance is processed at, 0 follows the host again.
+//A lower rate makes cheap patches cheaper. Converting at the edges adds latency, see RNBOGetInternalSampleRate.
+//The core is prepared again at the new rate when the next block is processed, which resets the state of the patch.
+//The converter is built here, for the host the instance was created or last processed for. An instance that hasn't
+//been processed yet, or whose host changes, outputs silence until RNBOPoll has built one for it.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetInternalSampleRate(int32_t key, int32_t samplerate)
 {
-	return with_instance(key, [index, value, attime](RNBOUnity::InnerData * inner) {
-			inner->mCore.setParameterValueNormalized(index, value, attime);
+	return with_instance(key, [samplerate](RNBOUnity::InnerData * inner) {
+			inner->mInternalRate.store(std::max(0, samplerate));
+			inner->buildConverters();
+			inner->wake();
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetParamValueNormalized(int32_t key, RNBO::ParameterIndex index, RNBO::ParameterValue * valueOut)
+//latency is in frames at the host rate, 0 while the core runs at the host rate
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetInternalSampleRate(int32_t key, int32_t * samplerate, int32_t * latency)
 {
-	return with_instance(key, [index, valueOut](RNBOUnity::InnerData * inner) {
-			if (valueOut != nullptr) {
-				*valueOut = inner->mCore.convertToNormalizedParameterValue(index, inner->mCore.getParameterValue(index));
+	return with_instance(key, [samplerate, latency](RNBOUnity::InnerData * inner) {
+			if (samplerate) {
+				*samplerate = inner->mInternalRate.load();
+			}
+			if (latency) {
+				*latency = static_cast<int32_t>(inner->mRateLatency.load());
 			}
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMessageNumber(int32_t key, RNBO::MessageTag tag, RNBO::number v, RNBO::MillisecondTime attime)
+//The latency the instance adds, in frames at the host rate, -1 if there is no such instance.
+//What the patch reports through its description (see PatchLatency), plus converting to and from an internal rate and oversampling.
+//The compensation delay isn't included.
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOGetLatency(int32_t key)
 {
-	return with_instance(key, [&tag, v, attime](RNBOUnity::InnerData * inner) {
-			RNBO::MessageEvent event(tag, attime, v);
-			inner->mCore.scheduleEvent(event);
+	int32_t latency = -1;
+	with_instance(key, [&latency](RNBOUnity::InnerData * inner) {
+			latency = inner->latency();
 	});
+	return latency;
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMessageBang(int32_t key, RNBO::MessageTag tag, RNBO::MillisecondTime attime)
+//Delay the output of the instance by frames, 0 removes the delay.
+//The delay line is sized for the channel count the instance was last processed with. If that changes, the
+//output isn't delayed until RNBOPoll has rebuilt the line for the new count.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetLatencyCompensation(int32_t key, int32_t frames)
 {
-	return with_instance(key, [tag, attime](RNBOUnity::InnerData * inner) {
-			RNBO::MessageEvent event(tag, attime);
-			inner->mCore.scheduleEvent(event);
+	return with_instance(key, [frames](RNBOUnity::InnerData * inner) {
+			inner->setCompensation(static_cast<size_t>(std::max(0, frames)));
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMessageList(int32_t key, RNBO::MessageTag tag, const RNBO::number* buffer, size_t bufferlen, RNBO::MillisecondTime attime)
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetLatencyCompensation(int32_t key, int32_t * frames)
 {
-	return with_instance(key, [tag, buffer, bufferlen, attime](RNBOUnity::InnerData * inner) {
-		auto l = std::make_unique<RNBO::list>();
-		for (auto i = 0; i < bufferlen; i++) {
-			l->push(buffer[i]);
-		}
-		RNBO::MessageEvent event(tag, attime, std::move(l));
-		inner->mCore.scheduleEvent(event);
+	return with_instance(key, [frames](RNBOUnity::InnerData * inner) {
+			if (frames) {
+				*frames = static_cast<int32_t>(inner->compensation());
+			}
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendMIDI(int32_t key, const uint8_t* bytes, int len, RNBO::MillisecondTime attime)
+//Line up instances processed in parallel: each is delayed by how much less latency it has than the one with the most.
+//Returns that latency, or -1 if any of the keys has no instance, then nothing is changed.
+//Call it again after anything that changes their latency (internal rate, oversampling, a latency parameter).
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOAlignLatency(const int32_t * keys, int32_t count)
 {
-	return with_instance(key, [bytes, len, attime](RNBOUnity::InnerData * inner) {
-			RNBO::MidiEvent event(attime, 0, bytes, len);
-			inner->mCore.scheduleEvent(event);
-	});
+	if (keys == nullptr || count <= 0)
+		return -1;
+	std::vector<int32_t> latencies(static_cast<size_t>(count), 0);
+	for (int32_t i = 0; i < count; i++) {
+		if (!with_instance(keys[i], [&latencies, i](RNBOUnity::InnerData * inner) { latencies[static_cast<size_t>(i)] = inner->latency(); }))
+			return -1;
+	}
+	const int32_t most = *std::max_element(latencies.begin(), latencies.end());
+	for (int32_t i = 0; i < count; i++) {
+		const int32_t frames = most - latencies[static_cast<size_t>(i)];
+		with_instance(keys[i], [frames](RNBOUnity::InnerData * inner) {
+				inner->setCompensation(static_cast<size_t>(frames));
+		});
+	}
+	return most;
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendTransportEvent(int32_t key, bool running, RNBO::MillisecondTime attime)
+//Oversample the core 2, 4 or 8 times, 1 turns it off. Costs that many times the CPU of the patch, plus the filters.
+//Like changing the internal rate, the core is prepared again with the next block, which resets the state of the patch,
+//and the filters are built here, or by RNBOPoll if the instance hasn't been processed yet.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetOversampling(int32_t key, int32_t factor)
 {
-	return with_instance(key, [running, attime](RNBOUnity::InnerData * inner) {
-			RNBO::TransportEvent event(attime, running ? RNBO::TransportState::RUNNING : RNBO::TransportState::STOPPED);
-			inner->mCore.scheduleEvent(event);
+	if (factor != 1 && factor != 2 && factor != 4 && factor != 8)
+		return false;
+	return with_instance(key, [factor](RNBOUnity::InnerData * inner) {
+			inner->mOversampling.store(factor);
+			inner->buildConverters();
+			inner->wake();
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendTempoEvent(int32_t key, RNBO::number bpm, RNBO::MillisecondTime attime)
+//latency is in frames at the host rate, what the filters add once oversampling is running
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetOversampling(int32_t key, int32_t * factor, int32_t * latency)
 {
-	return with_instance(key, [bpm, attime](RNBOUnity::InnerData * inner) {
-			RNBO::TempoEvent event(attime, bpm);
-			inner->mCore.scheduleEvent(event);
+	return with_instance(key, [factor, latency](RNBOUnity::InnerData * inner) {
+			if (factor) {
+				*factor = inner->mOversampling.load();
+			}
+			if (latency) {
+				*latency = static_cast<int32_t>(inner->mOversamplingLatency.load());
+			}
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendBeatTimeEvent(int32_t key, RNBO::number beattime, RNBO::MillisecondTime attime)
+//Skip processing (and output silence) once input and output have been below threshold for tailMs
+//Processing resumes on input above threshold or anything sent from script (parameters, messages, MIDI, presets, data refs),
+//and doesn't stop while the transport the instance follows is running
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetIdleMode(int32_t key, bool enabled, float threshold, RNBO::MillisecondTime tailMs)
 {
-	return with_instance(key, [beattime, attime](RNBOUnity::InnerData * inner) {
-			RNBO::BeatTimeEvent event(attime, beattime);
-			inner->mCore.scheduleEvent(event);
+	return with_instance(key, [enabled, threshold, tailMs](RNBOUnity::InnerData * inner) {
+			inner->mIdleThreshold.store(std::max(0.0f, threshold));
+			inner->mIdleTailMs.store(std::max(0.0, tailMs));
+			inner->mIdleEnabled.store(enabled);
+			inner->wake();
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSendTimeSignatureEvent(int32_t key, int32_t numerator, int32_t denominator, RNBO::MillisecondTime attime)
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetIdleState(int32_t key, bool * idle, uint64_t * idleBlocks, uint64_t * processedBlocks, uint64_t * idleTransitions)
 {
-	return with_instance(key, [numerator, denominator, attime](RNBOUnity::InnerData * inner) {
-			RNBO::TimeSignatureEvent event(attime, numerator, denominator);
-			inner->mCore.scheduleEvent(event);
+	return with_instance(key, [idle, idleBlocks, processedBlocks, idleTransitions](RNBOUnity::InnerData * inner) {
+			if (idle) {
+				*idle = inner->mIdle.load();
+			}
+			if (idleBlocks) {
+				*idleBlocks = inner->mIdleBlocks.load();
+			}
+			if (processedBlocks) {
+				*processedBlocks = inner->mProcessedBlocks.load();
+			}
+			if (idleTransitions) {
+				*idleTransitions = inner->mIdleTransitions.load();
+			}
 	});
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOCopyLoadDataRef(int32_t key, const char * id, const float * data, size_t datalen, size_t channels, size_t samplerate)
+//Start writing the output of an instance to path, a 32 bit float wav file unless the path ends in .raw
+//Replaces (and finalizes) any capture that is already running for the instance
+//Nothing is created for a key that has no instance
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOStartCapture(int32_t key, const char * path)
 {
-	return with_instance(key, [id, data, datalen, channels, samplerate](RNBOUnity::InnerData * inner) {
-			RNBO::Float32AudioBuffer bufferType(channels, static_cast<double>(samplerate));
+	if (path == nullptr || !with_instance(key, [](RNBOUnity::InnerData *) {})) {
+		return false;
+	}
 
-			//we need to create our own copy as RNBO might write into the data AND it also might realloc
-			float * d = new float[datalen];
-			size_t bytes = sizeof(float) * datalen;
-			std::memcpy(d, data, bytes);
-			inner->mCore.setExternalData(id, reinterpret_cast<char *>(d), bytes, bufferType, DataRefRelease);
+	//opened outside of the instance lock, creating the file can take a while
+	RNBOUnity::Capture * capture = RNBOUnity::Capture::open(path);
+	if (capture == nullptr) {
+		return false;
+	}
+
+	RNBOUnity::Capture * prev = nullptr;
+	bool found = with_instance(key, [capture, &prev](RNBOUnity::InnerData * inner) {
+			prev = inner->mCapture.swap(capture);
 	});
+	if (!found) {
+		//destroyed meanwhile, don't leave an empty file behind
+		delete capture;
+		std::remove(path);
+	}
+
+	//finishing joins the writer thread, do it outside of the instance lock
+	delete prev;
+	return found;
 }
 
-// here we simply send over the pointer to the data, since RNBO buffers are read/write, you have to be sure that your code doesn't try to write or resize
-// TODO can we indicate a real release?
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOUnsafeLoadReadOnlyDataRef(int32_t key, const char * id, const float * data, size_t datalen, size_t channels, size_t samplerate)
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOStopCapture(int32_t key)
 {
-	return with_instance(key, [id, data, datalen, channels, samplerate](RNBOUnity::InnerData * inner) {
-			RNBO::Float32AudioBuffer bufferType(channels, static_cast<double>(samplerate));
-
-			size_t bytes = sizeof(float) * datalen;
-      char * ptr = const_cast<char *>(reinterpret_cast<const char *>(data));
-			inner->mCore.setExternalData(id, ptr, bytes, bufferType, nullptr);
+	RNBOUnity::Capture * prev = nullptr;
+	bool found = with_instance(key, [&prev](RNBOUnity::InnerData * inner) {
+			prev = inner->mCapture.swap(nullptr);
 	});
+	delete prev;
+	return found && prev != nullptr;
 }
 
-extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOReleaseDataRef(int32_t key, const char * id)
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetCaptureStats(int32_t key, uint64_t * framesWritten, uint64_t * framesDropped)
 {
-	return with_instance(key, [id](RNBOUnity::InnerData * inner) {
-			inner->mCore.releaseExternalData(id);
+	bool capturing = false;
+	with_instance(key, [&capturing, framesWritten, framesDropped](RNBOUnity::InnerData * inner) {
+			inner->mCapture.with([&capturing, framesWritten, framesDropped](RNBOUnity::Capture * capture) {
+					capturing = true;
+					if (framesWritten) {
+						*framesWritten = capture->framesWritten();
+					}
+					if (framesDropped) {
+						*framesDropped = capture->framesDropped();
+					}
+			});
 	});
+	return capturing;
 }
 
 extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOClearRegisteredCallbacks(int32_t key)
@@ -947,21 +3446,83 @@ extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORegisterT
 
 extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBORegisterGlobalTransportRequestCallback(CTransportRequestCallback callback, void * handle)
 {
-	if (callback != nullptr && handle != nullptr) {
-		RNBOUnity::globalTransportCallback.store(new Callback(reinterpret_cast<void (*)()>(callback), handle));
-	} else {
-		RNBOUnity::globalTransportCallback.store(nullptr);
+	Callback * prev = RNBOUnity::globalTransportCallback.exchange(callback != nullptr && handle != nullptr ? new Callback(reinterpret_cast<void (*)()>(callback), handle) : nullptr);
+	if (prev != nullptr) {
+		std::lock_guard<std::mutex> guard(retiredTransportMutex);
+		retiredTransportCallbacks.push_back(prev);
+	}
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOSetGlobalTransportState(bool running, RNBO::number bpm, RNBO::number beatTime, int32_t timeSigNum, int32_t timeSigDenom, RNBO::MillisecondTime attime)
+{
+	RNBOUnity::globalTransportState.write(running, bpm, beatTime, timeSigNum, timeSigDenom, attime);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOClearGlobalTransportState()
+{
+	RNBOUnity::globalTransportState.clear();
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetGlobalTransportBeatTime(RNBO::MillisecondTime now, RNBO::number * beatTime)
+{
+	RNBOUnity::SharedTransportState::Snapshot state;
+	if (!RNBOUnity::globalTransportState.active() || !RNBOUnity::globalTransportState.read(state)) {
+		return false;
 	}
+	if (beatTime) {
+		*beatTime = state.beatTimeAt(now);
+	}
+	return true;
 }
 
 extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORegisterTransportRequestCallback(int32_t key, CTransportRequestCallback callback, void * handle)
 {
 	return with_instance(key, [callback, handle](RNBOUnity::InnerData * inner) {
 			if (callback != nullptr && handle != nullptr) {
-			Callback * data = new Callback(reinterpret_cast<void (*)()>(callback), handle);
-			inner->mTransportCallback.store(data);
+				inner->setTransportCallback(new Callback(reinterpret_cast<void (*)()>(callback), handle));
+			} else {
+				inner->setTransportCallback(nullptr);
+			}
+	});
+}
+
+//Receive all of the MIDI the instance produced since the last RNBOPoll with one callback, packed like RNBOSendMIDIPacked input
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORegisterMIDIEventCallback(int32_t key, CMIDIBatchCallback callback, void * handle)
+{
+	return with_instance(key, [callback, handle](RNBOUnity::InnerData * inner) {
+			if (callback && handle) {
+				inner->mEventHandler.setMidiBatchCallback([callback, handle](const uint8_t * packed, size_t len, int32_t count) {
+						callback(handle, packed, len, count);
+				});
 			} else {
-			inner->mTransportCallback.store(nullptr);
+				inner->mEventHandler.setMidiBatchCallback(nullptr);
+			}
+	});
+}
+
+//Alternatively, collect the outgoing MIDI and copy it out after RNBOPoll
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOSetMIDIOutCollection(int32_t key, bool enabled)
+{
+	return with_instance(key, [enabled](RNBOUnity::InnerData * inner) {
+			inner->mEventHandler.setMidiOutEnabled(enabled);
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOCopyMIDIOut(int32_t key, uint8_t * dest, size_t capacity, size_t * written, int32_t * count)
+{
+	return with_instance(key, [dest, capacity, written, count](RNBOUnity::InnerData * inner) {
+			size_t n = inner->mEventHandler.copyMidiOut(dest, capacity, count);
+			if (written) {
+				*written = n;
+			}
+	});
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetMIDIOutDropped(int32_t key, uint64_t * dropped)
+{
+	return with_instance(key, [dropped](RNBOUnity::InnerData * inner) {
+			if (dropped) {
+				*dropped = inner->mEventHandler.midiOutDropped();
 			}
 	});
 }
@@ -978,4 +3539,237 @@ extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBORegisterP
 	});
 }
 
+//The threads the plugin starts, by role: 0 graph workers, 1 sample decoding and batch rendering, 2 background work
+//(the reclaimer, capture writers, hot reload). Threads pick it up between pieces of work, false for an unknown role.
+//affinity is a mask of the CPUs they may run on, 0 allows all of them. priority 1 to 99 asks for real time scheduling, 0 is normal.
+//budgetMs is the thread CPU time a cycle may take before it counts as a deadline miss. A graph worker's cycle is its share of a block,
+//an offline cycle one decoded sample or batch rendered job, a background cycle one reclaim pass, capture write or hot reload check.
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOConfigureThreads(int32_t role, uint64_t affinity, int32_t priority, double budgetMs)
+{
+	if (!RNBOUnity::ThreadManager::valid(role))
+		return false;
+	RNBOUnity::ThreadManager::Config config;
+	config.affinity = affinity;
+	config.priority = std::clamp(priority, 0, 99);
+	config.budgetMs = budgetMs;
+	RNBOUnity::threadManager().configure(static_cast<RNBOUnity::ThreadManager::Role>(role), config);
+	return true;
+}
+
+//denied counts the times a thread couldn't get the affinity or priority it was configured with, usually a missing permission
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGetThreadStats(int32_t role, uint64_t * cycles, uint64_t * misses, double * worstMs, uint64_t * denied)
+{
+	if (!RNBOUnity::ThreadManager::valid(role))
+		return false;
+	RNBOUnity::ThreadManager::Stats stats;
+	RNBOUnity::threadManager().stats(static_cast<RNBOUnity::ThreadManager::Role>(role), stats);
+	if (cycles) {
+		*cycles = stats.cycles;
+	}
+	if (misses) {
+		*misses = stats.misses;
+	}
+	if (worstMs) {
+		*worstMs = stats.worstMs;
+	}
+	if (denied) {
+		*denied = stats.denied;
+	}
+	return true;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOResetThreadStats(int32_t role)
+{
+	if (!RNBOUnity::ThreadManager::valid(role))
+		return false;
+	RNBOUnity::threadManager().resetStats(static_cast<RNBOUnity::ThreadManager::Role>(role));
+	return true;
+}
+
+//routing graphs, key RNBOGraphIO (0) stands for the graph's input or output
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOGraphCreate(int32_t threads, int32_t channels, int32_t maxBlockSize)
+{
+	auto graph = new RNBOUnity::Graph(threads, channels, maxBlockSize);
+	std::lock_guard<std::mutex> guard(RNBOUnity::graphsMutex);
+	RNBOUnity::graphs.push_back(graph);
+	return graph;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOGraphDestroy(RNBOUnity::Graph * graph)
+{
+	if (graph == nullptr)
+		return;
+	{
+		std::lock_guard<std::mutex> guard(RNBOUnity::graphsMutex);
+		RNBOUnity::graphs.erase(std::remove(RNBOUnity::graphs.begin(), RNBOUnity::graphs.end(), graph), RNBOUnity::graphs.end());
+	}
+	delete graph;
+}
+
+//instances in a graph are processed by it, don't also process them with RNBOProcess
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGraphAdd(RNBOUnity::Graph * graph, int32_t key, int32_t inchannels, int32_t outchannels)
+{
+	if (graph == nullptr)
+		return false;
+	bool added = false;
+	//held across the add so the instance can't be destroyed halfway
+	with_instance(key, [graph, inchannels, outchannels, &added](RNBOUnity::InnerData * inner) {
+			added = graph->add(inner, inchannels, outchannels);
+	});
+	return added;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGraphRemove(RNBOUnity::Graph * graph, int32_t key)
+{
+	if (graph == nullptr)
+		return false;
+	bool removed = false;
+	with_instance(key, [graph, &removed](RNBOUnity::InnerData * inner) {
+			removed = graph->remove(inner);
+	});
+	return removed;
+}
+
+//false if either end isn't in the graph, or the connection would make a cycle
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGraphConnectAudio(RNBOUnity::Graph * graph, int32_t fromKey, int32_t toKey)
+{
+	if (graph == nullptr)
+		return false;
+	return graph->connectAudio(fromKey, toKey);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGraphDisconnectAudio(RNBOUnity::Graph * graph, int32_t fromKey, int32_t toKey)
+{
+	if (graph == nullptr)
+		return false;
+	return graph->disconnectAudio(fromKey, toKey);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGraphConnectMessage(RNBOUnity::Graph * graph, int32_t fromKey, RNBO::MessageTag outport, int32_t toKey, RNBO::MessageTag inport)
+{
+	if (graph == nullptr)
+		return false;
+	return graph->connectMessage(fromKey, outport, toKey, inport);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOGraphDisconnectMessage(RNBOUnity::Graph * graph, int32_t fromKey, RNBO::MessageTag outport, int32_t toKey, RNBO::MessageTag inport)
+{
+	if (graph == nullptr)
+		return false;
+	return graph->disconnectMessage(fromKey, outport, toKey, inport);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOGraphProcess(RNBOUnity::Graph * graph, RNBO::MillisecondTime now, float * buffer, int32_t channels, int32_t nframes, int32_t samplerate)
+{
+	if (graph == nullptr)
+		return;
+	graph->process(now, buffer, channels, nframes, samplerate);
+}
+
+#endif
+
+//voice pools
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOVoicePoolCreatePatch(int32_t patch, int32_t voices, int32_t channels, int32_t samplerate, int32_t maxBlockSize)
+{
+	if (patch < 0 || static_cast<size_t>(patch) >= RNBOUnity::numPatches)
+		return nullptr;
+	RNBOUnity::VoicePool * pool = nullptr;
+#if RNBO_UNITY_MULTI_PATCH == 1
+	RNBO::PatcherFactoryFunctionPtr patcher = RNBOUnity::getPatch(static_cast<size_t>(patch)).factory(RNBO::Platform::get());
+	pool = new RNBOUnity::VoicePool(voices, channels, samplerate, maxBlockSize, patcher);
+#elif RNBO_UNITY_HOT_RELOAD == 1
+	{
+		//registered under the same lock a reload holds, so the pool either gets the newest code here or from the reload
+		std::lock_guard<std::mutex> guard(RNBOUnity::hotReloadMutex);
+		RNBO::PatcherFactoryFunctionPtr patcher = RNBOUnity::currentPatcherFactory();
+		pool = new RNBOUnity::VoicePool(voices, channels, samplerate, maxBlockSize, patcher);
+		RNBOUnity::hotReloadPools.push_back(pool);
+	}
+#else
+	RNBO::PatcherFactoryFunctionPtr patcher = nullptr;
+	pool = new RNBOUnity::VoicePool(voices, channels, samplerate, maxBlockSize, patcher);
+#endif
+	return pool;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void * AUDIO_CALLING_CONVENTION RNBOVoicePoolCreate(int32_t voices, int32_t channels, int32_t samplerate, int32_t maxBlockSize)
+{
+	return RNBOVoicePoolCreatePatch(0, voices, channels, samplerate, maxBlockSize);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOVoicePoolDestroy(RNBOUnity::VoicePool * pool)
+{
+#if RNBO_UNITY_HOT_RELOAD == 1
+	{
+		std::lock_guard<std::mutex> guard(RNBOUnity::hotReloadMutex);
+		auto& pools = RNBOUnity::hotReloadPools;
+		pools.erase(std::remove(pools.begin(), pools.end(), pool), pools.end());
+	}
 #endif
+	delete pool;
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOVoicePoolProcess(RNBOUnity::VoicePool * pool, RNBO::MillisecondTime now, float * buffer, int32_t channels, int32_t nframes, int32_t samplerate)
+{
+	if (pool == nullptr) {
+		if (buffer != nullptr && channels > 0 && nframes > 0) {
+			std::memset(buffer, 0, static_cast<size_t>(channels) * static_cast<size_t>(nframes) * sizeof(float));
+		}
+		return;
+	}
+	pool->process(now, buffer, channels, nframes, samplerate);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API int32_t AUDIO_CALLING_CONVENTION RNBOVoicePoolTrigger(RNBOUnity::VoicePool * pool, int32_t priority,
+		const RNBO::ParameterIndex * paramIndices, const RNBO::ParameterValue * paramValues, int32_t numParams,
+		RNBO::MessageTag bangTag, const uint8_t * midi, int32_t midiLen, RNBO::MillisecondTime attime)
+{
+	if (pool == nullptr)
+		return RNBOUnity::VoicePool::invalidVoice;
+	return pool->trigger(priority, paramIndices, paramValues, numParams, bangTag, midi, midiLen, attime);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API bool AUDIO_CALLING_CONVENTION RNBOVoicePoolStop(RNBOUnity::VoicePool * pool, int32_t voiceId)
+{
+	if (pool == nullptr)
+		return false;
+	return pool->stop(voiceId);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOVoicePoolSetCulling(RNBOUnity::VoicePool * pool, float threshold, RNBO::MillisecondTime holdMs)
+{
+	if (pool == nullptr)
+		return;
+	pool->setCulling(threshold, holdMs);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOVoicePoolSetStopMessage(RNBOUnity::VoicePool * pool, RNBO::MessageTag tag)
+{
+	if (pool == nullptr)
+		return;
+	pool->setStopMessage(tag);
+}
+
+extern "C" UNITY_AUDIODSP_EXPORT_API void AUDIO_CALLING_CONVENTION RNBOVoicePoolGetStats(RNBOUnity::VoicePool * pool, int32_t * active, uint64_t * triggered, uint64_t * stolen, uint64_t * rejected, uint64_t * culled)
+{
+	if (pool == nullptr)
+		return;
+	auto stats = pool->stats();
+	if (active) {
+		*active = stats.active;
+	}
+	if (triggered) {
+		*triggered = stats.triggered;
+	}
+	if (stolen) {
+		*stolen = stats.stolen;
+	}
+	if (rejected) {
+		*rejected = stats.rejected;
+	}
+	if (culled) {
+		*culled = stats.culled;
+	}
+}
@@ -0,0 +1,193 @@
+//Instance churn benchmark for the script key allocator, see docs/BUILD_OPTIMIZATION.md
+//
+//Loads the plugin and has several threads create and destroy instances as fast as they can, each keeping a
+//few of its own alive, while other threads keep calling into live instances by key the way scripts do.
+//Prints creates and script calls per second and how long creates took, so key allocation and the instance
+//lock can be compared across changes, and checks that a destroyed key is refused and a new one is accepted.
+//
+//usage: RNBOUnityChurn <plugin path> [seconds] [churn threads] [script threads] [live instances per thread]
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+	typedef void * (*InstanceCreate)(int32_t *);
+	typedef void (*InstanceDestroy)(void *, int32_t);
+	typedef bool (*SetParamValue)(int32_t, size_t, double, double);
+	//answers for any live key without changing anything
+	typedef bool (*GetSnapshotSize)(int32_t, size_t *, size_t *);
+
+	template <typename T>
+	T lookup(void * lib, const char * name) {
+		return reinterpret_cast<T>(dlsym(lib, name));
+	}
+
+	//create times in power of two nanosecond buckets, merged from the churn threads at the end
+	struct Histogram {
+		std::array<uint64_t, 64> buckets = {};
+		uint64_t count = 0;
+		uint64_t worst = 0;
+
+		void add(uint64_t ns) {
+			size_t b = 0;
+			while (b + 1 < buckets.size() && (uint64_t(1) << (b + 1)) <= ns) {
+				b++;
+			}
+			buckets[b]++;
+			count++;
+			worst = std::max(worst, ns);
+		}
+
+		void merge(const Histogram& o) {
+			for (size_t b = 0; b < buckets.size(); b++) {
+				buckets[b] += o.buckets[b];
+			}
+			count += o.count;
+			worst = std::max(worst, o.worst);
+		}
+
+		//upper bound of the bucket the fraction p of the samples falls in
+		double percentileUs(double p) const {
+			const uint64_t target = static_cast<uint64_t>(std::ceil(p * static_cast<double>(count)));
+			uint64_t seen = 0;
+			for (size_t b = 0; b < buckets.size(); b++) {
+				seen += buckets[b];
+				if (seen >= target && seen > 0) {
+					return static_cast<double>(uint64_t(1) << (b + 1)) / 1000.0;
+				}
+			}
+			return 0.0;
+		}
+	};
+
+	//the keys script threads pick from, published by the churn threads
+	struct Published {
+		std::atomic<int32_t> key { 0 };
+	};
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <plugin path> [seconds] [churn threads] [script threads] [live instances per thread]\n", argv[0]);
+		return 1;
+	}
+	const double seconds = argc > 2 ? std::atof(argv[2]) : 10.0;
+	const int churnThreads = std::max(1, argc > 3 ? std::atoi(argv[3]) : 4);
+	const int scriptThreads = std::max(0, argc > 4 ? std::atoi(argv[4]) : 2);
+	const size_t live = static_cast<size_t>(std::max(1, argc > 5 ? std::atoi(argv[5]) : 8));
+
+	void * lib = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+	if (lib == nullptr) {
+		std::fprintf(stderr, "failed to load %s: %s\n", argv[1], dlerror());
+		return 1;
+	}
+
+	auto instanceCreate = lookup<InstanceCreate>(lib, "RNBOInstanceCreate");
+	auto instanceDestroy = lookup<InstanceDestroy>(lib, "RNBOInstanceDestroy");
+	auto setParamValue = lookup<SetParamValue>(lib, "RNBOSetParamValue");
+	auto getSnapshotSize = lookup<GetSnapshotSize>(lib, "RNBOGetSnapshotSize");
+	if (instanceCreate == nullptr || instanceDestroy == nullptr || setParamValue == nullptr || getSnapshotSize == nullptr) {
+		std::fprintf(stderr, "%s doesn't have the script instance entrypoints\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<Published> published(static_cast<size_t>(churnThreads) * live);
+	std::vector<Histogram> histograms(static_cast<size_t>(churnThreads));
+	std::atomic<bool> running(true);
+	std::atomic<uint64_t> creates(0);
+	std::atomic<uint64_t> calls(0);
+	std::atomic<uint64_t> staleAccepted(0);
+	std::atomic<uint64_t> freshRefused(0);
+	std::atomic<uint64_t> failed(0);
+	std::vector<std::thread> threads;
+
+	//churn, each thread replaces its oldest instance with a new one, over and over
+	for (int t = 0; t < churnThreads; t++) {
+		threads.emplace_back([&, t]() {
+			struct Owned {
+				void * instance = nullptr;
+				int32_t key = 0;
+			};
+			std::vector<Owned> owned(live);
+			Histogram& histogram = histograms[static_cast<size_t>(t)];
+			size_t oldest = 0;
+			while (running.load(std::memory_order_relaxed)) {
+				Owned& o = owned[oldest];
+				Published& slot = published[static_cast<size_t>(t) * live + oldest];
+				if (o.instance != nullptr) {
+					slot.key.store(0, std::memory_order_relaxed);
+					instanceDestroy(o.instance, o.key);
+					//the generation in the key has to tell a destroyed instance from whatever reuses its slot
+					if (getSnapshotSize(o.key, nullptr, nullptr)) {
+						staleAccepted++;
+					}
+				}
+
+				const auto start = std::chrono::steady_clock::now();
+				o.instance = instanceCreate(&o.key);
+				histogram.add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+				if (o.instance == nullptr) {
+					failed++;
+				} else {
+					if (!getSnapshotSize(o.key, nullptr, nullptr)) {
+						freshRefused++;
+					}
+					slot.key.store(o.key, std::memory_order_relaxed);
+				}
+				creates++;
+				oldest = (oldest + 1) % owned.size();
+			}
+			for (auto& o: owned) {
+				if (o.instance != nullptr) {
+					instanceDestroy(o.instance, o.key);
+				}
+			}
+		});
+	}
+
+	//script, calls by key into whatever is live, these contend with the creates for the instance lock
+	for (int t = 0; t < scriptThreads; t++) {
+		threads.emplace_back([&, t]() {
+			std::mt19937 rng(static_cast<unsigned>(100 + t));
+			while (running.load(std::memory_order_relaxed)) {
+				const int32_t key = published[rng() % published.size()].key.load(std::memory_order_relaxed);
+				if (key != 0) {
+					setParamValue(key, rng() % 8, static_cast<double>(rng() % 1000) / 1000.0, 0.0);
+				}
+				calls++;
+			}
+		});
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	running.store(false);
+	for (auto& thread: threads) {
+		thread.join();
+	}
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Histogram all;
+	for (auto& h: histograms) {
+		all.merge(h);
+	}
+	std::printf("%d churn threads with %zu live instances each, %d script threads, %.2f s\n", churnThreads, live, scriptThreads, elapsed);
+	std::printf("%llu creates, %.0f creates/s, %llu failed\n", static_cast<unsigned long long>(creates.load()), creates.load() / elapsed,
+			static_cast<unsigned long long>(failed.load()));
+	std::printf("create p50 < %.1f us, p99 < %.1f us, worst %.1f us\n", all.percentileUs(0.5), all.percentileUs(0.99), static_cast<double>(all.worst) / 1000.0);
+	std::printf("%llu script calls, %.0f calls/s\n", static_cast<unsigned long long>(calls.load()), calls.load() / elapsed);
+	std::printf("%llu destroyed keys accepted, %llu new keys refused\n", static_cast<unsigned long long>(staleAccepted.load()),
+			static_cast<unsigned long long>(freshRefused.load()));
+	return staleAccepted.load() == 0 && freshRefused.load() == 0 && failed.load() == 0 ? 0 : 1;
+}
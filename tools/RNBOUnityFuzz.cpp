@@ -0,0 +1,344 @@
+//libFuzzer target for the script entrypoints, see docs/BUILD_OPTIMIZATION.md
+//
+//Each input is read as a little program: an opcode byte followed by the arguments it needs, taken
+//from the input as they are (so indices, sizes and values are arbitrary, NaNs included). It creates,
+//processes and destroys a few instances, and feeds the raw bytes to the parsers that take data from
+//script: packed MIDI, MIDI files, snapshots and presets. Keys are mostly live ones, some stale ones.
+//
+//The plugin is loaded from RNBO_UNITY_PLUGIN, or the one it was built against.
+//Without libFuzzer (RNBO_UNITY_FUZZ_REPLAY) it runs the files on the command line once each, to
+//replay a crash or a corpus under a sanitizer of another compiler.
+//
+//usage: RNBOUnityFuzz [libFuzzer options] [corpus dir]
+//       RNBOUnityFuzz <input file>... (replay)
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#ifndef RNBO_UNITY_FUZZ_PLUGIN
+#define RNBO_UNITY_FUZZ_PLUGIN ""
+#endif
+
+namespace {
+	const size_t numslots = 4;
+	const int32_t maxchannels = 8;
+	const int32_t maxframes = 2048;
+
+	typedef void * (*InstanceCreate)(int32_t *);
+	typedef void (*InstanceDestroy)(void *, int32_t);
+	typedef void (*Process)(void *, double, float *, int32_t, int32_t, int32_t);
+	typedef bool (*SetParamValue)(int32_t, size_t, double, double);
+	typedef bool (*RampParamEnvelope)(int32_t, size_t, const double *, size_t, int32_t, double);
+	typedef bool (*SendMessageList)(int32_t, uint32_t, const double *, size_t, double);
+	typedef bool (*ScheduleMessageNumber)(int32_t, uint32_t, double, double, int32_t);
+	typedef int32_t (*CancelScheduledGroup)(int32_t, int32_t);
+	typedef bool (*SendMIDI)(int32_t, const uint8_t *, int, double);
+	typedef bool (*SendMIDIPacked)(int32_t, const uint8_t *, size_t, int32_t *);
+	typedef bool (*LoadMIDIFile)(int32_t, const uint8_t *, size_t, double, int32_t);
+	typedef bool (*SendTimeSignature)(int32_t, int32_t, int32_t, double);
+	typedef bool (*SendTempo)(int32_t, double, double);
+	typedef bool (*GetSnapshotSize)(int32_t, size_t *, size_t *);
+	typedef bool (*CaptureSnapshot)(int32_t, uint8_t *, size_t, size_t *);
+	typedef bool (*RestoreSnapshot)(int32_t, const uint8_t *, size_t);
+	typedef bool (*LoadPreset)(int32_t, const char *);
+	typedef bool (*SetInt)(int32_t, int32_t);
+	typedef bool (*Poll)(int32_t);
+	typedef void * (*ReleaseHandles)();
+
+	struct Plugin {
+		InstanceCreate instanceCreate = nullptr;
+		InstanceDestroy instanceDestroy = nullptr;
+		Process process = nullptr;
+		SetParamValue setParamValue = nullptr;
+		SetParamValue setParamValueNormalized = nullptr;
+		RampParamEnvelope rampParamEnvelope = nullptr;
+		SendMessageList sendMessageList = nullptr;
+		ScheduleMessageNumber scheduleMessageNumber = nullptr;
+		CancelScheduledGroup cancelScheduledGroup = nullptr;
+		SendMIDI sendMIDI = nullptr;
+		SendMIDIPacked sendMIDIPacked = nullptr;
+		LoadMIDIFile loadMIDIFile = nullptr;
+		SendTimeSignature sendTimeSignature = nullptr;
+		SendTempo sendTempo = nullptr;
+		GetSnapshotSize getSnapshotSize = nullptr;
+		CaptureSnapshot captureSnapshot = nullptr;
+		RestoreSnapshot restoreSnapshot = nullptr;
+		LoadPreset loadPreset = nullptr;
+		SetInt setLatencyCompensation = nullptr;
+		SetInt setOversampling = nullptr;
+		SetInt setInternalSampleRate = nullptr;
+		Poll poll = nullptr;
+		ReleaseHandles releaseHandles = nullptr;
+	};
+
+	template <typename T>
+	void lookup(void * lib, const char * name, T& fn) {
+		fn = reinterpret_cast<T>(dlsym(lib, name));
+		if (fn == nullptr) {
+			std::fprintf(stderr, "plugin has no %s\n", name);
+			std::abort();
+		}
+	}
+
+	const Plugin& plugin() {
+		static const Plugin loaded = []() {
+			const char * path = std::getenv("RNBO_UNITY_PLUGIN");
+			if (path == nullptr || *path == '\0') {
+				path = RNBO_UNITY_FUZZ_PLUGIN;
+			}
+			void * lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+			if (lib == nullptr) {
+				std::fprintf(stderr, "failed to load '%s' (set RNBO_UNITY_PLUGIN): %s\n", path, dlerror());
+				std::abort();
+			}
+			Plugin p;
+			lookup(lib, "RNBOInstanceCreate", p.instanceCreate);
+			lookup(lib, "RNBOInstanceDestroy", p.instanceDestroy);
+			lookup(lib, "RNBOProcess", p.process);
+			lookup(lib, "RNBOSetParamValue", p.setParamValue);
+			lookup(lib, "RNBOSetParamValueNormalized", p.setParamValueNormalized);
+			lookup(lib, "RNBORampParamEnvelope", p.rampParamEnvelope);
+			lookup(lib, "RNBOSendMessageList", p.sendMessageList);
+			lookup(lib, "RNBOScheduleMessageNumber", p.scheduleMessageNumber);
+			lookup(lib, "RNBOCancelScheduledGroup", p.cancelScheduledGroup);
+			lookup(lib, "RNBOSendMIDI", p.sendMIDI);
+			lookup(lib, "RNBOSendMIDIPacked", p.sendMIDIPacked);
+			lookup(lib, "RNBOLoadMIDIFile", p.loadMIDIFile);
+			lookup(lib, "RNBOSendTimeSignatureEvent", p.sendTimeSignature);
+			lookup(lib, "RNBOSendTempoEvent", p.sendTempo);
+			lookup(lib, "RNBOGetSnapshotSize", p.getSnapshotSize);
+			lookup(lib, "RNBOCaptureSnapshot", p.captureSnapshot);
+			lookup(lib, "RNBORestoreSnapshot", p.restoreSnapshot);
+			lookup(lib, "RNBOLoadPreset", p.loadPreset);
+			lookup(lib, "RNBOSetLatencyCompensation", p.setLatencyCompensation);
+			lookup(lib, "RNBOSetOversampling", p.setOversampling);
+			lookup(lib, "RNBOSetInternalSampleRate", p.setInternalSampleRate);
+			lookup(lib, "RNBOPoll", p.poll);
+			lookup(lib, "RNBOReleaseHandles", p.releaseHandles);
+			return p;
+		}();
+		return loaded;
+	}
+
+	//takes arguments from the front of the input, zeros once it runs out
+	class Reader {
+		public:
+			Reader(const uint8_t * data, size_t size) : mData(data), mSize(size) {}
+
+			bool done() const { return mOffset >= mSize; }
+
+			template <typename T>
+			T take() {
+				T value;
+				std::memset(&value, 0, sizeof(T));
+				const size_t n = std::min(sizeof(T), mSize - mOffset);
+				std::memcpy(&value, mData + mOffset, n);
+				mOffset += n;
+				return value;
+			}
+
+			//the next up to len bytes
+			const uint8_t * bytes(size_t& len) {
+				len = std::min(len, mSize - mOffset);
+				const uint8_t * start = mData + mOffset;
+				mOffset += len;
+				return start;
+			}
+
+		private:
+			const uint8_t * mData;
+			const size_t mSize;
+			size_t mOffset = 0;
+	};
+
+	struct Slot {
+		void * instance = nullptr;
+		int32_t key = 0;
+	};
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+	const Plugin& p = plugin();
+	Reader in(data, size);
+	Slot slots[numslots];
+	std::vector<float> buffer(static_cast<size_t>(maxchannels * maxframes));
+	std::vector<uint8_t> scratch;
+	std::vector<double> numbers;
+	double now = 0.0;
+
+	while (!in.done()) {
+		const uint8_t op = in.take<uint8_t>();
+		Slot& slot = slots[in.take<uint8_t>() % numslots];
+		//a stale or made up key once in a while
+		const int32_t key = (op & 0x80) ? in.take<int32_t>() : slot.key;
+
+		switch (op % 20) {
+			case 0:
+				if (slot.instance == nullptr) {
+					slot.instance = p.instanceCreate(&slot.key);
+				}
+				break;
+			case 1:
+				if (slot.instance != nullptr) {
+					p.instanceDestroy(slot.instance, slot.key);
+					p.instanceDestroy(slot.instance, slot.key);
+					slot.instance = nullptr;
+				}
+				break;
+			case 2:
+				if (slot.instance != nullptr) {
+					const int32_t channels = 1 + in.take<uint8_t>() % maxchannels;
+					const int32_t frames = in.take<uint16_t>() % (maxframes + 1);
+					static const int32_t rates[] = { 22050, 44100, 48000, 96000 };
+					const int32_t samplerate = rates[in.take<uint8_t>() % 4];
+					p.process(slot.instance, now, buffer.data(), channels, frames, samplerate);
+					now += 1000.0 * frames / samplerate;
+				}
+				break;
+			case 3:
+			case 4: {
+				const size_t index = in.take<uint16_t>();
+				const double value = in.take<double>();
+				const double at = in.take<double>();
+				(op % 20 == 3 ? p.setParamValue : p.setParamValueNormalized)(key, index, value, at);
+				break;
+			}
+			case 5: {
+				//(value, duration) pairs
+				const size_t index = in.take<uint16_t>();
+				numbers.resize(2 * (in.take<uint8_t>() % 8));
+				for (auto& n: numbers) {
+					n = in.take<double>();
+				}
+				const int32_t curve = in.take<int32_t>();
+				p.rampParamEnvelope(key, index, numbers.data(), numbers.size() / 2, curve, now);
+				break;
+			}
+			case 6: {
+				const uint32_t tag = in.take<uint32_t>();
+				numbers.resize(in.take<uint8_t>() % 16);
+				for (auto& n: numbers) {
+					n = in.take<double>();
+				}
+				const double at = in.take<double>();
+				p.sendMessageList(key, tag, numbers.data(), numbers.size(), at);
+				break;
+			}
+			case 7: {
+				const uint32_t tag = in.take<uint32_t>();
+				const double value = in.take<double>();
+				const double at = now + in.take<uint16_t>();
+				p.scheduleMessageNumber(key, tag, value, at, in.take<int8_t>());
+				break;
+			}
+			case 8:
+				p.cancelScheduledGroup(key, in.take<int8_t>());
+				break;
+			case 9: {
+				size_t len = in.take<uint8_t>() % 8;
+				const uint8_t * bytes = in.bytes(len);
+				const double at = now + in.take<uint16_t>();
+				p.sendMIDI(key, bytes, static_cast<int>(len), at);
+				break;
+			}
+			case 10: {
+				size_t len = in.take<uint16_t>();
+				const uint8_t * bytes = in.bytes(len);
+				int32_t scheduled = 0;
+				p.sendMIDIPacked(key, bytes, len, &scheduled);
+				break;
+			}
+			case 11: {
+				size_t len = in.take<uint16_t>();
+				const uint8_t * bytes = in.bytes(len);
+				const double beat = in.take<double>();
+				p.loadMIDIFile(key, bytes, len, beat, in.take<int8_t>());
+				break;
+			}
+			case 12: {
+				p.sendTempo(key, in.take<double>(), now);
+				const int32_t numerator = in.take<int32_t>();
+				p.sendTimeSignature(key, numerator, in.take<int32_t>(), now);
+				break;
+			}
+			case 13: {
+				size_t len = in.take<uint16_t>();
+				const uint8_t * bytes = in.bytes(len);
+				p.restoreSnapshot(key, bytes, len);
+				break;
+			}
+			case 14: {
+				//a real snapshot with one byte changed
+				size_t full = 0;
+				size_t written = 0;
+				if (p.getSnapshotSize(key, &full, nullptr)) {
+					scratch.resize(full);
+					if (p.captureSnapshot(key, scratch.data(), scratch.size(), &written) && written > 0) {
+						const size_t at = in.take<uint16_t>() % written;
+						scratch[at] ^= in.take<uint8_t>();
+						p.restoreSnapshot(key, scratch.data(), written);
+					}
+				}
+				break;
+			}
+			case 15: {
+				size_t len = in.take<uint16_t>();
+				const uint8_t * bytes = in.bytes(len);
+				std::string payload(reinterpret_cast<const char *>(bytes), len);
+				p.loadPreset(key, payload.c_str());
+				break;
+			}
+			//delays and rates a scene could plausibly ask for, so the fuzzer doesn't just run out of memory
+			case 16:
+				p.setLatencyCompensation(key, in.take<int32_t>() % 96000);
+				break;
+			case 17:
+				p.setOversampling(key, in.take<int32_t>());
+				break;
+			case 18:
+				p.setInternalSampleRate(key, in.take<int32_t>() % 192000);
+				break;
+			case 19:
+				p.poll(key);
+				break;
+		}
+	}
+
+	for (auto& slot: slots) {
+		if (slot.instance != nullptr) {
+			p.instanceDestroy(slot.instance, slot.key);
+		}
+	}
+	while (p.releaseHandles() != nullptr) {
+	}
+	return 0;
+}
+
+#if RNBO_UNITY_FUZZ_REPLAY
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <input file>...\n", argv[0]);
+		return 1;
+	}
+	for (int i = 1; i < argc; i++) {
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file) {
+			std::fprintf(stderr, "can't read %s\n", argv[i]);
+			return 1;
+		}
+		std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		LLVMFuzzerTestOneInput(input.data(), input.size());
+		std::printf("%s: %zu bytes ok\n", argv[i], input.size());
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,185 @@
+//Headless workload for profile guided optimization builds, see docs/BUILD_OPTIMIZATION.md
+//
+//Loads the (instrumented) plugin and drives it the way Unity does: through the effect definition's
+//process and parameter callbacks, and through the script instance entrypoints with scheduled
+//parameter, transport and MIDI events. Also prints the time spent processing, so the same run
+//against the regular and the optimized plugin gives you the speedup.
+//
+//usage: RNBOUnityPGOTrain <plugin path> [seconds]
+
+#include <AudioPluginInterface.h>
+
+#include <dlfcn.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+	const int samplerate = 48000;
+	const int blocksize = 512;
+	const int channels = 2;
+
+	typedef int (*GetDefinitions)(UnityAudioEffectDefinition***);
+	typedef void * (*InstanceCreate)(int32_t *);
+	typedef void (*InstanceDestroy)(void *, int32_t);
+	typedef void (*Process)(void *, double, float *, int32_t, int32_t, int32_t);
+	typedef bool (*SetParamValueNormalized)(int32_t, size_t, double, double);
+	typedef bool (*SendMIDI)(int32_t, const uint8_t *, int, double);
+	typedef bool (*SendTempo)(int32_t, double, double);
+	typedef bool (*SendTransport)(int32_t, bool, double);
+	typedef bool (*Poll)(int32_t);
+	typedef bool (*GetSnapshotSize)(int32_t, size_t *, size_t *);
+
+	template <typename T>
+	T lookup(void * lib, const char * name) {
+		return reinterpret_cast<T>(dlsym(lib, name));
+	}
+
+	//a few notes a second, with the matching note offs
+	void sendNotes(SendMIDI sendMIDI, int32_t key, std::mt19937& rng, double now, double duration) {
+		if (sendMIDI == nullptr)
+			return;
+		std::uniform_int_distribution<int> pitch(36, 96);
+		for (double t = 0.0; t < duration; t += 125.0) {
+			uint8_t p = static_cast<uint8_t>(pitch(rng));
+			uint8_t on[3] = { 0x90, p, 100 };
+			uint8_t off[3] = { 0x80, p, 0 };
+			sendMIDI(key, on, 3, now + t);
+			sendMIDI(key, off, 3, now + t + 100.0);
+		}
+	}
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <plugin path> [seconds]\n", argv[0]);
+		return 1;
+	}
+	const double seconds = argc > 2 ? std::atof(argv[2]) : 30.0;
+	const int64_t blocks = static_cast<int64_t>(seconds * samplerate / blocksize);
+
+	void * lib = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+	if (lib == nullptr) {
+		std::fprintf(stderr, "failed to load %s: %s\n", argv[1], dlerror());
+		return 1;
+	}
+
+	auto getDefinitions = lookup<GetDefinitions>(lib, "UnityGetAudioEffectDefinitions");
+	auto instanceCreate = lookup<InstanceCreate>(lib, "RNBOInstanceCreate");
+	auto instanceDestroy = lookup<InstanceDestroy>(lib, "RNBOInstanceDestroy");
+	auto process = lookup<Process>(lib, "RNBOProcess");
+	auto setParamNormalized = lookup<SetParamValueNormalized>(lib, "RNBOSetParamValueNormalized");
+	auto sendMIDI = lookup<SendMIDI>(lib, "RNBOSendMIDI");
+	auto sendTempo = lookup<SendTempo>(lib, "RNBOSendTempoEvent");
+	auto sendTransport = lookup<SendTransport>(lib, "RNBOSendTransportEvent");
+	auto poll = lookup<Poll>(lib, "RNBOPoll");
+	auto getSnapshotSize = lookup<GetSnapshotSize>(lib, "RNBOGetSnapshotSize");
+
+	if (getDefinitions == nullptr) {
+		std::fprintf(stderr, "%s is not a unity audio plugin\n", argv[1]);
+		return 1;
+	}
+
+	UnityAudioEffectDefinition ** definitions = nullptr;
+	if (getDefinitions(&definitions) < 1) {
+		std::fprintf(stderr, "no effect definitions\n");
+		return 1;
+	}
+	UnityAudioEffectDefinition * definition = definitions[0];
+
+	std::mt19937 rng(74);
+	std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	std::vector<float> input(static_cast<size_t>(blocksize * channels));
+	std::vector<float> output(input.size());
+	std::vector<float> buffer(input.size());
+
+	UnityAudioEffectState state;
+	std::memset(&state, 0, sizeof(state));
+	state.structsize = sizeof(state);
+	state.samplerate = samplerate;
+	state.dspbuffersize = blocksize;
+	state.flags = UnityAudioEffectStateFlags_IsPlaying;
+	state.hostapiversion = UNITY_AUDIO_PLUGIN_API_VERSION;
+	//opaque to plugins, but GetEffectData asserts it is set
+	state.internal = &state;
+	definition->create(&state);
+
+	int32_t key = -1;
+	void * instance = instanceCreate ? instanceCreate(&key) : nullptr;
+
+	//the script entrypoints take RNBO parameter indices, which aren't the effect's (those start with the instance
+	//index and leave out hidden parameters). A delta snapshot entry is a full snapshot value plus a uint32_t index,
+	//so the two sizes differ by that much per parameter.
+	size_t numParams = 0;
+	size_t fullSize = 0;
+	size_t maxDeltaSize = 0;
+	if (instance != nullptr && getSnapshotSize != nullptr && getSnapshotSize(key, &fullSize, &maxDeltaSize) && maxDeltaSize > fullSize) {
+		numParams = (maxDeltaSize - fullSize) / sizeof(uint32_t);
+	}
+
+	std::chrono::nanoseconds elapsed(0);
+	for (int64_t b = 0; b < blocks; b++) {
+		const double now = 1000.0 * static_cast<double>(b * blocksize) / samplerate;
+
+		//events, roughly every quarter second
+		if (b % 24 == 0) {
+			for (UInt32 p = 0; p < definition->numparameters; p++) {
+				const auto& def = definition->paramdefs[p];
+				//leave the instance index alone
+				if (std::strncmp(def.name, "Instance Index", 14) == 0)
+					continue;
+				definition->setfloatparameter(&state, static_cast<int>(p), def.min + unit(rng) * (def.max - def.min));
+			}
+			if (instance != nullptr) {
+				if (setParamNormalized) {
+					for (size_t p = 0; p < numParams; p++) {
+						setParamNormalized(key, p, unit(rng), now + 10.0);
+					}
+				}
+				sendNotes(sendMIDI, key, rng, now, 250.0);
+			}
+		}
+		if (instance != nullptr && b % 480 == 0) {
+			if (sendTempo)
+				sendTempo(key, 90.0 + 60.0 * unit(rng), now);
+			if (sendTransport)
+				sendTransport(key, true, now);
+		}
+
+		for (auto& s: input) {
+			s = noise(rng);
+		}
+		buffer = input;
+
+		state.currdsptick = static_cast<UInt64>(b * blocksize);
+		auto start = std::chrono::steady_clock::now();
+		definition->process(&state, input.data(), output.data(), blocksize, channels, channels);
+		if (instance != nullptr && process != nullptr) {
+			process(instance, now, buffer.data(), channels, blocksize, samplerate);
+		}
+		elapsed += std::chrono::steady_clock::now() - start;
+
+		if (instance != nullptr && poll != nullptr) {
+			poll(key);
+		}
+	}
+
+	if (instance != nullptr && instanceDestroy != nullptr) {
+		instanceDestroy(instance, key);
+	}
+	definition->release(&state);
+
+	const double ms = std::chrono::duration<double, std::milli>(elapsed).count();
+	std::printf("processed %lld blocks of %d frames in %.2f ms, %.3f us per block\n",
+			static_cast<long long>(blocks), blocksize, ms, blocks > 0 ? 1000.0 * ms / blocks : 0.0);
+
+	//don't dlclose, the profile is written at exit and needs the instrumented code mapped
+	return 0;
+}
@@ -0,0 +1,257 @@
+//Multi-threaded stress driver for the script entrypoints, see docs/BUILD_OPTIMIZATION.md
+//
+//Loads the plugin and hammers it from several threads at once the way a busy scene does: one thread
+//creates and destroys instances, simulated audio threads process them, and script threads send
+//parameters, messages, MIDI, transport callbacks, snapshots and polls at random, to live keys and to
+//stale ones. Built with RNBO_UNITY_SANITIZE, races and use after free show up as sanitizer reports.
+//Prints the throughput of the script calls and of the audio blocks, to compare concurrency changes.
+//
+//usage: RNBOUnityStress <plugin path> [seconds] [script threads] [audio threads]
+
+#include <dlfcn.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+	const int samplerate = 48000;
+	const int blocksize = 256;
+	const int channels = 2;
+	const size_t numslots = 16;
+
+	typedef void * (*InstanceCreate)(int32_t *);
+	typedef void (*InstanceDestroy)(void *, int32_t);
+	typedef void (*Process)(void *, double, float *, int32_t, int32_t, int32_t);
+	typedef bool (*SetParamValue)(int32_t, size_t, double, double);
+	typedef bool (*RampParamValue)(int32_t, size_t, double, double, int32_t, double);
+	typedef bool (*SendMessageNumber)(int32_t, uint32_t, double, double);
+	typedef bool (*ScheduleMessageNumber)(int32_t, uint32_t, double, double, int32_t);
+	typedef int32_t (*CancelScheduledGroup)(int32_t, int32_t);
+	typedef bool (*SendMIDI)(int32_t, const uint8_t *, int, double);
+	typedef bool (*Poll)(int32_t);
+	typedef void * (*ReleaseHandles)();
+	typedef void (*TransportRequestCallback)(void *, double, uint8_t *, double *, double *, int32_t *, int32_t *);
+	typedef bool (*RegisterTransportRequestCallback)(int32_t, TransportRequestCallback, void *);
+	typedef void (*RegisterGlobalTransportRequestCallback)(TransportRequestCallback, void *);
+	typedef bool (*ClearRegisteredCallbacks)(int32_t);
+	typedef bool (*SetLatencyCompensation)(int32_t, int32_t);
+	typedef bool (*SetOversampling)(int32_t, int32_t);
+	typedef bool (*GetSnapshotSize)(int32_t, size_t *, size_t *);
+	typedef bool (*CaptureSnapshot)(int32_t, uint8_t *, size_t, size_t *);
+	typedef bool (*RestoreSnapshot)(int32_t, const uint8_t *, size_t);
+
+	template <typename T>
+	T lookup(void * lib, const char * name) {
+		return reinterpret_cast<T>(dlsym(lib, name));
+	}
+
+	void transportRequest(void *, double, uint8_t * running, double * bpm, double * beattime, int32_t * num, int32_t * denom) {
+		*running = 1;
+		*bpm = 120.0;
+		*beattime = 0.0;
+		*num = 4;
+		*denom = 4;
+	}
+
+	//an instance as script sees it, the audio threads read the pointer without a lock like Unity's do
+	struct Slot {
+		std::mutex mutex;
+		std::atomic<void *> instance { nullptr };
+		std::atomic<int32_t> key { 0 };
+	};
+}
+
+int main(int argc, char * argv[]) {
+	if (argc < 2) {
+		std::fprintf(stderr, "usage: %s <plugin path> [seconds] [script threads] [audio threads]\n", argv[0]);
+		return 1;
+	}
+	const double seconds = argc > 2 ? std::atof(argv[2]) : 10.0;
+	const int scriptThreads = argc > 3 ? std::atoi(argv[3]) : 4;
+	const int audioThreads = argc > 4 ? std::atoi(argv[4]) : 2;
+
+	void * lib = dlopen(argv[1], RTLD_NOW | RTLD_LOCAL);
+	if (lib == nullptr) {
+		std::fprintf(stderr, "failed to load %s: %s\n", argv[1], dlerror());
+		return 1;
+	}
+
+	auto instanceCreate = lookup<InstanceCreate>(lib, "RNBOInstanceCreate");
+	auto instanceDestroy = lookup<InstanceDestroy>(lib, "RNBOInstanceDestroy");
+	auto process = lookup<Process>(lib, "RNBOProcess");
+	auto setParamValue = lookup<SetParamValue>(lib, "RNBOSetParamValue");
+	auto rampParamValue = lookup<RampParamValue>(lib, "RNBORampParamValue");
+	auto sendMessageNumber = lookup<SendMessageNumber>(lib, "RNBOSendMessageNumber");
+	auto scheduleMessageNumber = lookup<ScheduleMessageNumber>(lib, "RNBOScheduleMessageNumber");
+	auto cancelScheduledGroup = lookup<CancelScheduledGroup>(lib, "RNBOCancelScheduledGroup");
+	auto sendMIDI = lookup<SendMIDI>(lib, "RNBOSendMIDI");
+	auto poll = lookup<Poll>(lib, "RNBOPoll");
+	auto releaseHandles = lookup<ReleaseHandles>(lib, "RNBOReleaseHandles");
+	auto registerTransportRequest = lookup<RegisterTransportRequestCallback>(lib, "RNBORegisterTransportRequestCallback");
+	auto registerGlobalTransportRequest = lookup<RegisterGlobalTransportRequestCallback>(lib, "RNBORegisterGlobalTransportRequestCallback");
+	auto clearCallbacks = lookup<ClearRegisteredCallbacks>(lib, "RNBOClearRegisteredCallbacks");
+	auto setLatencyCompensation = lookup<SetLatencyCompensation>(lib, "RNBOSetLatencyCompensation");
+	auto setOversampling = lookup<SetOversampling>(lib, "RNBOSetOversampling");
+	auto getSnapshotSize = lookup<GetSnapshotSize>(lib, "RNBOGetSnapshotSize");
+	auto captureSnapshot = lookup<CaptureSnapshot>(lib, "RNBOCaptureSnapshot");
+	auto restoreSnapshot = lookup<RestoreSnapshot>(lib, "RNBORestoreSnapshot");
+
+	if (instanceCreate == nullptr || instanceDestroy == nullptr || process == nullptr || setParamValue == nullptr ||
+			rampParamValue == nullptr || sendMessageNumber == nullptr || scheduleMessageNumber == nullptr ||
+			cancelScheduledGroup == nullptr || sendMIDI == nullptr || poll == nullptr || releaseHandles == nullptr ||
+			registerTransportRequest == nullptr || registerGlobalTransportRequest == nullptr || clearCallbacks == nullptr ||
+			setLatencyCompensation == nullptr || setOversampling == nullptr || getSnapshotSize == nullptr ||
+			captureSnapshot == nullptr || restoreSnapshot == nullptr) {
+		std::fprintf(stderr, "%s doesn't have the script instance entrypoints\n", argv[1]);
+		return 1;
+	}
+
+	std::vector<Slot> slots(numslots);
+	std::atomic<bool> running(true);
+	std::atomic<uint64_t> ops(0);
+	std::atomic<uint64_t> blocks(0);
+	std::vector<std::thread> threads;
+
+	//create and destroy, destroying twice to check the second one is refused
+	threads.emplace_back([&]() {
+		std::mt19937 rng(1);
+		while (running.load()) {
+			Slot& slot = slots[rng() % slots.size()];
+			{
+				std::lock_guard<std::mutex> guard(slot.mutex);
+				void * instance = slot.instance.load();
+				if (instance != nullptr) {
+					const int32_t key = slot.key.exchange(0);
+					slot.instance.store(nullptr);
+					instanceDestroy(instance, key);
+					instanceDestroy(instance, key);
+				} else {
+					int32_t key = 0;
+					instance = instanceCreate(&key);
+					slot.key.store(key);
+					slot.instance.store(instance);
+				}
+			}
+			ops++;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	});
+
+	//audio, each thread processes its share of the slots block after block, as fast as it can
+	for (int a = 0; a < audioThreads; a++) {
+		threads.emplace_back([&, a]() {
+			std::vector<float> buffer(static_cast<size_t>(blocksize * channels));
+			double now = 0.0;
+			while (running.load()) {
+				for (size_t i = static_cast<size_t>(a); i < slots.size(); i += static_cast<size_t>(audioThreads)) {
+					void * instance = slots[i].instance.load();
+					if (instance != nullptr) {
+						process(instance, now, buffer.data(), channels, blocksize, samplerate);
+					}
+				}
+				now += 1000.0 * blocksize / samplerate;
+				blocks++;
+			}
+		});
+	}
+
+	//script, mostly live keys, sometimes one that was never or is no longer valid
+	for (int t = 0; t < scriptThreads; t++) {
+		threads.emplace_back([&, t]() {
+			std::mt19937 rng(static_cast<unsigned>(10 + t));
+			std::vector<uint8_t> snapshot;
+			while (running.load()) {
+				int32_t key = slots[rng() % slots.size()].key.load();
+				if (key == 0) {
+					key = -static_cast<int32_t>(rng() % 64);
+				}
+				const double at = static_cast<double>(rng() % 100000);
+				switch (rng() % 14) {
+					case 0:
+						setParamValue(key, rng() % 8, static_cast<double>(rng() % 1000) / 1000.0, 0.0);
+						break;
+					case 1:
+						rampParamValue(key, rng() % 8, static_cast<double>(rng() % 1000) / 1000.0, 50.0, static_cast<int32_t>(rng() % 3), 0.0);
+						break;
+					case 2:
+						sendMessageNumber(key, static_cast<uint32_t>(rng()), 1.0, at);
+						break;
+					case 3:
+						scheduleMessageNumber(key, static_cast<uint32_t>(rng()), 1.0, at, static_cast<int32_t>(rng() % 4));
+						break;
+					case 4:
+						cancelScheduledGroup(key, static_cast<int32_t>(rng() % 4));
+						break;
+					case 5: {
+						const uint8_t note[3] = { 0x90, static_cast<uint8_t>(36 + rng() % 60), 100 };
+						sendMIDI(key, note, 3, at);
+						break;
+					}
+					case 6:
+						poll(key);
+						break;
+					case 7:
+						registerTransportRequest(key, transportRequest, nullptr);
+						break;
+					case 8:
+						clearCallbacks(key);
+						break;
+					case 9:
+						registerGlobalTransportRequest(rng() % 2 ? transportRequest : nullptr, nullptr);
+						break;
+					case 10:
+						setLatencyCompensation(key, static_cast<int32_t>(rng() % 512));
+						break;
+					case 11:
+						setOversampling(key, 1 << (rng() % 4));
+						break;
+					case 12:
+					case 13: {
+						size_t full = 0;
+						size_t written = 0;
+						if (getSnapshotSize(key, &full, nullptr)) {
+							snapshot.resize(full);
+							if (captureSnapshot(key, snapshot.data(), snapshot.size(), &written)) {
+								restoreSnapshot(key, snapshot.data(), written);
+							}
+						}
+						break;
+					}
+				}
+				while (releaseHandles() != nullptr) {
+				}
+				ops++;
+			}
+		});
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	running.store(false);
+	for (auto& thread: threads) {
+		thread.join();
+	}
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	for (auto& slot: slots) {
+		void * instance = slot.instance.load();
+		if (instance != nullptr) {
+			instanceDestroy(instance, slot.key.load());
+		}
+	}
+
+	const double blockrate = blocks.load() / elapsed;
+	std::printf("%d script threads, %d audio threads, %.2f s\n", scriptThreads, audioThreads, elapsed);
+	std::printf("%llu ops, %.0f ops/s\n", static_cast<unsigned long long>(ops.load()), ops.load() / elapsed);
+	std::printf("%llu blocks of %d frames, %.0f blocks/s, %.1fx real time per audio thread\n",
+			static_cast<unsigned long long>(blocks.load()), blocksize, blockrate,
+			audioThreads > 0 ? blockrate * blocksize / samplerate / audioThreads : 0.0);
+	return 0;
+}